@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Command line client for the library server (main --server).
+// Usage:
+//   client [-s socket] COMMAND ARGS...            Send one request
+//   client [-s socket]                            Send requests read from stdin
+//   client [-s socket] --bench THREADS COUNT COMMAND ARGS...
+//                                                 Load test: COUNT requests per thread
+
+#define DEFAULT_SOCKET_PATH "library.sock"
+#define LINE_LEN 4096 // Longest request the server accepts, e.g. AVAIL with a reading list
+
+typedef struct Connection {
+    int fd;
+    char buf[LINE_LEN * 8];
+    size_t used;
+} Connection;
+
+typedef struct BenchArg {
+    const char* path;
+    const char* request;
+    int count;
+    int failures;
+} BenchArg;
+
+int connectServer(Connection* conn, const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return 0;
+    strcpy(addr.sun_path, path);
+
+    conn->used = 0;
+    conn->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn->fd < 0) return 0;
+    if (connect(conn->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(conn->fd);
+        return 0;
+    }
+    return 1;
+}
+
+int sendLine(Connection* conn, const char* line) {
+    size_t len = strlen(line);
+    char msg[LINE_LEN + 2];
+    if (len > LINE_LEN) return 0;
+    memcpy(msg, line, len);
+    msg[len++] = '\n';
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = send(conn->fd, msg + off, len - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        off += (size_t)n;
+    }
+    return 1;
+}
+
+// Reads one response line into out. Returns 0 on EOF/error.
+int readLine(Connection* conn, char* out, size_t outLen) {
+    while (1) {
+        char* nl = memchr(conn->buf, '\n', conn->used);
+        if (nl) {
+            size_t len = (size_t)(nl - conn->buf);
+            size_t copy = (len < outLen - 1) ? len : outLen - 1;
+            memcpy(out, conn->buf, copy);
+            out[copy] = '\0';
+            conn->used -= len + 1;
+            memmove(conn->buf, nl + 1, conn->used);
+            return 1;
+        }
+        if (conn->used == sizeof(conn->buf)) conn->used = 0; // Drop oversized line
+        ssize_t n = recv(conn->fd, conn->buf + conn->used, sizeof(conn->buf) - conn->used, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        conn->used += (size_t)n;
+    }
+}
+
+// Sends one request and consumes its response. Returns 1 on "OK".
+int request(Connection* conn, const char* line, int print) {
+    char resp[LINE_LEN * 2];
+    if (!sendLine(conn, line)) return 0;
+    while (readLine(conn, resp, sizeof(resp))) {
+        if (print) printf("%s\n", resp);
+        if (strncmp(resp, "OK", 2) == 0) return 1;
+        if (strncmp(resp, "ERR", 3) == 0) return 0;
+    }
+    return 0;
+}
+
+void joinArgs(char* out, size_t outLen, int argc, char* argv[]) {
+    out[0] = '\0';
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) strncat(out, " ", outLen - strlen(out) - 1);
+        strncat(out, argv[i], outLen - strlen(out) - 1);
+    }
+}
+
+void* benchWorker(void* arg) {
+    BenchArg* b = (BenchArg*)arg;
+    Connection conn;
+    if (!connectServer(&conn, b->path)) {
+        b->failures = b->count;
+        return NULL;
+    }
+    for (int i = 0; i < b->count; i++) {
+        if (!request(&conn, b->request, 0)) b->failures++;
+    }
+    close(conn.fd);
+    return NULL;
+}
+
+int runBench(const char* path, int threads, int count, const char* line) {
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    BenchArg* args = (BenchArg*)calloc(threads, sizeof(BenchArg));
+    if (!tids || !args) return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        args[i].path = path;
+        args[i].request = line;
+        args[i].count = count;
+        pthread_create(&tids[i], NULL, benchWorker, &args[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        failures += args[i].failures;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    long total = (long)threads * count;
+    printf("%ld requests (%d failed) in %.3f s: %.0f req/s\n", total, failures, secs, secs > 0 ? total / secs : 0.0);
+    free(tids);
+    free(args);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = DEFAULT_SOCKET_PATH;
+    int argi = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        path = argv[2];
+        argi = 3;
+    }
+
+    char line[LINE_LEN];
+    if (argi < argc && strcmp(argv[argi], "--bench") == 0) {
+        if (argc - argi < 4) {
+            printf("Usage: %s [-s socket] --bench THREADS COUNT COMMAND ARGS...\n", argv[0]);
+            return 1;
+        }
+        int threads = atoi(argv[argi + 1]);
+        int count = atoi(argv[argi + 2]);
+        if (threads < 1 || count < 1) return 1;
+        joinArgs(line, sizeof(line), argc - argi - 3, argv + argi + 3);
+        return runBench(path, threads, count, line);
+    }
+
+    Connection conn;
+    if (!connectServer(&conn, path)) {
+        printf("Could not connect to %s\n", path);
+        return 1;
+    }
+
+    int ok = 1;
+    if (argi < argc) {
+        joinArgs(line, sizeof(line), argc - argi, argv + argi);
+        ok = request(&conn, line, 1);
+    } else {
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = 0;
+            if (!line[0]) continue;
+            ok = request(&conn, line, 1);
+        }
+    }
+    close(conn.fd);
+    return ok ? 0 : 1;
+}
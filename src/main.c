@@ -2,9 +2,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
 
 // Constants
-#define MAX_NAME_LEN 50
+#define MAX_NAME_LEN 256 // Longest title or name accepted from input
 #define STUDENT_ID_LEN 9
 #define ISBN_LEN 14
 #define LABEL_LEN 30
@@ -12,7 +36,96 @@
 #define OP_TYPE_BORROW 0
 #define OP_TYPE_RETURN 1
 #define DATE_STR_LEN 11
-#define MAX_STATUS_LEN 20
+
+// Loan/Return Result Codes
+#define LOAN_OK 1
+#define LOAN_ERR_STUDENT 0
+#define LOAN_ERR_SCORE -1
+#define LOAN_ERR_NO_COPY -2
+#define LOAN_ERR_NOT_BORROWED -3
+#define LOAN_ERR_NO_RECORD -4
+#define LOAN_ERR_NO_BOOK -5
+#define LOAN_ERR_ON_SHELF -6
+#define LOAN_ERR_ALREADY_HELD -7
+#define LOAN_ERR_RECORD -8 // The change does not fit in a journal record
+#define DELETE_OK 1
+#define DELETE_ERR_NOT_FOUND 0
+#define DELETE_ERR_ON_LOAN -1
+
+// Server Mode
+#define SERVER_SOCKET_PATH "library.sock"
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_QUEUE_LEN 64
+#define SERVER_LINE_LEN 512
+
+// Concurrency
+#define CATALOG_SHARDS 64
+#define CATALOG_INITIAL_BUCKETS 16
+#define STUDENT_LOCK_STRIPES 64
+#define STRESS_BOOKS 200
+#define STRESS_COPIES 3
+#define STRESS_STUDENTS 100
+#define STRESS_MAX_HELD 8
+
+// Group Commit
+#define JOURNAL_DEFAULT_WINDOW_US 200
+#define JOURNAL_DEFAULT_MAX_BATCH 128
+#define JOURNAL_RECORD_LEN 2048 // Longest record: an ID and two quoted MAX_NAME_LEN fields
+#define JOURNAL_FIELD_LEN (2 * MAX_NAME_LEN + 2) // One quoted text field
+#define JOURNAL_URING_DEPTH 16
+#define JOURNAL_URING_INFLIGHT 4 // Batches written + fsynced concurrently
+#define JOURNAL_SEQ_FAILED ((unsigned long)-1) // The record could not be journaled
+#define LATENCY_BENCH_DEFAULT_OPS 2000
+
+// Background Checkpoint
+#define CHECKPOINT_DEFAULT_INTERVAL_SEC 30
+#define CHECKPOINT_DEFAULT_DIRTY 256
+
+// Title Index
+#define TITLE_INDEX_LEVELS 16
+#define TITLE_PAGE_SIZE 20
+
+// Circulation Statistics
+#define STATS_TOP_K 10
+#define STATS_DURATION_BUCKETS 5
+
+// Loan History Archive
+#define ARCHIVE_DEFAULT_HORIZON_DAYS 365
+#define INTERVAL_OPEN INT_MAX // End day of a loan that is still out
+#define COLUMNS_MAGIC "LCOL"
+#define COLUMNS_VERSION 2 // Version 1 headers end before archivedBefore
+#define TRENDS_TOP_TITLES 10
+#define HISTORY_BENCH_DEFAULT_RECORDS 1000000
+
+// Batch Availability
+#define AVAIL_PREFETCH_DISTANCE 8 // Keys between a bucket prefetch and its probe
+#define AVAIL_BENCH_DEFAULT_BOOKS 100000
+#define FILE_BENCH_HISTORY_CSV "bench_history.csv"
+#define FILE_BENCH_HISTORY_COL "bench_history.col"
+
+// Partitioned Catalog (kiosk mode)
+#define CATALOG_PARTITIONS 64
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_HASHES 7
+#define KIOSK_DEFAULT_BUDGET_KB 8192
+#define KIOSK_RELOAD_CHECK_SEC 1
+#define IMAGE_MAGIC "LIMG"
+#define IMAGE_VERSION 1
+
+// CSV Reader
+#define CSV_MAX_FIELDS 16
+#define PARSE_BENCH_DEFAULT_ROWS 1000000
+#define FILE_BENCH_PARSE "bench_parse.csv"
+
+// CSV Writer
+#define CSV_WRITE_BUFFER (1 << 20)
+#define SAVE_BENCH_DEFAULT_COPIES 1000000
+#define FILE_BENCH_SAVE "bench_copies.csv"
+
+// String Arena
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_INITIAL_SLOTS 1024
+#define MEMORY_REPORT_DEFAULT_BOOKS 100000
 
 // File Names 
 #define FILE_AUTHORS "authors.csv"
@@ -21,38 +134,80 @@
 #define FILE_BOOK_AUTHORS "book_authors.csv"
 #define FILE_LOANS "loans.csv"
 #define FILE_COPIES "copies.csv" // Was "ornekler.csv"
+#define FILE_STATS "stats.csv"
+#define FILE_HOLDS "holds.csv"
+#define FILE_JOURNAL "journal.log"
+#define JOURNAL_GENERATION_FMT "%s.%d" // Rotated journal awaiting a checkpoint, numbered from 1
+#define CHECKPOINT_TMP_SUFFIX ".tmp"
+#define ARCHIVE_DIR "archive"
+#define CATALOG_DIR "catalog"
+#define FILE_CATALOG_DIRECTORY "catalog/directory.csv"
+#define FILE_CATALOG_IMAGE "catalog/image.bin"
+#define FILE_CATALOG_GENERATION "catalog/generation"
+#define FILE_BENCH_JOURNAL "bench_journal.log"
+#define FILE_LIBRARY_BIN "library.bin"
+
+// Storage Engines
+#define BINARY_MAGIC "LBIN"
+#define BINARY_VERSION 1
+#define STORAGE_BENCH_DEFAULT_BOOKS 100000
+#define STORAGE_BENCH_DIR "bench_storage"
 
 // --- STRUCTS ---
 
 typedef struct Author {
     int id;
-    char name[MAX_NAME_LEN];
-    char surname[MAX_NAME_LEN];
+    const char* name;    // Interned
+    const char* surname; // Interned
     struct Author *next;
 } Author;
 
 typedef struct Student {
     char studentId[STUDENT_ID_LEN];
-    char name[MAX_NAME_LEN];
-    char surname[MAX_NAME_LEN];
     int score;
+    int activeLoans;     // Copies currently held
+    const char* name;    // Interned
+    const char* surname; // Interned
     struct Student *prev;
     struct Student *next;
+    struct BookCopy* loans; // Open loans, linked through holderNext
 } Student;
 
 typedef struct BookCopy {
     char labelNo[ISBN_LEN + 10]; // E.g., ISBN_1
     char borrowerStudentId[STUDENT_ID_LEN];
-    char status[MAX_STATUS_LEN];
     struct BookCopy* next;
+    struct LoanTransaction* loan; // Borrow record of the open loan, NULL on shelf
+    struct BookCopy* holderNext;  // Next open loan of the same student
 } BookCopy;
 
+// A student waiting for a copy of a book
+typedef struct Hold {
+    char studentId[STUDENT_ID_LEN];
+    char date[DATE_STR_LEN];
+    struct Hold* next;
+} Hold;
+
+typedef struct HoldQueue {
+    Hold* head;
+    Hold* tail;
+    int count;
+} HoldQueue;
+
 typedef struct Book {
-    char title[MAX_NAME_LEN];
+    const char* title; // Interned
     char isbn[ISBN_LEN];
+    unsigned char skipLevels; // Title index levels, including next
     int quantity;
+    int checkedOut;           // Copies currently lent
+    int borrowCount;          // Loans since the library was created
+    int authorRowCount;
+    int* authorRows;          // Rows of this book in the book-author map
     BookCopy* copies;
     struct Book* next;
+    struct Book* isbnNext; // Chain within the catalog shard bucket
+    struct Book** skip;    // Title index links above next
+    HoldQueue* holds;      // FIFO of waiting students, NULL when empty
 } Book;
 
 // Many-to-Many Relationship Map
@@ -69,24 +224,445 @@ typedef struct LoanTransaction {
     struct LoanTransaction* next;
 } LoanTransaction;
 
+// One batch handed to io_uring: a write linked to an fdatasync
+typedef struct JournalSlot {
+    char* buf;
+    size_t cap;
+    size_t bytes;
+    off_t offset;     // Where the batch goes in the journal file
+    int take;         // Records in the batch
+    int written;      // Result of the write (bytes or -errno)
+    int done;         // Both operations completed
+} JournalSlot;
+
+// io_uring instance of the committer, set up with raw syscalls. The
+// kernel types are only named inside the HAVE_IO_URING code.
+typedef struct JournalRing {
+    int fd;           // -1 when the thread backend is in use
+    void* sqMap;
+    void* cqMap;
+    size_t sqMapLen, cqMapLen, sqesLen;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    void* sqes;
+    void* cqes;
+    JournalSlot slots[JOURNAL_URING_INFLIGHT]; // Oldest at slotHead
+    int slotHead;
+    int inflight;
+} JournalRing;
+
+// Write-ahead journal for circulation. Transactions are queued and one
+// committer thread writes each batch with a single write + fdatasync.
+typedef struct Journal {
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // Signalled when records are queued
+    pthread_cond_t done;  // Broadcast when a batch becomes durable
+    int fd;
+    char path[256];
+    int running;
+    pthread_t thread;
+    char* pending;        // Queued record bytes
+    size_t pendingLen;
+    size_t pendingCap;
+    size_t* recordEnds;   // End offset of each queued record
+    int recordCount;
+    int recordCap;
+    unsigned long appendedSeq;
+    unsigned long takenSeq;       // Last record handed to a batch
+    unsigned long durableSeq;
+    unsigned long rotateSeq;      // Last record before a pending rotation
+    int rotatePending;            // The committer stops at rotateSeq until the file is switched
+    int windowUs;         // How long the committer waits for a batch to fill
+    int maxBatch;         // Records per write + fdatasync
+    unsigned long batches;
+    unsigned long records;
+    int useUring;         // Requested backend; falls back to the thread if setup fails
+    int asyncCommit;      // Changes return before their record is durable
+    int failed;           // A write or fdatasync failed; nothing more is accepted
+    off_t offset;         // End of the journal file (io_uring writes at explicit offsets)
+    JournalRing ring;
+} Journal;
+
+// Circulation counters kept up to date by every borrow and return
+typedef struct CirculationStats {
+    long loans;
+    long returns;
+    long penalties;         // Returns that cost points
+    long penaltyPoints;
+    long loanDays;          // Total duration of closed loans
+    long durations[STATS_DURATION_BUCKETS]; // Closed loans per duration range
+    Book* top[STATS_TOP_K]; // Most borrowed books, descending
+    int topCount;
+} CirculationStats;
+
+// Consistent copy of the resident state taken at one epoch. Rows are
+// linked through their next pointers so the save functions can write
+// them directly. Loan history nodes are never modified after they are
+// published, so the snapshot shares them instead of copying.
+typedef struct Snapshot {
+    unsigned long epoch;
+    Author* authors;
+    Student* students;
+    Book* books;
+    BookCopy* copies;
+    LoanTransaction* loans;
+    BookAuthorMap* map;
+    HoldQueue* holdQueues;
+    Hold* holds;
+    CirculationStats stats;
+    int authorCount;
+    int studentCount;
+    int bookCount;
+    int mapCount;
+} Snapshot;
+
+typedef struct Checkpointer {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    struct Library* lib;
+    int intervalSec;      // Checkpoint at least this often while dirty
+    int dirtyThreshold;   // ...or as soon as this many changes pile up
+    int dirty;
+    unsigned long epoch;
+} Checkpointer;
+
+// ISBN hash index, split into independently locked shards.
+// Lock order: persistLock -> libraryLock -> intervalIndex.lock -> catalog
+// shards (ascending) -> student stripes (ascending) -> loanLock -> statsLock.
+typedef struct CatalogShard {
+    pthread_mutex_t lock; // Guards copy state of the books in this shard
+    Book** buckets;
+    int bucketCount;
+    int count;
+} CatalogShard;
+
+// All resident state, shared by the console and the server
+typedef struct Library {
+    Author* authors;
+    Student* students;
+    Book* books;
+    LoanTransaction* loans;
+    BookAuthorMap* mapArr;
+    int mapCount;
+    int lastAuthorID;
+} Library;
+
+// Persistence backend. Loading builds the resident state, every change
+// is handed to apply as a journal-format record, and checkpoints write a
+// consistent snapshot. Selected with --storage (see STORAGE ENGINES).
+typedef struct StorageEngine {
+    const char* name;
+    void (*loadAll)(Library* lib);
+    int (*open)(void);                                      // Start accepting changes
+    unsigned long (*apply)(const char* record, size_t len); // Commit sequence to wait for, 0 for none, JOURNAL_SEQ_FAILED if lost
+    int (*checkpoint)(Snapshot* snap);                      // NULL when nothing is persisted
+    void (*close)(void);
+} StorageEngine;
+
+// One ISBN-hash partition of the on-disk catalog (catalog/part_NN.csv).
+// The directory entry (counts and Bloom filter) is always resident; the
+// books and copies are faulted in on first lookup and evicted LRU.
+typedef struct CatalogPartition {
+    int bookCount;
+    int copyCount;
+    size_t bytes;           // Resident size once loaded
+    uint32_t bloomBits;     // Power of two, 0 when the partition is empty
+    uint64_t* bloom;
+    Book* books;            // Sorted by ISBN, NULL while not resident
+    BookCopy* copies;
+    char* text;             // Titles of the resident books
+    unsigned long lastUse;
+} CatalogPartition;
+
+// Read-only catalog served from the partitions under a memory budget
+typedef struct PartitionedCatalog {
+    pthread_mutex_t lock;
+    CatalogPartition parts[CATALOG_PARTITIONS];
+    size_t budget;
+    size_t resident;
+    unsigned long tick;
+    unsigned long lookups, bloomSkips, loads, evictions;
+    struct timespec directoryMtime;
+    time_t lastCheck;
+} PartitionedCatalog;
+
+// Shared catalog image (catalog/image.bin): one immutable, pointer-free
+// file that reader processes map read-only. Sections follow the header
+// in this order, each 8-byte aligned; every reference is an index or an
+// offset into the text section.
+typedef struct ImageHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t generation;
+    uint64_t size;         // Whole file
+    uint32_t bookCount;    // In title order
+    uint32_t copyCount;
+    uint32_t authorCount;
+    uint32_t linkCount;
+    uint32_t bucketCount;  // Power of two; entries are book index + 1
+    uint32_t reserved;
+    uint64_t bucketsOff, booksOff, copiesOff, authorsOff, linksOff, textOff, textLen;
+} ImageHeader;
+
+typedef struct ImageBook {
+    char isbn[ISBN_LEN];
+    uint32_t titleOff;
+    int32_t quantity;
+    int32_t available;
+    int32_t borrowCount;
+    uint32_t firstCopy, copyCount;
+    uint32_t firstLink, linkCount; // Author indexes in the links section
+} ImageBook;
+
+typedef struct ImageCopy {
+    char labelNo[ISBN_LEN + 10];
+    char borrowerStudentId[STUDENT_ID_LEN];
+} ImageCopy;
+
+typedef struct ImageAuthor {
+    int32_t id;
+    uint32_t nameOff, surnameOff;
+} ImageAuthor;
+
+// A reader's view of the image. The generation word is shared with the
+// writer; a new value means a newer image has been renamed into place.
+typedef struct CatalogImage {
+    const unsigned char* base;
+    size_t size;
+    const ImageHeader* header;
+    const uint64_t* generation;
+    uint64_t mapped;           // Generation of the mapped image
+} CatalogImage;
+
+// Closed loan records selected to move out of the resident history
+typedef struct ArchivePlan {
+    LoanTransaction** nodes; // By month, chronological within a month
+    int* returned;           // Return day of the record's borrow/return pair
+    int* pair;               // Shared by the two records of a pair
+    unsigned char* archived; // Set once the record is in its segment
+    int count;
+    int cutoffDay;
+} ArchivePlan;
+
+// Field of the current CSV record. Points into the reader's buffer and
+// is valid until the next record is read; it is not NUL-terminated.
+typedef struct CsvField {
+    const char* ptr;
+    size_t len;
+} CsvField;
+
+// Whole-file CSV reader. The file is mapped privately (or read into one
+// buffer when it cannot be mapped) and records are split in place.
+typedef struct CsvReader {
+    char* data;
+    size_t size;
+    size_t pos;
+    int mapped;
+    int fieldCount;
+    CsvField fields[CSV_MAX_FIELDS];
+} CsvReader;
+
+// Buffered output file used by every saver
+typedef struct CsvWriter {
+    int fd;
+    char* buf;
+    size_t len;
+    int failed;
+} CsvWriter;
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t used;
+    size_t cap;
+    char data[];
+} ArenaChunk;
+
+// Interned strings: chunks hold the bytes, slots is an open-addressing
+// set of the stored strings
+typedef struct StringArena {
+    pthread_mutex_t lock;
+    ArenaChunk* chunks;
+    const char** slots;
+    size_t slotCount;
+    size_t count;
+    size_t bytes;    // String bytes stored
+    size_t reserved; // Chunk bytes allocated
+} StringArena;
+
+// Strings numbered in insertion order. The text blob holds them
+// NUL-terminated; slots (open addressing, id + 1, 0 = empty) map back.
+typedef struct StringDict {
+    char* text;
+    size_t textLen;
+    size_t textCap;
+    int* offsets;       // Start of each string in text
+    int count;
+    int cap;
+    int* slots;
+    int slotCount;
+} StringDict;
+
+// Loan records in columns. Student IDs and ISBNs are dictionary ids and
+// the copy number comes from the label suffix; the three are bit-packed
+// at the width their largest value needs. Days are zigzag varint deltas
+// from the previous record, and the op type is one bit per record.
+typedef struct LoanColumns {
+    int count;
+    StringDict students;
+    StringDict isbns;
+    unsigned char studentBits;
+    unsigned char isbnBits;
+    unsigned char copyBits;
+    uint64_t* studentCol;
+    uint64_t* isbnCol;
+    uint64_t* copyCol;     // Copy number + 1, 0 when the label has no suffix
+    uint64_t* opCol;       // Bit set for returns
+    unsigned char* days;
+    size_t daysLen;
+    int archivedBefore;    // Archive segments: pairs returned before this day are all held
+} LoanColumns;
+
+// On-disk header of a columnar file, followed by the student and ISBN
+// text (each padded to 8 bytes), the four packed columns and the days.
+// Fields are in host byte order.
+typedef struct ColumnFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t studentCount;
+    uint32_t isbnCount;
+    uint32_t studentTextLen;
+    uint32_t isbnTextLen;
+    unsigned char bits[4]; // Student, ISBN, copy, unused
+    uint64_t daysLen;
+    int32_t archivedBefore;
+    uint32_t reserved;
+} ColumnFileHeader;
+
+// Borrow/return pair as a span of day numbers
+typedef struct LoanInterval {
+    const char* label;     // Interned
+    const char* studentId; // Interned
+    int start;
+    int end;               // INTERVAL_OPEN until returned
+} LoanInterval;
+
+// Intervals of one label or student, ordered by start. maxEnd holds the
+// largest end in the implicit subtree rooted at each position.
+typedef struct IntervalList {
+    const char* key;       // Interned, NULL for an empty slot
+    int* items;            // Interval numbers
+    int* maxEnd;
+    int count;
+    int cap;
+    int dirty;             // maxEnd is out of date
+    int unsorted;          // An interval was appended out of start order
+} IntervalList;
+
+typedef struct IntervalMap {
+    IntervalList* slots;
+    int slotCount;
+    int count;
+} IntervalMap;
+
+typedef struct IntervalIndex {
+    pthread_mutex_t lock;
+    int built;
+    unsigned long consumed; // History records applied so far
+    LoanInterval* intervals;
+    int count;
+    int cap;
+    IntervalMap byLabel;
+    IntervalMap byStudent;
+} IntervalIndex;
+
 // --- PROTOTYPES ---
 int isStudentExists(Student* head, const char * studentId);
-int isBookOnShelf(Book* head, const char* labelNo);
-int isStudentScorePositive(Student* head, const char* studentId);
-void saveBooksToFile(Book* head, const char* filename);
-void borrowBookCopy(Book** head, const char* label, const char * studentId);
-int isBookCopyBorrowed(Book* head, const char* label, const char* studentId);
-void returnBookCopy(Book** head, const char* label);
-void updateStudentScore(Student** head, const char* studentId, int points);
-void saveStudentsToFile(Student* head, const char* filename);
+int saveBooksToFile(Book* head, const char* filename);
+int saveStudentsToFile(Student* head, const char* filename);
 void freeBookCopies(BookCopy* head);
 void listNonReturnedBooks(Student* sHead, Book* bHead);
 void listAuthors(Author* head);
-void saveBookAuthorMapToFile(BookAuthorMap* array, int count);
-void saveBookCopiesToFile(Book* head, const char* filename);
+int saveBookAuthorMapToFile(BookAuthorMap* array, int count, const char* filename);
+int saveBookCopiesToFile(Book* head, const char* filename);
+int saveLoansToFile(LoanTransaction* head, const char* filename);
+int dateToDayNumber(const char* date);
+int daysFromCivil(int y, int m, int d);
+void dayNumberToCivil(int days, int* year, int* month, int* day);
+int loadSegment(int monthKey, LoanColumns* cols);
+void formatDayNumber(int days, char* out, size_t len);
+int planArchive(LoanTransaction* head, int cutoffDay, ArchivePlan* plan);
+int writeArchiveSegments(ArchivePlan* plan);
+void keepArchivedPairs(ArchivePlan* plan);
+void dropArchivedHistory(Library* lib);
+void detachArchived(Library* lib, ArchivePlan* plan);
+void archivePlanFree(ArchivePlan* plan);
+void intervalIndexSync(LoanTransaction** lHead);
+void intervalIndexReset(void);
+void statsRecordLoan(Book* book, Student* student);
+void statsRecordReturn(Book* book, Student* student, int days, int penalty);
+void statsRebuildTop(Book* head);
+void statsForgetBook(Book* head, Book* book);
+void statsRead(CirculationStats* out);
+int saveStatsToFile(const CirculationStats* stats, const char* filename);
+char* findBorrowDate(LoanTransaction* head, const char* sId, const char* label);
+int holdRemove(Book* book, const char* sId);
+void removeBookAuthorRows(Book* book, BookAuthorMap* arr, int* count);
+void freeHolds(Book* book);
+unsigned long dispatchHold(Student* sHead, Book* book, BookCopy* copy, LoanTransaction** lHead,
+                           const char* date, char* holderOut);
+int saveHoldsToFile(Book* head, const char* filename);
+int getDaysDifference(const char* start, const char* end);
+int binaryLoad(Library* lib);
+
+// --- GLOBAL STATE ---
+
+static CatalogShard catalogShards[CATALOG_SHARDS];
+static pthread_mutex_t studentLocks[STUDENT_LOCK_STRIPES];
+static pthread_mutex_t loanLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t persistLock = PTHREAD_MUTEX_INITIALIZER;
+extern const StorageEngine csvEngine, binaryEngine, memoryEngine;
+static const StorageEngine* storage = &csvEngine;
+static int archiveHorizonDays = ARCHIVE_DEFAULT_HORIZON_DAYS;
+// Structure of the lists: readers (lookups, circulation, snapshots) share
+// it, inserts and deletes take it exclusively
+static pthread_rwlock_t libraryLock = PTHREAD_RWLOCK_INITIALIZER;
+static StringArena stringArena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static Book* titleLevels[TITLE_INDEX_LEVELS]; // Skip list heads; level 0 is the book list head
+static int titleTopLevel = 1;
+static CirculationStats circulation;
+static unsigned long loanHistoryAdded; // Records pushed onto the history head, guarded by loanLock
+static IntervalIndex intervalIndex = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static Checkpointer checkpointer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .intervalSec = CHECKPOINT_DEFAULT_INTERVAL_SEC,
+    .dirtyThreshold = CHECKPOINT_DEFAULT_DIRTY,
+};
+static Journal journal = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .fd = -1,
+    .useUring = 1,
+    .ring = { .fd = -1 },
+    .windowUs = JOURNAL_DEFAULT_WINDOW_US,
+    .maxBatch = JOURNAL_DEFAULT_MAX_BATCH,
+};
 
 // --- HELPER FUNCTIONS ---
 
+Student* findStudent(Student* head, const char* studentId) {
+    while (head) {
+        if (strcmp(head->studentId, studentId) == 0) return head;
+        head = head->next;
+    }
+    return NULL;
+}
+
 int isStudentExists(Student* head, const char* studentId) {
     Student* current = head;
     while (current != NULL) {
@@ -98,51 +674,575 @@ int isStudentExists(Student* head, const char* studentId) {
     return 0;
 }
 
-const char* findBookLabelByISBN(Book* head, const char* isbn) {
-    Book* kCurrent = head;
-    while (kCurrent) {
-        if (strcmp(kCurrent->isbn, isbn) == 0) {
-            BookCopy* oCurrent = kCurrent->copies;
-            while (oCurrent) {
-                if (strcmp(oCurrent->borrowerStudentId, "SHELF") == 0) { // Was "RAFTA"
-                    return oCurrent->labelNo;
-                }
-                oCurrent = oCurrent->next;
+// --- CSV READER ---
+// All CSV files are parsed through one reader. Records are split without
+// copying: fields are views into the mapped file. Quoted fields may hold
+// commas, newlines and doubled quotes; the quotes are removed in place,
+// which is why the mapping is private and writable.
+
+int csvOpen(CsvReader* r, const char* filename) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    r->size = (size_t)st.st_size;
+    if (r->size > 0) {
+        void* map = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, r->size, MADV_SEQUENTIAL);
+            r->data = (char*)map;
+            r->mapped = 1;
+        } else {
+            r->data = (char*)malloc(r->size);
+            size_t got = 0;
+            while (r->data && got < r->size) {
+                ssize_t n = read(fd, r->data + got, r->size - got);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += (size_t)n;
             }
+            if (!r->data) got = 0;
+            r->size = got;
         }
-        kCurrent = kCurrent->next;
     }
-    return NULL;
+    close(fd);
+    return 1;
 }
 
-int isBookOnShelf(Book* head, const char* labelNo) {
-    Book* kCurrent = head;
-    while (kCurrent != NULL) {
-        BookCopy* oCurrent = kCurrent->copies;
-        while (oCurrent != NULL) {
-            if (strcmp(oCurrent->labelNo, labelNo) == 0) {
-                if (strcmp(oCurrent->borrowerStudentId, "SHELF") == 0) {
-                    return 1; // On Shelf
-                } else {
-                    return 0; // Borrowed
-                }
+void csvClose(CsvReader* r) {
+    if (r->mapped) munmap(r->data, r->size);
+    else free(r->data);
+    r->data = NULL;
+    r->size = r->pos = 0;
+}
+
+// First ',', '"' or '\n' in [p, end), or end. Scans 16 bytes at a time.
+static char* csvScan(char* p, char* end) {
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, quote)),
+                                    _mm_cmpeq_epi8(v, newline));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz((unsigned int)mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '"' && *p != '\n') p++;
+    return p;
+}
+
+// Removes the quotes of the field starting at p (on the opening quote).
+// Returns the position after the closing quote.
+static char* csvUnquote(char* p, char* end, CsvField* field) {
+    char* out = p;
+    char* in = p + 1;
+    field->ptr = p;
+    while (in < end) {
+        char* q = (char*)memchr(in, '"', (size_t)(end - in));
+        if (!q) q = end;
+        memmove(out, in, (size_t)(q - in));
+        out += q - in;
+        in = q + 1;
+        if (q < end - 1 && q[1] == '"') {
+            *out++ = '"';
+            in = q + 2;
+            continue;
+        }
+        break;
+    }
+    field->len = (size_t)(out - p);
+    return in < end ? in : end;
+}
+
+// Splits the next non-empty record into r->fields.
+// Returns the field count, 0 at end of file.
+int csvNextRecord(CsvReader* r) {
+    char* end = r->data + r->size;
+    while (r->pos < r->size) {
+        char* p = r->data + r->pos;
+        if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')) {
+            r->pos += (*p == '\n') ? 1 : 2;
+            continue;
+        }
+        int n = 0;
+        while (1) {
+            CsvField field;
+            if (p < end && *p == '"') {
+                p = csvUnquote(p, end, &field);
+                while (p < end && *p != ',' && *p != '\n') p++; // Junk after the closing quote
+            } else {
+                char* d = csvScan(p, end);
+                while (d < end && *d == '"') d = csvScan(d + 1, end); // Stray quote inside a bare field
+                field.ptr = p;
+                field.len = (size_t)(d - p);
+                if (field.len && p[field.len - 1] == '\r' && (d == end || *d == '\n')) field.len--;
+                p = d;
+            }
+            if (n < CSV_MAX_FIELDS) r->fields[n++] = field;
+            if (p < end && *p == ',') {
+                p++;
+                continue;
             }
-            oCurrent = oCurrent->next;
+            break;
         }
-        kCurrent = kCurrent->next;
+        r->pos = (p < end) ? (size_t)(p - r->data) + 1 : r->size;
+        r->fieldCount = n;
+        return n;
     }
+    r->fieldCount = 0;
     return 0;
 }
 
-int isStudentScorePositive(Student* head, const char* studentId) {
-    Student* current = head;
-    while (current != NULL) {
-        if (strcmp(current->studentId, studentId) == 0) {
-            return (current->score > 0) ? 1 : 0;
+// Copies a field into a fixed-size buffer, truncating like the old
+// sscanf width limits did
+void csvCopy(CsvField f, char* dst, size_t dstLen) {
+    size_t len = (f.len < dstLen - 1) ? f.len : dstLen - 1;
+    memcpy(dst, f.ptr, len);
+    dst[len] = '\0';
+}
+
+// Parses a decimal integer field. Returns 0 if it is not a number.
+int csvLong(CsvField f, long* out) {
+    size_t i = 0;
+    while (i < f.len && (f.ptr[i] == ' ' || f.ptr[i] == '\t')) i++;
+    int neg = 0;
+    if (i < f.len && (f.ptr[i] == '-' || f.ptr[i] == '+')) neg = (f.ptr[i++] == '-');
+    if (i >= f.len || f.ptr[i] < '0' || f.ptr[i] > '9') return 0;
+    long v = 0;
+    while (i < f.len && f.ptr[i] >= '0' && f.ptr[i] <= '9') {
+        if (v < 100000000000000000L) v = v * 10 + (f.ptr[i] - '0');
+        i++;
+    }
+    *out = neg ? -v : v;
+    return 1;
+}
+
+int csvInt(CsvField f, int* out) {
+    long v;
+    if (!csvLong(f, &v)) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+// --- CSV WRITER ---
+// Savers format rows into a large buffer with the appenders below and
+// hand it to the kernel with one write call per buffer.
+
+int csvWriterOpen(CsvWriter* w, const char* filename, int append) {
+    w->len = 0;
+    w->failed = 0;
+    w->buf = (char*)malloc(CSV_WRITE_BUFFER);
+    if (!w->buf) return 0;
+    w->fd = open(filename, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (w->fd < 0) {
+        free(w->buf);
+        return 0;
+    }
+    return 1;
+}
+
+static void csvFlush(CsvWriter* w) {
+    size_t off = 0;
+    while (off < w->len && !w->failed) {
+        ssize_t n = write(w->fd, w->buf + off, w->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) w->failed = 1;
+        else off += (size_t)n;
+    }
+    w->len = 0;
+}
+
+// Room for at least n more bytes (n <= CSV_WRITE_BUFFER)
+static inline char* csvReserve(CsvWriter* w, size_t n) {
+    if (w->len + n > CSV_WRITE_BUFFER) csvFlush(w);
+    return w->buf + w->len;
+}
+
+void csvPutChar(CsvWriter* w, char c) {
+    *csvReserve(w, 1) = c;
+    w->len++;
+}
+
+void csvPutBytes(CsvWriter* w, const char* s, size_t n) {
+    while (n > 0) {
+        size_t room = CSV_WRITE_BUFFER - w->len;
+        if (room == 0) {
+            csvFlush(w);
+            room = CSV_WRITE_BUFFER;
         }
-        current = current->next;
+        size_t chunk = (n < room) ? n : room;
+        memcpy(w->buf + w->len, s, chunk);
+        w->len += chunk;
+        s += chunk;
+        n -= chunk;
     }
-    return 0;
+}
+
+void csvPutStr(CsvWriter* w, const char* s) {
+    csvPutBytes(w, s, strlen(s));
+}
+
+void csvPutLong(CsvWriter* w, long value) {
+    char tmp[21];
+    char* p = tmp + sizeof(tmp);
+    unsigned long v = (value < 0) ? 0ul - (unsigned long)value : (unsigned long)value;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0) *--p = '-';
+    csvPutBytes(w, p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+void csvPutInt(CsvWriter* w, int value) {
+    csvPutLong(w, value);
+}
+
+// Text field, quoted when it contains a delimiter
+void csvPutField(CsvWriter* w, const char* s) {
+    size_t len = strlen(s);
+    if (!memchr(s, ',', len) && !memchr(s, '"', len) && !memchr(s, '\n', len) && !memchr(s, '\r', len)) {
+        csvPutBytes(w, s, len);
+        return;
+    }
+    csvPutChar(w, '"');
+    for (; *s; s++) {
+        if (*s == '"') csvPutChar(w, '"');
+        csvPutChar(w, *s);
+    }
+    csvPutChar(w, '"');
+}
+
+// Writes the rest of the buffer and fsyncs so a finished save survives a
+// crash. Returns 0 if any write failed.
+int csvWriterClose(CsvWriter* w) {
+    csvFlush(w);
+    int ok = !w->failed && fsync(w->fd) == 0;
+    if (close(w->fd) != 0) ok = 0;
+    free(w->buf);
+    w->buf = NULL;
+    return ok;
+}
+
+// --- CATALOG INDEX ---
+// Books are found by ISBN through a sharded hash table. Inserts and
+// deletes change the table structure and must run exclusively; copy
+// state changes only need the shard lock of their book.
+
+static unsigned int hashString(const char* s, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len && s[i]; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Labels are "<ISBN>_<n>", so a label hashes to its book's shard
+static size_t isbnLengthOfLabel(const char* label) {
+    const char* sep = strrchr(label, '_');
+    return sep ? (size_t)(sep - label) : strlen(label);
+}
+
+void catalogInit() {
+    for (int i = 0; i < CATALOG_SHARDS; i++) {
+        pthread_mutex_init(&catalogShards[i].lock, NULL);
+        catalogShards[i].buckets = NULL;
+        catalogShards[i].bucketCount = 0;
+        catalogShards[i].count = 0;
+    }
+    for (int i = 0; i < STUDENT_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&studentLocks[i], NULL);
+    }
+#ifdef __GLIBC__
+    // Continuous lookups must not starve structural writers or archival
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&libraryLock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+#endif
+}
+
+CatalogShard* catalogShardOf(const char* isbn, size_t len) {
+    return &catalogShards[hashString(isbn, len) % CATALOG_SHARDS];
+}
+
+pthread_mutex_t* studentLockOf(const char* studentId) {
+    return &studentLocks[hashString(studentId, STUDENT_ID_LEN) % STUDENT_LOCK_STRIPES];
+}
+
+static Book** catalogBucket(CatalogShard* shard, unsigned int h) {
+    return &shard->buckets[(h / CATALOG_SHARDS) % (unsigned int)shard->bucketCount];
+}
+
+static void catalogGrow(CatalogShard* shard) {
+    int newCount = shard->bucketCount ? shard->bucketCount * 2 : CATALOG_INITIAL_BUCKETS;
+    Book** newBuckets = (Book**)calloc(newCount, sizeof(Book*));
+    if (!newBuckets) return;
+    Book** oldBuckets = shard->buckets;
+    int oldCount = shard->bucketCount;
+    shard->buckets = newBuckets;
+    shard->bucketCount = newCount;
+    for (int i = 0; i < oldCount; i++) {
+        Book* b = oldBuckets[i];
+        while (b) {
+            Book* next = b->isbnNext;
+            Book** slot = catalogBucket(shard, hashString(b->isbn, ISBN_LEN));
+            b->isbnNext = *slot;
+            *slot = b;
+            b = next;
+        }
+    }
+    free(oldBuckets);
+}
+
+// Looks up an ISBN whose hash h is already known
+static Book* catalogProbe(CatalogShard* shard, unsigned int h, const char* isbn, size_t len) {
+    if (!shard->bucketCount) return NULL;
+    Book* b = *catalogBucket(shard, h);
+    while (b) {
+        if (len < ISBN_LEN && strncmp(b->isbn, isbn, len) == 0 && b->isbn[len] == '\0') return b;
+        b = b->isbnNext;
+    }
+    return NULL;
+}
+
+Book* catalogFindN(const char* isbn, size_t len) {
+    unsigned int h = hashString(isbn, len);
+    return catalogProbe(&catalogShards[h % CATALOG_SHARDS], h, isbn, len);
+}
+
+Book* catalogFind(const char* isbn) {
+    return catalogFindN(isbn, strlen(isbn));
+}
+
+void catalogInsert(Book* book) {
+    unsigned int h = hashString(book->isbn, ISBN_LEN);
+    CatalogShard* shard = &catalogShards[h % CATALOG_SHARDS];
+    if (shard->count >= shard->bucketCount) catalogGrow(shard);
+    if (!shard->bucketCount) return;
+    Book** slot = catalogBucket(shard, h);
+    book->isbnNext = *slot;
+    *slot = book;
+    shard->count++;
+}
+
+void catalogRemove(Book* book) {
+    unsigned int h = hashString(book->isbn, ISBN_LEN);
+    CatalogShard* shard = &catalogShards[h % CATALOG_SHARDS];
+    if (!shard->bucketCount) return;
+    Book** slot = catalogBucket(shard, h);
+    while (*slot && *slot != book) slot = &(*slot)->isbnNext;
+    if (*slot) {
+        *slot = book->isbnNext;
+        shard->count--;
+    }
+}
+
+void lockAllShards() {
+    for (int i = 0; i < CATALOG_SHARDS; i++) pthread_mutex_lock(&catalogShards[i].lock);
+}
+
+void unlockAllShards() {
+    for (int i = CATALOG_SHARDS - 1; i >= 0; i--) pthread_mutex_unlock(&catalogShards[i].lock);
+}
+
+void lockAllStudents() {
+    for (int i = 0; i < STUDENT_LOCK_STRIPES; i++) pthread_mutex_lock(&studentLocks[i]);
+}
+
+void unlockAllStudents() {
+    for (int i = STUDENT_LOCK_STRIPES - 1; i >= 0; i--) pthread_mutex_unlock(&studentLocks[i]);
+}
+
+// --- TITLE INDEX ---
+// The book list is the bottom level of a skip list ordered by (title,
+// ISBN): books may carry extra links on higher levels, so inserts,
+// deletes and seeks take O(log n) instead of a walk down the list. Like
+// the catalog index, structural changes must run exclusively.
+
+static int compareBookKey(const Book* b, const char* title, const char* isbn) {
+    int c = strcmp(b->title, title);
+    return c ? c : strcmp(b->isbn, isbn);
+}
+
+// Successor of x on a level; x == NULL stands for the list head
+static Book* titleNext(Book** head, Book* x, int level) {
+    if (!x) return level ? titleLevels[level] : *head;
+    return level ? x->skip[level - 1] : x->next;
+}
+
+static void titleSetNext(Book** head, Book* x, int level, Book* to) {
+    if (!x) {
+        if (level) titleLevels[level] = to;
+        else *head = to;
+    } else if (level) {
+        x->skip[level - 1] = to;
+    } else {
+        x->next = to;
+    }
+}
+
+// Each further level is kept with probability 1/4 (xorshift; inserts are serialized)
+static int titleRandomLevel() {
+    static unsigned int seed = 2463534242u;
+    int levels = 1;
+    while (levels < TITLE_INDEX_LEVELS) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        if (seed & 3) break;
+        levels++;
+    }
+    return levels;
+}
+
+// Last book ordered before (title, isbn) on every level, NULL for the head
+static void titleFindPath(Book** head, const char* title, const char* isbn, Book** path) {
+    Book* x = NULL;
+    for (int level = titleTopLevel - 1; level >= 0; level--) {
+        Book* next = titleNext(head, x, level);
+        while (next && compareBookKey(next, title, isbn) < 0) {
+            x = next;
+            next = titleNext(head, x, level);
+        }
+        path[level] = x;
+    }
+}
+
+void titleIndexInsert(Book** head, Book* book) {
+    int levels = titleRandomLevel();
+    book->skip = NULL;
+    if (levels > 1) {
+        book->skip = (Book**)calloc(levels - 1, sizeof(Book*));
+        if (!book->skip) levels = 1;
+    }
+    book->skipLevels = (unsigned char)levels;
+
+    Book* path[TITLE_INDEX_LEVELS];
+    titleFindPath(head, book->title, book->isbn, path);
+    for (int level = titleTopLevel; level < levels; level++) path[level] = NULL;
+    if (levels > titleTopLevel) titleTopLevel = levels;
+    for (int level = 0; level < levels; level++) {
+        titleSetNext(head, book, level, titleNext(head, path[level], level));
+        titleSetNext(head, path[level], level, book);
+    }
+}
+
+void titleIndexRemove(Book** head, Book* book) {
+    Book* path[TITLE_INDEX_LEVELS];
+    titleFindPath(head, book->title, book->isbn, path);
+    for (int level = 0; level < book->skipLevels; level++) {
+        // Step over books with the same key until the predecessor is found
+        Book* x = path[level];
+        Book* next = titleNext(head, x, level);
+        while (next && next != book && compareBookKey(next, book->title, book->isbn) == 0) {
+            x = next;
+            next = titleNext(head, x, level);
+        }
+        if (next == book) titleSetNext(head, x, level, titleNext(head, book, level));
+    }
+    free(book->skip);
+    book->skip = NULL;
+    book->skipLevels = 0;
+    book->next = NULL;
+    while (titleTopLevel > 1 && !titleLevels[titleTopLevel - 1]) titleTopLevel--;
+}
+
+// Forgets the upper levels when the whole list is freed
+void titleIndexClear() {
+    memset(titleLevels, 0, sizeof(titleLevels));
+    titleTopLevel = 1;
+}
+
+// First book whose title is >= title
+Book* titleIndexSeek(Book* head, const char* title) {
+    Book* path[TITLE_INDEX_LEVELS];
+    titleFindPath(&head, title, "", path);
+    return titleNext(&head, path[0], 0);
+}
+
+// --- STRING ARENA ---
+// Titles and names are interned: each distinct string is stored once in
+// append-only chunks and records point at it. Stored strings never move
+// or change, so readers and snapshots use them without locking; the
+// arena lock only guards interning. Strings are not freed individually.
+
+static ArenaChunk* arenaNewChunk(size_t need) {
+    size_t cap = (need > ARENA_CHUNK_SIZE) ? need : ARENA_CHUNK_SIZE;
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + cap);
+    if (!chunk) return NULL;
+    chunk->used = 0;
+    chunk->cap = cap;
+    chunk->next = stringArena.chunks;
+    stringArena.chunks = chunk;
+    stringArena.reserved += sizeof(ArenaChunk) + cap;
+    return chunk;
+}
+
+static int arenaGrowSlots() {
+    size_t newCount = stringArena.slotCount ? stringArena.slotCount * 2 : ARENA_INITIAL_SLOTS;
+    const char** slots = (const char**)calloc(newCount, sizeof(const char*));
+    if (!slots) return 0;
+    for (size_t i = 0; i < stringArena.slotCount; i++) {
+        const char* s = stringArena.slots[i];
+        if (!s) continue;
+        size_t j = hashString(s, strlen(s)) & (newCount - 1);
+        while (slots[j]) j = (j + 1) & (newCount - 1);
+        slots[j] = s;
+    }
+    free(stringArena.slots);
+    stringArena.slots = slots;
+    stringArena.slotCount = newCount;
+    return 1;
+}
+
+// Returns the stored copy of the first len bytes of s
+const char* internStringN(const char* s, size_t len) {
+    pthread_mutex_lock(&stringArena.lock);
+    if (stringArena.count * 2 >= stringArena.slotCount && !arenaGrowSlots()) {
+        pthread_mutex_unlock(&stringArena.lock);
+        return "";
+    }
+    size_t mask = stringArena.slotCount - 1;
+    size_t i = hashString(s, len) & mask;
+    while (stringArena.slots[i]) {
+        const char* cur = stringArena.slots[i];
+        if (strncmp(cur, s, len) == 0 && cur[len] == '\0') {
+            pthread_mutex_unlock(&stringArena.lock);
+            return cur;
+        }
+        i = (i + 1) & mask;
+    }
+
+    ArenaChunk* chunk = stringArena.chunks;
+    if (!chunk || chunk->cap - chunk->used < len + 1) chunk = arenaNewChunk(len + 1);
+    if (!chunk) {
+        pthread_mutex_unlock(&stringArena.lock);
+        return "";
+    }
+    char* copy = chunk->data + chunk->used;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    chunk->used += len + 1;
+    stringArena.slots[i] = copy;
+    stringArena.count++;
+    stringArena.bytes += len + 1;
+    pthread_mutex_unlock(&stringArena.lock);
+    return copy;
+}
+
+const char* internString(const char* s) {
+    return internStringN(s, strlen(s));
 }
 
 // --- AUTHOR FUNCTIONS ---
@@ -151,8 +1251,8 @@ Author* createAuthor(int id, const char* name, const char* surname) {
     Author* newAuthor = (Author*) malloc(sizeof(Author));
     if (!newAuthor) return NULL;
     newAuthor->id = id;
-    strncpy(newAuthor->name, name, sizeof(newAuthor->name));
-    strncpy(newAuthor->surname, surname, sizeof(newAuthor->surname));
+    newAuthor->name = internString(name);
+    newAuthor->surname = internString(surname);
     newAuthor->next = NULL;
     return newAuthor;
 }
@@ -204,47 +1304,50 @@ void listAuthors(Author* head) {
     }
 }
 
-void saveAuthorsToFile(Author* head, const char* filename) {
-    FILE* fp = fopen(filename, "w");
-    if (!fp) {
+int saveAuthorsToFile(Author* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) {
         printf("Could not open file: %s\n", filename);
-        return;
+        return 0;
     }
-    fprintf(fp, "AuthorID,Name,Surname\n");
+    csvPutStr(&w, "AuthorID,Name,Surname\n");
     while (head) {
-        fprintf(fp, "%d,%s,%s\n", head->id, head->name, head->surname);
+        csvPutInt(&w, head->id);
+        csvPutChar(&w, ',');
+        csvPutField(&w, head->name);
+        csvPutChar(&w, ',');
+        csvPutField(&w, head->surname);
+        csvPutChar(&w, '\n');
         head = head->next;
     }
-    fclose(fp);
+    return csvWriterClose(&w);
 }
 
 Author* loadAuthorsFromFile(int* lastID) {
-    FILE* fp = fopen(FILE_AUTHORS, "r");
-    if (!fp) {
+    CsvReader csv;
+    if (!csvOpen(&csv, FILE_AUTHORS)) {
         printf("File not found: %s\n", FILE_AUTHORS);
         *lastID = 0;
         return NULL;
     }
-    char line[256];
     Author* head = NULL;
     *lastID = 0;
-    fgets(line, sizeof(line), fp); // Skip header
+    csvNextRecord(&csv); // Skip header
 
-    while (fgets(line, sizeof(line), fp)) {
+    while (csvNextRecord(&csv)) {
         int id;
-        char name[MAX_NAME_LEN], surname[MAX_NAME_LEN];
-        if (sscanf(line, "%d,%49[^,],%49[^\n]", &id, name, surname) == 3) {
+        if (csv.fieldCount >= 3 && csvInt(csv.fields[0], &id)) {
             Author* newAuthor = (Author*)malloc(sizeof(Author));
-            if (!newAuthor) return NULL;
+            if (!newAuthor) { csvClose(&csv); return NULL; }
             newAuthor->id = id;
-            strncpy(newAuthor->name, name, MAX_NAME_LEN);
-            strncpy(newAuthor->surname, surname, MAX_NAME_LEN);
+            newAuthor->name = internStringN(csv.fields[1].ptr, csv.fields[1].len);
+            newAuthor->surname = internStringN(csv.fields[2].ptr, csv.fields[2].len);
             newAuthor->next = head;
             head = newAuthor;
             if (id > *lastID) *lastID = id;
         }
     }
-    fclose(fp);
+    csvClose(&csv);
 
     // Sort list 
     if (!head) return NULL;
@@ -277,7 +1380,6 @@ void removeAuthorFromBooks(BookAuthorMap** mapArray, int* count, int authorID) {
             (*mapArray)[i].authorID = -1;
         }
     }
-    saveBookAuthorMapToFile(*mapArray, *count);
 }
 
 Author* deleteAuthor(Author* head, int id, BookAuthorMap** mapArray, int* mapCount) {
@@ -312,8 +1414,8 @@ int updateAuthor(Author* head, int id, const char* newName, const char* newSurna
     Author* iter = head;
     while (iter) {
         if (iter->id == id) {
-            strncpy(iter->name, newName, MAX_NAME_LEN);
-            strncpy(iter->surname, newSurname, MAX_NAME_LEN);
+            iter->name = internString(newName);
+            iter->surname = internString(newSurname);
             return 1;
         }
         iter = iter->next;
@@ -327,9 +1429,11 @@ Student* addStudent(Student* head, const char* id, const char* name, const char*
     Student* newNode = (Student*)malloc(sizeof(Student));
     if (!newNode) return head;
     strncpy(newNode->studentId, id, STUDENT_ID_LEN);
-    strncpy(newNode->name, name, MAX_NAME_LEN);
-    strncpy(newNode->surname, surname, MAX_NAME_LEN);
+    newNode->name = internString(name);
+    newNode->surname = internString(surname);
     newNode->score = 100;
+    newNode->activeLoans = 0;
+    newNode->loans = NULL;
     newNode->prev = NULL;
     newNode->next = NULL;
 
@@ -360,26 +1464,26 @@ Student* addStudent(Student* head, const char* id, const char* name, const char*
     return head;
 }
 
-void deleteStudent(Student** head, const char* id) {
-    Student* temp = *head;
-    Student* prev = NULL;
-    while (temp && strcmp(temp->studentId, id) != 0) {
-        prev = temp;
-        temp = temp->next;
-    }
-    if (!temp) return;
+// Students holding copies are kept until the copies come back. Their
+// holds stay queued and are dropped when they reach the head.
+int deleteStudent(Student** head, const char* id) {
+    Student* temp = findStudent(*head, id);
+    if (!temp) return DELETE_ERR_NOT_FOUND;
+    if (temp->loans) return DELETE_ERR_ON_LOAN;
 
-    if (!prev) *head = temp->next;
-    else prev->next = temp->next;
+    if (temp->prev) temp->prev->next = temp->next;
+    else *head = temp->next;
+    if (temp->next) temp->next->prev = temp->prev;
     free(temp);
+    return DELETE_OK;
 }
 
 int updateStudent(Student* head, const char* id, const char* newName, const char* newSurname, int newScore) {
     Student* iter = head;
     while (iter) {
         if (strcmp(iter->studentId, id) == 0) {
-            strncpy(iter->name, newName, MAX_NAME_LEN);
-            strncpy(iter->surname, newSurname, MAX_NAME_LEN);
+            iter->name = internString(newName);
+            iter->surname = internString(newSurname);
             iter->score = newScore;
             return 1;
         }
@@ -389,268 +1493,340 @@ int updateStudent(Student* head, const char* id, const char* newName, const char
 }
 
 Student* loadStudentsFromFile() {
-    FILE* fp = fopen(FILE_STUDENTS, "r");
-    if (!fp) {
+    CsvReader csv;
+    if (!csvOpen(&csv, FILE_STUDENTS)) {
         printf("File not found: %s\n", FILE_STUDENTS);
         return NULL;
     }
-    char line[256];
     Student* head = NULL;
-    fgets(line, sizeof(line), fp);
-    while (fgets(line, sizeof(line), fp)) {
-        char id[STUDENT_ID_LEN], name[MAX_NAME_LEN], surname[MAX_NAME_LEN];
+    csvNextRecord(&csv);
+    while (csvNextRecord(&csv)) {
+        char id[STUDENT_ID_LEN];
         int score;
-        if (sscanf(line, "%8[^,],%49[^,],%49[^,],%d", id, name, surname, &score) == 4) {
+        if (csv.fieldCount >= 4 && csv.fields[0].len > 0 && csvInt(csv.fields[3], &score)) {
+            csvCopy(csv.fields[0], id, sizeof(id));
+            const char* name = internStringN(csv.fields[1].ptr, csv.fields[1].len);
+            const char* surname = internStringN(csv.fields[2].ptr, csv.fields[2].len);
             head = addStudent(head, id, name, surname);
             updateStudent(head, id, name, surname, score);
         }
     }
-    fclose(fp);
+    csvClose(&csv);
     return head;
 }
 
-void saveStudentsToFile(Student* head, const char* filename) {
-    FILE* fp = fopen(filename, "w");
-    if (!fp) return;
-    fprintf(fp, "StudentID,Name,Surname,Score\n");
+int saveStudentsToFile(Student* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    csvPutStr(&w, "StudentID,Name,Surname,Score\n");
     while (head) {
-        fprintf(fp, "%s,%s,%s,%d\n", head->studentId, head->name, head->surname, head->score);
+        csvPutStr(&w, head->studentId);
+        csvPutChar(&w, ',');
+        csvPutField(&w, head->name);
+        csvPutChar(&w, ',');
+        csvPutField(&w, head->surname);
+        csvPutChar(&w, ',');
+        csvPutInt(&w, head->score);
+        csvPutChar(&w, '\n');
         head = head->next;
     }
-    fclose(fp);
+    return csvWriterClose(&w);
 }
 
 // --- BOOK FUNCTIONS ---
 
+static BookCopy* newShelfCopy(const char* isbn, int number) {
+    BookCopy* copy = (BookCopy*)malloc(sizeof(BookCopy));
+    if (!copy) return NULL;
+    snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", isbn, number);
+    strcpy(copy->borrowerStudentId, "SHELF");
+    copy->loan = NULL;
+    copy->holderNext = NULL;
+    return copy;
+}
+
+// Copy number from the label suffix, e.g. 3 for "ISBN_3"
+static int copyNumber(const BookCopy* copy) {
+    const char* sep = strrchr(copy->labelNo, '_');
+    return sep ? atoi(sep + 1) : 0;
+}
+
+// *newBookRef stays NULL when the ISBN is already in the catalog or the
+// quantity is negative; a second Book with the same ISBN would shadow
+// the first in the index.
 Book* addBook(Book* head, const char* title, const char* isbn, int qty, Book** newBookRef) {
+    *newBookRef = NULL;
+    if (qty < 0 || catalogFind(isbn)) return head;
     Book* newBook = (Book*)malloc(sizeof(Book));
     if (!newBook) return head;
-    strncpy(newBook->title, title, MAX_NAME_LEN);
+    newBook->title = internString(title);
     strncpy(newBook->isbn, isbn, ISBN_LEN);
     newBook->quantity = qty;
+    newBook->checkedOut = 0;
+    newBook->borrowCount = 0;
+    newBook->authorRowCount = 0;
+    newBook->authorRows = NULL;
+    newBook->holds = NULL;
     newBook->next = NULL;
     newBook->copies = NULL;
 
     for (int i = 1; i <= qty; i++) {
-        BookCopy* copy = (BookCopy*)malloc(sizeof(BookCopy));
+        BookCopy* copy = newShelfCopy(isbn, i);
         if (!copy) return NULL;
-        snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", isbn, i);
-        strcpy(copy->borrowerStudentId, "SHELF");
         copy->next = newBook->copies;
         newBook->copies = copy;
     }
 
     *newBookRef = newBook;
-
-    if (!head) return newBook;
-
-    Book* iter = head;
-    Book* prev = NULL;
-
-    while (iter && strcmp(iter->title, title) < 0) {
-        prev = iter;
-        iter = iter->next;
-    }
-    while (iter && strcmp(iter->title, title) == 0 && strcmp(iter->isbn, isbn) < 0) {
-        prev = iter;
-        iter = iter->next;
-    }
-
-    if (!prev) {
-        newBook->next = head;
-        return newBook;
-    }
-
-    prev->next = newBook;
-    newBook->next = iter;
+    catalogInsert(newBook);
+    titleIndexInsert(&head, newBook);
     return head;
 }
 
-void deleteBook(Book** head, const char* isbn) {
-    Book* temp = *head;
-    Book* prev = NULL;
-
-    while(temp && strcmp(temp->isbn, isbn) != 0) {
-        prev = temp;
-        temp = temp->next;
+// Books with copies out are kept until the copies come back. Author
+// links go with the book; its closed loans stay in the history.
+int deleteBook(Book** head, const char* isbn, BookAuthorMap** map, int* mapCount) {
+    Book* temp = catalogFind(isbn);
+    if (!temp) return DELETE_ERR_NOT_FOUND;
+    for (BookCopy* copy = temp->copies; copy; copy = copy->next) {
+        if (strcmp(copy->borrowerStudentId, "SHELF") != 0) return DELETE_ERR_ON_LOAN;
     }
-    if (!temp) return;
-
-    if (!prev) *head = temp->next;
-    else prev->next = temp->next;
 
+    removeBookAuthorRows(temp, *map, mapCount);
+    titleIndexRemove(head, temp);
+    catalogRemove(temp);
+    statsForgetBook(*head, temp);
+    freeHolds(temp);
     freeBookCopies(temp->copies);
     free(temp);
+    return DELETE_OK;
 }
 
-int updateBook(Book* head, const char* isbn, const char* newTitle, int newQty) {
-    Book* iter = head;
-    int found = 0;
-    while (iter && !found) {
-        if (strcmp(iter->isbn, isbn) == 0) {
-            found = 1;
-            strncpy(iter->title, newTitle, MAX_NAME_LEN);
-
-            if (newQty > iter->quantity) {
-                int i = iter->quantity + 1;
-                while (i <= newQty) {
-                    BookCopy* copy = (BookCopy*)malloc(sizeof(BookCopy));
-                    if (copy) {
-                        snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", isbn, i);
-                        strcpy(copy->borrowerStudentId, "SHELF");
-                        copy->next = iter->copies;
-                        iter->copies = copy;
-                    }
-                    i++;
-                }
-            }
-            else if (newQty < iter->quantity) {
-                int toDelete = iter->quantity - newQty;
-                int deleted = 0;
-                while (deleted < toDelete && iter->copies) {
-                    BookCopy* temp = iter->copies;
-                    iter->copies = temp->next;
-                    free(temp);
-                    deleted++;
-                }
+// A new title moves the book to its new position in the title index.
+// Copies are numbered 1..quantity, so shrinking removes the highest
+// numbers and is refused while any of them is lent out.
+int updateBook(Book** head, const char* isbn, const char* newTitle, int newQty) {
+    Book* iter = catalogFind(isbn);
+    if (!iter || newQty < 0) return DELETE_ERR_NOT_FOUND;
+
+    if (newQty < iter->quantity) {
+        for (BookCopy* copy = iter->copies; copy; copy = copy->next) {
+            if (copyNumber(copy) > newQty && strcmp(copy->borrowerStudentId, "SHELF") != 0) return DELETE_ERR_ON_LOAN;
+        }
+        BookCopy** link = &iter->copies;
+        while (*link) {
+            BookCopy* copy = *link;
+            if (copyNumber(copy) > newQty) {
+                *link = copy->next;
+                free(copy);
+            } else {
+                link = &copy->next;
             }
-            iter->quantity = newQty;
         }
-        iter = iter->next;
     }
-    return found;
+    int qty = newQty < iter->quantity ? newQty : iter->quantity;
+    while (qty < newQty) {
+        BookCopy* copy = newShelfCopy(isbn, qty + 1);
+        if (!copy) break;
+        copy->next = iter->copies;
+        iter->copies = copy;
+        qty++;
+    }
+    iter->quantity = qty;
+
+    if (strcmp(iter->title, newTitle) != 0) {
+        titleIndexRemove(head, iter);
+        iter->title = internString(newTitle);
+        titleIndexInsert(head, iter);
+    }
+    return DELETE_OK;
 }
 
 Book* loadBooksFromFile(const char* bookFile, const char* copiesFile) {
     Book* head = NULL;
-    FILE* fp = fopen(bookFile, "r");
-    if (!fp) {
+    CsvReader csv;
+    if (!csvOpen(&csv, bookFile)) {
         printf("Book file not found: %s\n", bookFile);
         return NULL;
     }
-    char line[256];
-    fgets(line, sizeof(line), fp);
+    csvNextRecord(&csv);
 
-    while (fgets(line, sizeof(line), fp)) {
-        char title[MAX_NAME_LEN], isbn[ISBN_LEN];
+    while (csvNextRecord(&csv)) {
+        char isbn[ISBN_LEN];
         int qty;
-        if (sscanf(line, "%49[^,],%13[^,],%d", title, isbn, &qty) == 3) {
+        if (csv.fieldCount >= 3 && csv.fields[0].len > 0 && csv.fields[1].len > 0 && csvInt(csv.fields[2], &qty)) {
             Book* newBook = NULL;
+            const char* title = internStringN(csv.fields[0].ptr, csv.fields[0].len);
+            csvCopy(csv.fields[1], isbn, sizeof(isbn));
             head = addBook(head, title, isbn, qty, &newBook);
+            if (newBook && csv.fieldCount >= 4) csvInt(csv.fields[3], &newBook->borrowCount);
         }
     }
-    fclose(fp);
+    csvClose(&csv);
     
     // Note: Copies loading logic (below)
     return head;
 }
 
-void saveBooksToFile(Book* head, const char* filename) {
-    FILE* fp = fopen(filename, "w");
-    if (!fp) return;
-    fprintf(fp, "Title,ISBN,Quantity\n");
+int saveBooksToFile(Book* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    csvPutStr(&w, "Title,ISBN,Quantity,Borrowed\n");
     while (head) {
-        fprintf(fp, "%s,%s,%d\n", head->title, head->isbn, head->quantity);
+        csvPutField(&w, head->title);
+        csvPutChar(&w, ',');
+        csvPutStr(&w, head->isbn);
+        csvPutChar(&w, ',');
+        csvPutInt(&w, head->quantity);
+        csvPutChar(&w, ',');
+        csvPutInt(&w, head->borrowCount);
+        csvPutChar(&w, '\n');
         head = head->next;
     }
-    fclose(fp);
+    return csvWriterClose(&w);
 }
 
-void saveBookCopiesToFile(Book* head, const char* filename) {
-    FILE* fp = fopen(filename, "w");
-    if (!fp) return;
-    fprintf(fp, "LabelNo,ISBN,BorrowerID\n");
+int saveBookCopiesToFile(Book* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    csvPutStr(&w, "LabelNo,ISBN,BorrowerID\n");
     while (head) {
+        size_t isbnLen = strlen(head->isbn);
         BookCopy* copy = head->copies;
         while (copy) {
-            fprintf(fp, "%s,%s,%s\n", copy->labelNo, head->isbn, copy->borrowerStudentId);
+            csvPutStr(&w, copy->labelNo);
+            csvPutChar(&w, ',');
+            csvPutBytes(&w, head->isbn, isbnLen);
+            csvPutChar(&w, ',');
+            csvPutStr(&w, copy->borrowerStudentId);
+            csvPutChar(&w, '\n');
             copy = copy->next;
         }
         head = head->next;
     }
-    fclose(fp);
+    return csvWriterClose(&w);
 }
 
-void loadBookCopiesFromFile(Book* head, const char* filename) {
-    FILE* fp = fopen(filename, "r");
-    if (!fp) return;
-    char line[256];
-    fgets(line, sizeof(line), fp);
+// Books are looked up through the catalog index straight from the
+// field view, so the copies file loads in one pass
+void loadBookCopiesFromFile(const char* filename) {
+    CsvReader csv;
+    if (!csvOpen(&csv, filename)) return;
+    csvNextRecord(&csv);
 
-    while (fgets(line, sizeof(line), fp)) {
-        char* label = strtok(line, ",\n");
-        char* isbn = strtok(NULL, ",\n");
-        char* borrower = strtok(NULL, ",\n");
-
-        if (label && isbn && borrower) {
-            int found = 0;
-            Book* bIter = head;
-            while (bIter && !found) {
-                if (strcmp(bIter->isbn, isbn) == 0) {
-                    BookCopy* cIter = bIter->copies;
-                    while (cIter) {
-                        if (strcmp(cIter->labelNo, label) == 0) {
-                            strncpy(cIter->borrowerStudentId, borrower, STUDENT_ID_LEN);
-                            found = 1;
-                        }
-                        cIter = cIter->next;
-                    }
-                }
-                bIter = bIter->next;
+    while (csvNextRecord(&csv)) {
+        if (csv.fieldCount < 3 || csv.fields[0].len == 0 || csv.fields[2].len == 0) continue;
+        CsvField label = csv.fields[0];
+        Book* book = catalogFindN(csv.fields[1].ptr, csv.fields[1].len);
+        if (!book) continue;
+        for (BookCopy* cIter = book->copies; cIter; cIter = cIter->next) {
+            if (strncmp(cIter->labelNo, label.ptr, label.len) == 0 && cIter->labelNo[label.len] == '\0') {
+                csvCopy(csv.fields[2], cIter->borrowerStudentId, STUDENT_ID_LEN);
+                break;
             }
         }
     }
-    fclose(fp);
+    csvClose(&csv);
 }
 
 // --- BOOK-AUTHOR MAP FUNCTIONS ---
 
 BookAuthorMap* loadBookAuthorMap(int* count) {
-    FILE* fp = fopen(FILE_BOOK_AUTHORS, "r");
-    if (!fp) {
-        *count = 0;
-        return NULL;
-    }
-    char line[256];
-    int c = 0;
-    while (fgets(line, sizeof(line), fp)) c++;
-    rewind(fp);
-
-    if (c == 0) {
-        *count = 0;
-        fclose(fp);
-        return NULL;
-    }
-    BookAuthorMap* arr = (BookAuthorMap*)malloc(sizeof(BookAuthorMap) * c);
-    if (!arr) { fclose(fp); return NULL; }
+    *count = 0;
+    CsvReader csv;
+    if (!csvOpen(&csv, FILE_BOOK_AUTHORS)) return NULL;
 
-    int idx = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        sscanf(line, "%13[^,],%d", arr[idx].bookISBN, &arr[idx].authorID);
-        idx++;
+    BookAuthorMap* arr = NULL;
+    int c = 0, cap = 0;
+    while (csvNextRecord(&csv)) {
+        int authorID;
+        if (csv.fieldCount < 2 || !csvInt(csv.fields[1], &authorID)) continue;
+        if (c == cap) {
+            int newCap = cap ? cap * 2 : 64;
+            BookAuthorMap* grown = (BookAuthorMap*)realloc(arr, sizeof(BookAuthorMap) * newCap);
+            if (!grown) break;
+            arr = grown;
+            cap = newCap;
+        }
+        csvCopy(csv.fields[0], arr[c].bookISBN, ISBN_LEN);
+        arr[c].authorID = authorID;
+        c++;
     }
+    csvClose(&csv);
     *count = c;
-    fclose(fp);
     return arr;
 }
 
-void saveBookAuthorMapToFile(BookAuthorMap* arr, int count) {
-    FILE* fp = fopen(FILE_BOOK_AUTHORS, "w");
-    if (!fp) return;
+int saveBookAuthorMapToFile(BookAuthorMap* arr, int count, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
     for (int i = 0; i < count; i++) {
-        fprintf(fp, "%s,%d\n", arr[i].bookISBN, arr[i].authorID);
+        csvPutStr(&w, arr[i].bookISBN);
+        csvPutChar(&w, ',');
+        csvPutInt(&w, arr[i].authorID);
+        csvPutChar(&w, '\n');
     }
-    fclose(fp);
+    return csvWriterClose(&w);
+}
+
+// Each book lists its rows in the map, so links are checked and removed
+// without scanning the whole array
+static int addAuthorRow(Book* book, int row) {
+    int* rows = (int*)realloc(book->authorRows, sizeof(int) * (book->authorRowCount + 1));
+    if (!rows) return 0;
+    book->authorRows = rows;
+    book->authorRows[book->authorRowCount++] = row;
+    return 1;
+}
+
+// Fills the last row into the removed one and repoints its book
+static void dropMapRow(BookAuthorMap* arr, int* count, int row) {
+    int last = --(*count);
+    if (row == last) return;
+    arr[row] = arr[last];
+    Book* moved = catalogFind(arr[row].bookISBN);
+    for (int i = 0; moved && i < moved->authorRowCount; i++) {
+        if (moved->authorRows[i] == last) moved->authorRows[i] = row;
+    }
+}
+
+// Builds the per-book row lists after loading. Links to books that no
+// longer exist are dropped.
+void indexBookAuthorMap(BookAuthorMap* arr, int* count) {
+    int dropped = 0;
+    int i = 0;
+    while (i < *count) {
+        Book* book = catalogFind(arr[i].bookISBN);
+        if (book && addAuthorRow(book, i)) {
+            i++;
+        } else {
+            arr[i] = arr[--(*count)];
+            dropped++;
+        }
+    }
+    if (dropped) printf("Dropped %d author links to deleted books\n", dropped);
+}
+
+void removeBookAuthorRows(Book* book, BookAuthorMap* arr, int* count) {
+    while (book->authorRowCount > 0) {
+        int row = book->authorRows[--book->authorRowCount];
+        dropMapRow(arr, count, row);
+    }
+    free(book->authorRows);
+    book->authorRows = NULL;
 }
 
 int addBookAuthorRelation(BookAuthorMap** arr, int* count, const char* isbn, int authorID) {
-    for (int i = 0; i < *count; i++) {
-        if (strcmp((*arr)[i].bookISBN, isbn) == 0 && (*arr)[i].authorID == authorID)
+    Book* book = catalogFind(isbn);
+    if (!book) return 0;
+    for (int i = 0; i < book->authorRowCount; i++) {
+        if ((*arr)[book->authorRows[i]].authorID == authorID)
             return 0; // Already exists
     }
     BookAuthorMap* newArr = (BookAuthorMap*)realloc(*arr, sizeof(BookAuthorMap) * (*count + 1));
     if (!newArr) return 0;
     *arr = newArr;
+    if (!addAuthorRow(book, *count)) return 0;
     strncpy((*arr)[*count].bookISBN, isbn, ISBN_LEN);
     (*arr)[*count].authorID = authorID;
     (*count)++;
@@ -658,459 +1834,6308 @@ int addBookAuthorRelation(BookAuthorMap** arr, int* count, const char* isbn, int
 }
 
 int removeBookAuthorRelation(BookAuthorMap** arr, int* count, const char* isbn, int authorID) {
-    int found = 0;
-    int i = 0;
-    while (i < *count && !found) {
-        if (strcmp((*arr)[i].bookISBN, isbn) == 0 && (*arr)[i].authorID == authorID) {
-            found = 1;
-            (*arr)[i] = (*arr)[*count - 1];
-            (*count)--;
-            *arr = (BookAuthorMap*)realloc(*arr, sizeof(BookAuthorMap) * (*count));
+    Book* book = catalogFind(isbn);
+    for (int i = 0; book && i < book->authorRowCount; i++) {
+        int row = book->authorRows[i];
+        if ((*arr)[row].authorID == authorID) {
+            book->authorRows[i] = book->authorRows[--book->authorRowCount];
+            dropMapRow(*arr, count, row);
+            return 1;
         }
-        i++;
     }
-    return found;
+    return 0;
 }
 
-// --- LOAN FUNCTIONS ---
+// --- PARTITIONED CATALOG ---
+// Every checkpoint also writes the catalog split by ISBN hash into
+// catalog/part_NN.csv (books sorted by ISBN, each book row followed by
+// its copy rows) and a small directory with per-partition counts and
+// Bloom filters. A kiosk process (--kiosk) reads only the directory at
+// startup and faults partitions in on lookup, so it starts instantly and
+// stays within --memory-budget however large the library grows.
 
-void saveLoansToFile(LoanTransaction* head) {
-    FILE* fp = fopen(FILE_LOANS, "w");
-    if (!fp) return;
-    LoanTransaction* iter = head;
-    while (iter) {
-        fprintf(fp, "%s,%s,%d,%s\n", iter->studentId, iter->bookLabelNo, iter->operationType, iter->date);
-        iter = iter->next;
-    }
-    fclose(fp);
+static unsigned int partitionOf(const char* isbn, size_t len) {
+    return hashString(isbn, len) % CATALOG_PARTITIONS;
 }
 
-void addLoanTransaction(LoanTransaction** head, const char* sId, const char* label, int type, const char* date) {
-    LoanTransaction* newNode = (LoanTransaction*)malloc(sizeof(LoanTransaction));
-    if (!newNode) return;
-    strncpy(newNode->studentId, sId, STUDENT_ID_LEN - 1);
-    newNode->studentId[STUDENT_ID_LEN - 1] = '\0';
+// Two independent hashes for double hashing (the partition already
+// consumed the low bits of hashString)
+static void bloomHashes(const char* isbn, size_t len, uint32_t* h1, uint32_t* h2) {
+    uint32_t h = hashString(isbn, len);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    *h1 = h;
+    *h2 = (h * 0x9e3779b1u) | 1;
+}
 
-    strncpy(newNode->bookLabelNo, label, sizeof(newNode->bookLabelNo) - 1);
-    newNode->bookLabelNo[sizeof(newNode->bookLabelNo) - 1] = '\0';
+static void bloomAdd(uint64_t* bloom, uint32_t bits, const char* isbn) {
+    uint32_t h1, h2;
+    bloomHashes(isbn, strlen(isbn), &h1, &h2);
+    for (int k = 0; k < BLOOM_HASHES; k++) {
+        uint32_t bit = (h1 + k * h2) & (bits - 1);
+        bloom[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
 
-    newNode->operationType = type;
-    strncpy(newNode->date, date, sizeof(newNode->date) - 1);
-    newNode->date[sizeof(newNode->date) - 1] = '\0';
+static int bloomMayContain(const uint64_t* bloom, uint32_t bits, const char* isbn, size_t len) {
+    if (!bits) return 0;
+    uint32_t h1, h2;
+    bloomHashes(isbn, len, &h1, &h2);
+    for (int k = 0; k < BLOOM_HASHES; k++) {
+        uint32_t bit = (h1 + k * h2) & (bits - 1);
+        if (!(bloom[bit >> 6] & (1ULL << (bit & 63)))) return 0;
+    }
+    return 1;
+}
 
-    newNode->next = *head;
-    *head = newNode;
+static uint32_t bloomSizeFor(int keys) {
+    if (keys <= 0) return 0;
+    uint32_t bits = 64;
+    while (bits < (uint32_t)keys * BLOOM_BITS_PER_KEY) bits <<= 1;
+    return bits;
 }
 
-void borrowBookCopy(Book** head, const char* label, const char* sId) {
-    Book* bIter = *head;
-    while (bIter) {
-        BookCopy* cIter = bIter->copies;
-        while (cIter) {
-            if (strcmp(cIter->labelNo, label) == 0) {
-                strncpy(cIter->borrowerStudentId, sId, STUDENT_ID_LEN);
-                saveBookCopiesToFile(*head, FILE_COPIES);
-                return;
-            }
-            cIter = cIter->next;
-        }
-        bIter = bIter->next;
-    }
-    printf("Copy not found: %s\n", label);
+static int compareBookByPartition(const void* a, const void* b) {
+    const Book* x = *(const Book* const*)a;
+    const Book* y = *(const Book* const*)b;
+    unsigned int px = partitionOf(x->isbn, strlen(x->isbn)), py = partitionOf(y->isbn, strlen(y->isbn));
+    if (px != py) return px < py ? -1 : 1;
+    return strcmp(x->isbn, y->isbn);
 }
 
-int processLoan(Student** sHead, Book** bHead, LoanTransaction** lHead, const char* sId, const char* isbn, const char* date) {
-    if (!isStudentExists(*sHead, sId)) {
-        printf("Error: Student not found!\n");
+static void partitionPath(char* out, size_t len, int p) {
+    snprintf(out, len, "%s/part_%02d.csv", CATALOG_DIR, p);
+}
+
+// Writes the partitions and then the directory, each with temp file +
+// rename. Called from the checkpoint with a snapshot of the book list.
+int saveCatalogPartitions(Book* head) {
+    int count = 0;
+    for (Book* b = head; b; b = b->next) count++;
+    Book** books = (Book**)malloc(sizeof(Book*) * (count ? count : 1));
+    if (!books) return 0;
+    int i = 0;
+    for (Book* b = head; b; b = b->next) books[i++] = b;
+    qsort(books, count, sizeof(Book*), compareBookByPartition);
+    if (mkdir(CATALOG_DIR, 0755) != 0 && errno != EEXIST) {
+        free(books);
         return 0;
     }
-    if (!isStudentScorePositive(*sHead, sId)) {
-        printf("Error: Student score insufficient!\n");
+
+    CsvWriter dir;
+    char dirTmp[64];
+    snprintf(dirTmp, sizeof(dirTmp), "%s%s", FILE_CATALOG_DIRECTORY, CHECKPOINT_TMP_SUFFIX);
+    if (!csvWriterOpen(&dir, dirTmp, 0)) {
+        free(books);
         return 0;
     }
-    const char* label = findBookLabelByISBN(*bHead, isbn);
-    if (!label) {
-        printf("Error: No copies available on shelf!\n");
+    csvPutStr(&dir, "Partition,Books,Copies,Bytes,Bloom\n");
+    int ok = 1;
+    i = 0;
+    for (int p = 0; p < CATALOG_PARTITIONS; p++) {
+        int first = i, copies = 0;
+        size_t bytes = 0;
+        while (i < count && partitionOf(books[i]->isbn, strlen(books[i]->isbn)) == (unsigned int)p) {
+            for (BookCopy* c = books[i]->copies; c; c = c->next) copies++;
+            bytes += strlen(books[i]->title) + 1;
+            i++;
+        }
+        uint32_t bits = bloomSizeFor(i - first);
+        uint64_t* bloom = (uint64_t*)calloc(bits / 64 + 1, sizeof(uint64_t));
+        char path[64], tmp[72];
+        partitionPath(path, sizeof(path), p);
+        snprintf(tmp, sizeof(tmp), "%s%s", path, CHECKPOINT_TMP_SUFFIX);
+        CsvWriter w;
+        if (!bloom || !csvWriterOpen(&w, tmp, 0)) {
+            free(bloom);
+            ok = 0;
+            break;
+        }
+        csvPutStr(&w, "ISBN,Quantity,Borrowed,Title\n");
+        for (int k = first; k < i; k++) {
+            Book* b = books[k];
+            bloomAdd(bloom, bits, b->isbn);
+            csvPutStr(&w, b->isbn);
+            csvPutChar(&w, ',');
+            csvPutInt(&w, b->quantity);
+            csvPutChar(&w, ',');
+            csvPutInt(&w, b->borrowCount);
+            csvPutChar(&w, ',');
+            csvPutField(&w, b->title);
+            csvPutChar(&w, '\n');
+            for (BookCopy* c = b->copies; c; c = c->next) {
+                csvPutStr(&w, c->labelNo);
+                csvPutChar(&w, ',');
+                csvPutStr(&w, c->borrowerStudentId);
+                csvPutChar(&w, '\n');
+            }
+        }
+        if (!csvWriterClose(&w) || rename(tmp, path) != 0) ok = 0;
+
+        bytes += sizeof(Book) * (size_t)(i - first) + sizeof(BookCopy) * (size_t)copies;
+        csvPutInt(&dir, p);
+        csvPutChar(&dir, ',');
+        csvPutInt(&dir, i - first);
+        csvPutChar(&dir, ',');
+        csvPutInt(&dir, copies);
+        csvPutChar(&dir, ',');
+        csvPutLong(&dir, (long)bytes);
+        csvPutChar(&dir, ',');
+        for (uint32_t word = 0; word < bits / 64; word++) {
+            char hex[17];
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)bloom[word]);
+            csvPutBytes(&dir, hex, 16);
+        }
+        csvPutChar(&dir, '\n');
+        free(bloom);
+        if (!ok) break;
+    }
+    free(books);
+    if (!csvWriterClose(&dir) || !ok || rename(dirTmp, FILE_CATALOG_DIRECTORY) != 0) {
+        unlink(dirTmp);
         return 0;
     }
-    borrowBookCopy(bHead, label, sId);
-    addLoanTransaction(lHead, sId, label, OP_TYPE_BORROW, date);
-    saveLoansToFile(*lHead);
     return 1;
 }
 
-int getDaysDifference(const char* start, const char* end) {
-    int y1, m1, d1, y2, m2, d2;
-    sscanf(start, "%d-%d-%d", &d1, &m1, &y1);
-    sscanf(end, "%d-%d-%d", &d1, &m2, &y2);
-    struct tm tm1 = {0}, tm2 = {0};
-    tm1.tm_year = y1 - 1900; tm1.tm_mon = m1 - 1; tm1.tm_mday = d1;
-    tm2.tm_year = y2 - 1900; tm2.tm_mon = m2 - 1; tm2.tm_mday = d2;
-    time_t t1 = mktime(&tm1);
-    time_t t2 = mktime(&tm2);
-    return (int)difftime(t2, t1) / (60 * 60 * 24);
+static void partitionEvict(PartitionedCatalog* pc, int p) {
+    CatalogPartition* part = &pc->parts[p];
+    if (!part->books) return;
+    free(part->books);
+    free(part->copies);
+    free(part->text);
+    part->books = NULL;
+    part->copies = NULL;
+    part->text = NULL;
+    pc->resident -= part->bytes;
+    pc->evictions++;
 }
 
-char* findBorrowDate(LoanTransaction* head, const char* sId, const char* label) {
-    while (head) {
-        if (strcmp(head->studentId, sId) == 0 &&
-            strcmp(head->bookLabelNo, label) == 0 &&
-            head->operationType == OP_TYPE_BORROW) {
-            return head->date;
+// Reads the directory. Caller holds pc->lock; resident partitions are
+// dropped, since they may predate the directory.
+static int partitionsReadDirectory(PartitionedCatalog* pc) {
+    CsvReader csv;
+    struct stat st;
+    if (stat(FILE_CATALOG_DIRECTORY, &st) != 0 || !csvOpen(&csv, FILE_CATALOG_DIRECTORY)) return 0;
+    for (int p = 0; p < CATALOG_PARTITIONS; p++) {
+        partitionEvict(pc, p);
+        free(pc->parts[p].bloom);
+        memset(&pc->parts[p], 0, sizeof(CatalogPartition));
+    }
+    pc->directoryMtime = st.st_mtim;
+    csvNextRecord(&csv); // Header
+    while (csvNextRecord(&csv)) {
+        int p;
+        long bytes;
+        if (csv.fieldCount < 5 || !csvInt(csv.fields[0], &p) || p < 0 || p >= CATALOG_PARTITIONS) continue;
+        CatalogPartition* part = &pc->parts[p];
+        if (!csvInt(csv.fields[1], &part->bookCount) || !csvInt(csv.fields[2], &part->copyCount) ||
+            !csvLong(csv.fields[3], &bytes)) continue;
+        part->bytes = (size_t)bytes;
+        size_t words = csv.fields[4].len / 16;
+        part->bloom = (uint64_t*)calloc(words + 1, sizeof(uint64_t));
+        if (!part->bloom) continue;
+        for (size_t w = 0; w < words; w++) {
+            char hex[17];
+            memcpy(hex, csv.fields[4].ptr + w * 16, 16);
+            hex[16] = '\0';
+            part->bloom[w] = strtoull(hex, NULL, 16);
         }
-        head = head->next;
+        part->bloomBits = (uint32_t)(words * 64);
+        if (part->bloomBits & (part->bloomBits - 1)) part->bloomBits = 0; // Corrupt: never matches
     }
-    return NULL;
+    csvClose(&csv);
+    return 1;
 }
 
-void returnBookCopy(Book** head, const char* label) {
-    Book* bIter = *head;
-    while (bIter) {
-        BookCopy* cIter = bIter->copies;
-        while (cIter) {
-            if (strcmp(cIter->labelNo, label) == 0) {
-                strcpy(cIter->borrowerStudentId, "SHELF");
-                return;
+// Parses a partition file. The directory counts size the arrays; they
+// grow if the file was replaced since the directory was read. Copies and
+// titles are linked once the arrays have stopped moving.
+static int partitionLoad(PartitionedCatalog* pc, int p) {
+    CatalogPartition* part = &pc->parts[p];
+    char path[64];
+    partitionPath(path, sizeof(path), p);
+    CsvReader csv;
+    if (!csvOpen(&csv, path)) return 0;
+    int bookCap = part->bookCount > 0 ? part->bookCount : 16;
+    int copyCap = part->copyCount > 0 ? part->copyCount : 16;
+    Book* books = (Book*)malloc(sizeof(Book) * bookCap);
+    BookCopy* copies = (BookCopy*)malloc(sizeof(BookCopy) * copyCap);
+    int* firstCopy = (int*)malloc(sizeof(int) * (bookCap + 1));
+    char* text = (char*)malloc(csv.size + 1); // Titles are never longer than the file
+    int nBooks = 0, nCopies = 0;
+    size_t textLen = 0;
+    int ok = books && copies && firstCopy && text;
+
+    csvNextRecord(&csv); // Header
+    while (ok && csvNextRecord(&csv)) {
+        if (csv.fieldCount >= 4) {
+            if (nBooks == bookCap) {
+                bookCap *= 2;
+                Book* grownBooks = (Book*)realloc(books, sizeof(Book) * bookCap);
+                int* grownFirst = (int*)realloc(firstCopy, sizeof(int) * (bookCap + 1));
+                if (grownBooks) books = grownBooks;
+                if (grownFirst) firstCopy = grownFirst;
+                if (!grownBooks || !grownFirst) ok = 0;
+                if (!ok) break;
             }
-            cIter = cIter->next;
+            Book* book = &books[nBooks];
+            memset(book, 0, sizeof(*book));
+            csvCopy(csv.fields[0], book->isbn, sizeof(book->isbn));
+            csvInt(csv.fields[1], &book->quantity);
+            csvInt(csv.fields[2], &book->borrowCount);
+            firstCopy[nBooks++] = nCopies;
+            csvCopy(csv.fields[3], text + textLen, csv.fields[3].len + 1);
+            book->title = (const char*)(uintptr_t)textLen; // Offset until text stops moving
+            textLen += csv.fields[3].len + 1;
+        } else if (csv.fieldCount == 2 && nBooks) {
+            if (nCopies == copyCap) {
+                copyCap *= 2;
+                BookCopy* grown = (BookCopy*)realloc(copies, sizeof(BookCopy) * copyCap);
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                copies = grown;
+            }
+            BookCopy* copy = &copies[nCopies++];
+            memset(copy, 0, sizeof(*copy));
+            csvCopy(csv.fields[0], copy->labelNo, sizeof(copy->labelNo));
+            csvCopy(csv.fields[1], copy->borrowerStudentId, sizeof(copy->borrowerStudentId));
+            if (strcmp(copy->borrowerStudentId, "SHELF") != 0) books[nBooks - 1].checkedOut++;
         }
-        bIter = bIter->next;
     }
-}
+    csvClose(&csv);
+    if (!ok) {
+        free(books);
+        free(copies);
+        free(firstCopy);
+        free(text);
+        return 0;
+    }
 
-void updateStudentScore(Student** head, const char* sId, int points) {
-    Student* iter = *head;
-    while (iter) {
-        if (strcmp(iter->studentId, sId) == 0) {
-            iter->score += points;
-            return;
+    char* shrunk = (char*)realloc(text, textLen ? textLen : 1);
+    if (shrunk) text = shrunk;
+    firstCopy[nBooks] = nCopies;
+    for (int b = 0; b < nBooks; b++) {
+        books[b].title = text + (uintptr_t)books[b].title;
+        for (int c = firstCopy[b]; c < firstCopy[b + 1]; c++) {
+            copies[c].next = (c + 1 < firstCopy[b + 1]) ? &copies[c + 1] : NULL;
         }
-        iter = iter->next;
+        books[b].copies = firstCopy[b] < firstCopy[b + 1] ? &copies[firstCopy[b]] : NULL;
     }
+    free(firstCopy);
+    part->books = books;
+    part->copies = copies;
+    part->text = text;
+    part->bookCount = nBooks;
+    part->copyCount = nCopies;
+    part->bytes = sizeof(Book) * (size_t)nBooks + sizeof(BookCopy) * (size_t)nCopies + textLen;
+    pc->resident += part->bytes;
+    pc->loads++;
+    return 1;
 }
 
-int isBookCopyBorrowed(Book* head, const char* label, const char* sId) {
-    Book* bIter = head;
-    while (bIter) {
-        BookCopy* cIter = bIter->copies;
-        while (cIter) {
-            if (strcmp(cIter->labelNo, label) == 0) {
-                if (strcmp(cIter->borrowerStudentId, sId) == 0) return 1;
-                else return 0;
-            }
-            cIter = cIter->next;
-        }
-        bIter = bIter->next;
-    }
-    return 0;
+int partitionsOpen(PartitionedCatalog* pc, size_t budget) {
+    memset(pc, 0, sizeof(*pc));
+    pthread_mutex_init(&pc->lock, NULL);
+    pc->budget = budget;
+    pc->lastCheck = time(NULL);
+    return partitionsReadDirectory(pc);
 }
 
-int processReturn(Student** sHead, Book** bHead, LoanTransaction** lHead, const char* sId, const char* label, const char* date) {
-    if (!isStudentExists(*sHead, sId)) {
-        printf("Student not found.\n"); return 0;
-    }
-    if (!isBookCopyBorrowed(*bHead, label, sId)) {
-        printf("Error: This book is not borrowed by this student.\n"); return 0;
+void partitionsClose(PartitionedCatalog* pc) {
+    for (int p = 0; p < CATALOG_PARTITIONS; p++) {
+        partitionEvict(pc, p);
+        free(pc->parts[p].bloom);
     }
-    char* borrowDate = findBorrowDate(*lHead, sId, label);
-    if (!borrowDate) {
-        printf("Error: Loan record not found.\n"); return 0;
+    pthread_mutex_destroy(&pc->lock);
+}
+
+static int compareIsbnToBook(const void* key, const void* elem) {
+    return strcmp((const char*)key, ((const Book*)elem)->isbn);
+}
+
+// Book with this ISBN, faulting its partition in and evicting the least
+// recently used ones over the budget. Caller holds pc->lock; the result
+// is valid until the lock is released.
+Book* partitionFind(PartitionedCatalog* pc, const char* isbn) {
+    time_t now = time(NULL);
+    if (now - pc->lastCheck >= KIOSK_RELOAD_CHECK_SEC) {
+        struct stat st;
+        pc->lastCheck = now;
+        if (stat(FILE_CATALOG_DIRECTORY, &st) == 0 && (st.st_mtim.tv_sec != pc->directoryMtime.tv_sec ||
+                                                       st.st_mtim.tv_nsec != pc->directoryMtime.tv_nsec)) {
+            partitionsReadDirectory(pc);
+        }
     }
-    int diff = getDaysDifference(borrowDate, date);
-    if (diff > 15) {
-        updateStudentScore(sHead, sId, -10);
+    pc->lookups++;
+    size_t len = strlen(isbn);
+    int p = (int)partitionOf(isbn, len);
+    CatalogPartition* part = &pc->parts[p];
+    if (!bloomMayContain(part->bloom, part->bloomBits, isbn, len)) {
+        pc->bloomSkips++;
+        return NULL;
     }
-    returnBookCopy(bHead, label);
-    addLoanTransaction(lHead, sId, label, OP_TYPE_RETURN, date);
-    saveLoansToFile(*lHead);
-    saveBookCopiesToFile(*bHead, FILE_COPIES);
-    saveStudentsToFile(*sHead, FILE_STUDENTS);
-    printf("Book returned successfully.\n");
-    return 1;
-}
+    if (!part->books && !partitionLoad(pc, p)) return NULL;
+    part->lastUse = ++pc->tick;
 
-LoanTransaction* loadLoansFromFile() {
-    FILE* fp = fopen(FILE_LOANS, "r");
-    if (!fp) return NULL;
-    LoanTransaction* head = NULL;
-    LoanTransaction* tail = NULL;
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        LoanTransaction* newNode = (LoanTransaction*)malloc(sizeof(LoanTransaction));
-        if (!newNode) { fclose(fp); return NULL; }
-        char* token = strtok(line, ",");
-        if(token) strncpy(newNode->studentId, token, STUDENT_ID_LEN);
-        token = strtok(NULL, ",");
-        if(token) strncpy(newNode->bookLabelNo, token, sizeof(newNode->bookLabelNo));
-        token = strtok(NULL, ",");
-        if(token) newNode->operationType = atoi(token);
-        token = strtok(NULL, ",\n");
-        if(token) strncpy(newNode->date, token, DATE_STR_LEN);
-        newNode->next = NULL;
-        if (!head) head = tail = newNode;
-        else { tail->next = newNode; tail = newNode; }
+    while (pc->resident > pc->budget) {
+        int victim = -1;
+        for (int i = 0; i < CATALOG_PARTITIONS; i++) {
+            if (i == p || !pc->parts[i].books) continue;
+            if (victim < 0 || pc->parts[i].lastUse < pc->parts[victim].lastUse) victim = i;
+        }
+        if (victim < 0) break;
+        partitionEvict(pc, victim);
     }
-    fclose(fp);
-    return head;
+    return (Book*)bsearch(isbn, part->books, part->bookCount, sizeof(Book), compareIsbnToBook);
 }
 
-// --- MENUS ---
+// --- SHARED CATALOG IMAGE ---
+// Checkpoints publish the catalog as one immutable image that lookup
+// processes (--reader) map read-only, so the pages are shared through
+// the page cache however many readers run and nothing is parsed. A new
+// image is written to a temp file and renamed into place, then the
+// generation word in catalog/generation is bumped; readers compare it
+// with the image they have mapped and remap when it moves.
 
-void menuAddAuthor(Author** head) {
-    char name[50], surname[50];
-    printf("Name: "); fgets(name, 50, stdin); name[strcspn(name, "\n")] = 0;
-    printf("Surname: "); fgets(surname, 50, stdin); surname[strcspn(surname, "\n")] = 0;
-    addAuthor(head, name, surname);
-    saveAuthorsToFile(*head, FILE_AUTHORS);
+static uint64_t* imageGeneration; // Writer's mapping of the generation word
+
+static size_t imageAlign(size_t n) {
+    return (n + 7) & ~(size_t)7;
 }
 
-void menuDeleteAuthor(Author** head, BookAuthorMap** arr, int* count) {
+typedef struct AuthorSlot {
     int id;
-    printf("Author ID to delete: "); scanf("%d", &id); while(getchar()!='\n');
-    *head = deleteAuthor(*head, id, arr, count);
-    saveAuthorsToFile(*head, FILE_AUTHORS);
+    int index;
+} AuthorSlot;
+
+static int compareAuthorSlot(const void* a, const void* b) {
+    const AuthorSlot* x = (const AuthorSlot*)a;
+    const AuthorSlot* y = (const AuthorSlot*)b;
+    return (x->id > y->id) - (x->id < y->id);
 }
 
-void menuAuthors(Author** head, BookAuthorMap** arr, int* count) {
-    int choice;
-    do {
-        printf("\n--- Author Menu ---\n1. Add Author\n2. Delete Author\n3. List Authors\n0. Back\nChoice: ");
-        scanf("%d", &choice); while(getchar()!='\n');
-        switch(choice) {
-            case 1: menuAddAuthor(head); break;
-            case 2: menuDeleteAuthor(head, arr, count); break;
-            case 3: listAuthors(*head); break;
-        }
-    } while(choice != 0);
+static int compareMapByIsbn(const void* a, const void* b) {
+    return strcmp(((const BookAuthorMap*)a)->bookISBN, ((const BookAuthorMap*)b)->bookISBN);
 }
 
-void menuStudents(Student** sHead, Book** bHead, LoanTransaction** lHead) {
-    int choice;
-    do {
-        printf("\n--- Student Menu ---\n1. Add Student\n2. Delete Student\n3. List Students\n4. Borrow/Return\n0. Back\nChoice: ");
-        scanf("%d", &choice); 
-        while(getchar()!='\n'); // Buffer temizliği
+static uint32_t imageText(char* text, size_t* len, const char* s) {
+    uint32_t off = (uint32_t)*len;
+    size_t n = strlen(s) + 1;
+    memcpy(text + *len, s, n);
+    *len += n;
+    return off;
+}
 
-        switch(choice) {
-            case 1: {
-                // Buffer boyutlarını güvenli hale getirdik (9 -> 20)
-                char id[20], name[50], sur[50]; 
-                
-                printf("ID: "); 
-                fgets(id, sizeof(id), stdin); 
-                id[strcspn(id, "\n")] = 0;
+static uint64_t* imageMapGeneration(int writable) {
+    int fd = open(FILE_CATALOG_GENERATION, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) return NULL;
+    if (writable && ftruncate(fd, sizeof(uint64_t)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void* p = mmap(NULL, sizeof(uint64_t), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : (uint64_t*)p;
+}
 
-                printf("Name: "); 
-                fgets(name, sizeof(name), stdin); 
-                name[strcspn(name, "\n")] = 0;
+// Builds the image from a checkpoint snapshot and swaps it in
+int publishCatalogImage(Snapshot* snap) {
+    if (mkdir(CATALOG_DIR, 0755) != 0 && errno != EEXIST) return 0;
+    if (!imageGeneration && !(imageGeneration = imageMapGeneration(1))) return 0;
 
-                printf("Surname: "); 
-                fgets(sur, sizeof(sur), stdin); 
-                sur[strcspn(sur, "\n")] = 0;
+    size_t books = (size_t)snap->bookCount, copies = 0, textLen = 0;
+    for (size_t i = 0; i < books; i++) {
+        for (BookCopy* c = snap->books[i].copies; c; c = c->next) copies++;
+        textLen += strlen(snap->books[i].title) + 1;
+    }
+    for (int i = 0; i < snap->authorCount; i++) {
+        textLen += strlen(snap->authors[i].name) + strlen(snap->authors[i].surname) + 2;
+    }
+    uint32_t bucketCount = 16;
+    while (bucketCount < books * 2) bucketCount <<= 1;
 
-                *sHead = addStudent(*sHead, id, name, sur);
-                saveStudentsToFile(*sHead, FILE_STUDENTS);
-                break;
-            }
-            case 2: {
-                char id[20]; // Burayı da arttırdık
-                printf("ID to delete: "); 
-                fgets(id, sizeof(id), stdin); 
-                id[strcspn(id, "\n")] = 0;
-                
-                deleteStudent(sHead, id);
-                saveStudentsToFile(*sHead, FILE_STUDENTS);
-                break;
-            }
-            case 3: {
-                Student* t = *sHead;
-                printf("ID\tName\tScore\n");
-                while(t){ 
-                    printf("%s\t%s %s\t%d\n", t->studentId, t->name, t->surname, t->score); 
-                    t=t->next; 
-                }
-                break;
-            }
-            case 4: {
-                int op;
-                // KRİTİK DÜZELTME BURADA: sId[9] yerine sId[20] yaptık
-                char sId[20], info[50], date[20]; 
-                
-                printf("1. Borrow\n2. Return\nSelect: "); 
-                scanf("%d", &op); 
-                while(getchar()!='\n'); // scanf sonrası temizlik
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, 4);
+    h.version = IMAGE_VERSION;
+    h.generation = __atomic_load_n(imageGeneration, __ATOMIC_ACQUIRE) + 1;
+    h.bookCount = (uint32_t)books;
+    h.copyCount = (uint32_t)copies;
+    h.authorCount = (uint32_t)snap->authorCount;
+    h.linkCount = (uint32_t)snap->mapCount; // Upper bound; rows of unknown authors are skipped
+    h.bucketCount = bucketCount;
+    h.bucketsOff = imageAlign(sizeof(ImageHeader));
+    h.booksOff = imageAlign(h.bucketsOff + sizeof(uint32_t) * bucketCount);
+    h.copiesOff = imageAlign(h.booksOff + sizeof(ImageBook) * books);
+    h.authorsOff = imageAlign(h.copiesOff + sizeof(ImageCopy) * copies);
+    h.linksOff = imageAlign(h.authorsOff + sizeof(ImageAuthor) * h.authorCount);
+    h.textOff = imageAlign(h.linksOff + sizeof(uint32_t) * h.linkCount);
+    h.size = imageAlign(h.textOff + textLen);
 
-                printf("Student ID: "); 
-                fgets(sId, sizeof(sId), stdin); 
-                sId[strcspn(sId, "\n")] = 0;
+    unsigned char* image = (unsigned char*)calloc(1, h.size);
+    AuthorSlot* slots = (AuthorSlot*)malloc(sizeof(AuthorSlot) * (h.authorCount ? h.authorCount : 1));
+    BookAuthorMap* map = (BookAuthorMap*)malloc(sizeof(BookAuthorMap) * (snap->mapCount ? snap->mapCount : 1));
+    if (!image || !slots || !map) {
+        free(image);
+        free(slots);
+        free(map);
+        return 0;
+    }
+    uint32_t* buckets = (uint32_t*)(image + h.bucketsOff);
+    ImageBook* iBooks = (ImageBook*)(image + h.booksOff);
+    ImageCopy* iCopies = (ImageCopy*)(image + h.copiesOff);
+    ImageAuthor* iAuthors = (ImageAuthor*)(image + h.authorsOff);
+    uint32_t* links = (uint32_t*)(image + h.linksOff);
+    char* text = (char*)(image + h.textOff);
+    size_t t = 0;
 
-                if(op==1) { 
-                    printf("Book ISBN: "); 
-                    fgets(info, sizeof(info), stdin); 
-                    info[strcspn(info, "\n")] = 0; 
-                }
-                else { 
-                    printf("Label (ISBN_1): "); 
-                    fgets(info, sizeof(info), stdin); 
-                    info[strcspn(info, "\n")] = 0; 
-                }
+    for (uint32_t i = 0; i < h.authorCount; i++) {
+        iAuthors[i].id = snap->authors[i].id;
+        iAuthors[i].nameOff = imageText(text, &t, snap->authors[i].name);
+        iAuthors[i].surnameOff = imageText(text, &t, snap->authors[i].surname);
+        slots[i].id = snap->authors[i].id;
+        slots[i].index = (int)i;
+    }
+    qsort(slots, h.authorCount, sizeof(AuthorSlot), compareAuthorSlot);
+    memcpy(map, snap->map, sizeof(BookAuthorMap) * snap->mapCount);
+    qsort(map, snap->mapCount, sizeof(BookAuthorMap), compareMapByIsbn);
 
-                printf("Date (DD.MM.YYYY): "); 
-                fgets(date, sizeof(date), stdin); 
-                date[strcspn(date, "\n")] = 0;
-                
-                if(op==1) processLoan(sHead, bHead, lHead, sId, info, date);
-                else processReturn(sHead, bHead, lHead, sId, info, date);
-                break;
-            }
+    uint32_t c = 0, l = 0;
+    for (uint32_t i = 0; i < books; i++) {
+        Book* b = &snap->books[i];
+        ImageBook* ib = &iBooks[i];
+        memcpy(ib->isbn, b->isbn, ISBN_LEN);
+        ib->titleOff = imageText(text, &t, b->title);
+        ib->quantity = b->quantity;
+        ib->borrowCount = b->borrowCount;
+        ib->firstCopy = c;
+        for (BookCopy* bc = b->copies; bc; bc = bc->next, c++) {
+            memcpy(iCopies[c].labelNo, bc->labelNo, sizeof(iCopies[c].labelNo));
+            memcpy(iCopies[c].borrowerStudentId, bc->borrowerStudentId, STUDENT_ID_LEN);
+            if (strcmp(bc->borrowerStudentId, "SHELF") == 0) ib->available++;
         }
-    } while(choice!=0);
-}
+        ib->copyCount = c - ib->firstCopy;
 
-// --- BOOK AUTHOR LINKING MENU ---
+        // Map rows are sorted by ISBN; books are not, so search per book
+        int lo = 0, hi = snap->mapCount;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (strcmp(map[mid].bookISBN, b->isbn) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        ib->firstLink = l;
+        for (int row = lo; row < snap->mapCount && strcmp(map[row].bookISBN, b->isbn) == 0; row++) {
+            AuthorSlot key = { map[row].authorID, 0 };
+            AuthorSlot* found = (AuthorSlot*)bsearch(&key, slots, h.authorCount, sizeof(AuthorSlot), compareAuthorSlot);
+            if (found) links[l++] = (uint32_t)found->index;
+        }
+        ib->linkCount = l - ib->firstLink;
 
-void menuLinkBookAuthor(Book* bHead, Author* aHead, BookAuthorMap** map, int* count) {
-    char isbn[14];
-    int authorId;
+        uint32_t slot = hashString(b->isbn, ISBN_LEN) & (bucketCount - 1);
+        while (buckets[slot]) slot = (slot + 1) & (bucketCount - 1);
+        buckets[slot] = i + 1;
+    }
+    h.linkCount = l;
+    h.textLen = t;
+    memcpy(image, &h, sizeof(h));
+    free(slots);
+    free(map);
 
-    printf("\n--- Available Books ---\n");
-    Book* bTmp = bHead;
-    while(bTmp) {
-        printf("ISBN: %s | Title: %s\n", bTmp->isbn, bTmp->title);
-        bTmp = bTmp->next;
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s%s", FILE_CATALOG_IMAGE, CHECKPOINT_TMP_SUFFIX);
+    CsvWriter w;
+    int ok = csvWriterOpen(&w, tmp, 0);
+    if (ok) {
+        csvPutBytes(&w, (const char*)image, h.size);
+        ok = csvWriterClose(&w) && rename(tmp, FILE_CATALOG_IMAGE) == 0;
+    }
+    free(image);
+    if (!ok) {
+        unlink(tmp);
+        return 0;
+    }
+    __atomic_store_n(imageGeneration, h.generation, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Maps the current image, checking that every section lies inside it
+static int imageMap(CatalogImage* img) {
+    int fd = open(FILE_CATALOG_IMAGE, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ImageHeader)) {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return 0;
+    const ImageHeader* h = (const ImageHeader*)p;
+    size_t size = (size_t)st.st_size;
+    int ok = memcmp(h->magic, IMAGE_MAGIC, 4) == 0 && h->version == IMAGE_VERSION && h->size == size
+          && h->bucketCount && !(h->bucketCount & (h->bucketCount - 1))
+          && h->bucketsOff + sizeof(uint32_t) * (uint64_t)h->bucketCount <= size
+          && h->booksOff + sizeof(ImageBook) * (uint64_t)h->bookCount <= size
+          && h->copiesOff + sizeof(ImageCopy) * (uint64_t)h->copyCount <= size
+          && h->authorsOff + sizeof(ImageAuthor) * (uint64_t)h->authorCount <= size
+          && h->linksOff + sizeof(uint32_t) * (uint64_t)h->linkCount <= size
+          && h->textOff + h->textLen <= size
+          && (h->textLen == 0 || ((const char*)p)[h->textOff + h->textLen - 1] == '\0');
+    if (!ok) {
+        munmap(p, size);
+        return 0;
     }
+    if (img->base) munmap((void*)img->base, img->size);
+    img->base = (const unsigned char*)p;
+    img->size = size;
+    img->header = h;
+    img->mapped = h->generation;
+    return 1;
+}
 
-    printf("\nEnter Book ISBN to Link: ");
-    fgets(isbn, sizeof(isbn), stdin);
-    isbn[strcspn(isbn, "\n")] = 0;
+int imageAttach(CatalogImage* img) {
+    memset(img, 0, sizeof(*img));
+    img->generation = imageMapGeneration(0);
+    return img->generation && imageMap(img);
+}
 
-    printf("\n--- Available Authors ---\n");
-    listAuthors(aHead); 
+// Remaps if the writer has published since; one atomic load otherwise
+void imageRefresh(CatalogImage* img) {
+    if (__atomic_load_n(img->generation, __ATOMIC_ACQUIRE) != img->mapped) imageMap(img);
+}
 
-    printf("\nEnter Author ID: ");
-    scanf("%d", &authorId);
-    while(getchar()!='\n'); 
+void imageDetach(CatalogImage* img) {
+    if (img->base) munmap((void*)img->base, img->size);
+    if (img->generation) munmap((void*)img->generation, sizeof(uint64_t));
+    memset(img, 0, sizeof(*img));
+}
 
-    if (addBookAuthorRelation(map, count, isbn, authorId)) {
-        printf("Success: Book linked to Author.\n");
-        saveBookAuthorMapToFile(*map, *count); 
-    } else {
-        printf("Error: Relation already exists or memory error.\n");
+static const ImageBook* imageBooks(const CatalogImage* img) {
+    return (const ImageBook*)(img->base + img->header->booksOff);
+}
+
+// Text at off, or "" if the offset is out of range
+static const char* imageString(const CatalogImage* img, uint32_t off) {
+    if (off >= img->header->textLen) return "";
+    return (const char*)(img->base + img->header->textOff + off);
+}
+
+const ImageBook* imageFind(const CatalogImage* img, const char* isbn) {
+    const ImageHeader* h = img->header;
+    const uint32_t* buckets = (const uint32_t*)(img->base + h->bucketsOff);
+    uint32_t slot = hashString(isbn, ISBN_LEN) & (h->bucketCount - 1);
+    for (uint32_t probes = 0; probes < h->bucketCount && buckets[slot]; probes++) {
+        uint32_t i = buckets[slot] - 1;
+        if (i < h->bookCount && strncmp(imageBooks(img)[i].isbn, isbn, ISBN_LEN) == 0) return &imageBooks(img)[i];
+        slot = (slot + 1) & (h->bucketCount - 1);
+    }
+    return NULL;
+}
+
+static void printImageBook(const CatalogImage* img, const ImageBook* b) {
+    const ImageHeader* h = img->header;
+    printf("%.*s | %s | %d of %d on shelf | borrowed %d times\n", ISBN_LEN, b->isbn, imageString(img, b->titleOff),
+           b->available, b->quantity, b->borrowCount);
+    const uint32_t* links = (const uint32_t*)(img->base + h->linksOff);
+    const ImageAuthor* authors = (const ImageAuthor*)(img->base + h->authorsOff);
+    for (uint32_t k = b->firstLink; k < b->firstLink + b->linkCount && k < h->linkCount; k++) {
+        if (links[k] < h->authorCount) {
+            printf("  Author: %s %s\n", imageString(img, authors[links[k]].nameOff), imageString(img, authors[links[k]].surnameOff));
+        }
+    }
+    const ImageCopy* copies = (const ImageCopy*)(img->base + h->copiesOff);
+    for (uint32_t k = b->firstCopy; k < b->firstCopy + b->copyCount && k < h->copyCount; k++) {
+        printf("  %.*s: %.*s\n", (int)sizeof(copies[k].labelNo), copies[k].labelNo,
+               STUDENT_ID_LEN, copies[k].borrowerStudentId);
     }
 }
 
-void menuBooks(Book** head, Author* aHead, BookAuthorMap** map, int* count) {
+// Lookup-only console over the shared image
+int runReader(void) {
+    CatalogImage img;
+    if (!imageAttach(&img)) {
+        printf("No catalog image; start the library once so a checkpoint publishes %s\n", FILE_CATALOG_IMAGE);
+        imageDetach(&img);
+        return 1;
+    }
     int choice;
     do {
-        printf("\n--- Book Menu ---\n");
+        printf("\n=== Catalog Lookup (read-only) ===\n");
+        printf("1. Find by ISBN\n2. Search Titles\n3. Image Status\n0. Exit\nSelect: ");
+        if (scanf("%d", &choice) != 1) break;
+        while (getchar() != '\n');
+        imageRefresh(&img);
+        const ImageHeader* h = img.header;
+        if (choice == 1) {
+            char isbn[20];
+            printf("ISBN: ");
+            if (!fgets(isbn, sizeof(isbn), stdin)) break;
+            isbn[strcspn(isbn, "\n")] = 0;
+            const ImageBook* b = imageFind(&img, isbn);
+            if (b) printImageBook(&img, b);
+            else printf("Book not found.\n");
+        } else if (choice == 2) {
+            char text[MAX_NAME_LEN];
+            printf("Title contains: ");
+            if (!fgets(text, sizeof(text), stdin)) break;
+            text[strcspn(text, "\n")] = 0;
+            int shown = 0;
+            for (uint32_t i = 0; i < h->bookCount && shown < TITLE_PAGE_SIZE; i++) {
+                const ImageBook* b = &imageBooks(&img)[i];
+                if (!strstr(imageString(&img, b->titleOff), text)) continue;
+                printf("%.*s | %s | %d of %d on shelf\n", ISBN_LEN, b->isbn, imageString(&img, b->titleOff),
+                       b->available, b->quantity);
+                shown++;
+            }
+            if (!shown) printf("No matching titles.\n");
+        } else if (choice == 3) {
+            printf("Generation %llu: %u books, %u copies, %u authors, %.1f KB mapped\n",
+                   (unsigned long long)h->generation, h->bookCount, h->copyCount, h->authorCount, img.size / 1024.0);
+        }
+    } while (choice != 0);
+    imageDetach(&img);
+    return 0;
+}
+
+// --- JOURNAL (GROUP COMMIT) ---
+// Records: "B,<studentId>,<label>,<date>" and
+//          "R,<studentId>,<label>,<date>,<penalty>".
+// The CSV files are the checkpoint; the journal holds everything since.
+
+// Gives concurrent transactions a short window to join the batch.
+// Caller holds journal.lock.
+static void journalWaitWindow(void) {
+    if (journal.windowUs <= 0 || journal.recordCount >= journal.maxBatch || !journal.running) return;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)journal.windowUs * 1000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (journal.recordCount < journal.maxBatch && journal.running) {
+        if (pthread_cond_timedwait(&journal.work, &journal.lock, &deadline) == ETIMEDOUT) break;
+    }
+}
+
+// Queued records the committer may write now: none past the boundary of
+// a pending rotation. Caller holds journal.lock.
+static int journalTakeable(void) {
+    if (!journal.rotatePending) return journal.recordCount;
+    unsigned long before = journal.rotateSeq - journal.takenSeq;
+    return before < (unsigned long)journal.recordCount ? (int)before : journal.recordCount;
+}
+
+// Moves up to maxBatch takeable records into *batch and returns their
+// size (0 if the buffer cannot grow). Caller holds journal.lock.
+static size_t journalTakeBatch(char** batch, size_t* batchCap, int* take) {
+    int takeable = journalTakeable();
+    *take = takeable < journal.maxBatch ? takeable : journal.maxBatch;
+    size_t bytes = journal.recordEnds[*take - 1];
+    if (bytes > *batchCap) {
+        char* grown = (char*)realloc(*batch, bytes);
+        if (!grown) return 0;
+        *batch = grown;
+        *batchCap = bytes;
+    }
+    memcpy(*batch, journal.pending, bytes);
+    journal.pendingLen -= bytes;
+    memmove(journal.pending, journal.pending + bytes, journal.pendingLen);
+    journal.recordCount -= *take;
+    for (int i = 0; i < journal.recordCount; i++)
+        journal.recordEnds[i] = journal.recordEnds[i + *take] - bytes;
+    journal.takenSeq += (unsigned long)*take;
+    return bytes;
+}
+
+// Latches a write or fdatasync failure. Records behind the failed batch
+// can no longer be made durable in order, so the queue is dropped and
+// every waiter is woken to report the failure. Caller holds journal.lock.
+static void journalFail(const char* what, int err) {
+    errno = err;
+    if (!journal.failed) perror(what);
+    journal.failed = 1;
+    journal.pendingLen = 0;
+    journal.recordCount = 0;
+    journal.takenSeq = journal.appendedSeq;
+    pthread_cond_broadcast(&journal.done);
+}
+
+// Thread backend: one blocking write + fdatasync per batch
+static void* journalCommitter(void* arg) {
+    (void)arg;
+    char* batch = NULL;
+    size_t batchCap = 0;
+    pthread_mutex_lock(&journal.lock);
+    while (1) {
+        while (journalTakeable() == 0 && journal.running)
+            pthread_cond_wait(&journal.work, &journal.lock);
+        if (journalTakeable() == 0) break;
+        journalWaitWindow();
+
+        int take;
+        size_t bytes = journalTakeBatch(&batch, &batchCap, &take);
+        if (!bytes) {
+            journalFail("journal batch", ENOMEM);
+            continue;
+        }
+        pthread_mutex_unlock(&journal.lock);
+
+        const char* failure = NULL;
+        int err = 0;
+        size_t off = 0;
+        while (off < bytes) {
+            ssize_t n = write(journal.fd, batch + off, bytes - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                failure = "journal write";
+                err = n < 0 ? errno : EIO;
+                break;
+            }
+            off += (size_t)n;
+        }
+        if (!failure && fdatasync(journal.fd) != 0) {
+            failure = "journal fdatasync";
+            err = errno;
+        }
+
+        pthread_mutex_lock(&journal.lock);
+        if (failure) {
+            journalFail(failure, err);
+            continue;
+        }
+        journal.durableSeq += take;
+        journal.batches++;
+        journal.records += take;
+        pthread_cond_broadcast(&journal.done);
+    }
+    pthread_mutex_unlock(&journal.lock);
+    free(batch);
+    return NULL;
+}
+
+#ifdef HAVE_IO_URING
+// io_uring backend: each batch is a write at an explicit offset linked
+// to an fdatasync, and up to JOURNAL_URING_INFLIGHT batches are in
+// flight while the next one is gathered. Batches can complete out of
+// order, so durableSeq only advances over the oldest completed ones; a
+// crash can leave a zero-filled gap before an unacknowledged batch, and
+// replay stops there.
+
+static int uringSetup(JournalRing* r) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, JOURNAL_URING_DEPTH, &p);
+    if (fd < 0) return 0;
+    r->sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cqMapLen > r->sqMapLen) r->sqMapLen = r->cqMapLen;
+    r->sqMap = mmap(NULL, r->sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    r->cqMap = single ? r->sqMap
+                      : mmap(NULL, r->cqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    r->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqMap == MAP_FAILED || r->cqMap == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqesLen);
+        if (r->cqMap != MAP_FAILED && !single) munmap(r->cqMap, r->cqMapLen);
+        if (r->sqMap != MAP_FAILED) munmap(r->sqMap, r->sqMapLen);
+        close(fd);
+        return 0;
+    }
+    char* sq = (char*)r->sqMap;
+    char* cq = (char*)r->cqMap;
+    r->sqHead = (unsigned*)(sq + p.sq_off.head);
+    r->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    r->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned*)(sq + p.sq_off.array);
+    r->cqHead = (unsigned*)(cq + p.cq_off.head);
+    r->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    r->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = cq + p.cq_off.cqes;
+    r->fd = fd;
+    r->slotHead = r->inflight = 0;
+    return 1;
+}
+
+static void uringTeardown(JournalRing* r) {
+    if (r->fd < 0) return;
+    munmap(r->sqes, r->sqesLen);
+    if (r->cqMap != r->sqMap) munmap(r->cqMap, r->cqMapLen);
+    munmap(r->sqMap, r->sqMapLen);
+    close(r->fd);
+    r->fd = -1;
+    for (int i = 0; i < JOURNAL_URING_INFLIGHT; i++) {
+        free(r->slots[i].buf);
+        r->slots[i].buf = NULL;
+        r->slots[i].cap = 0;
+    }
+}
+
+// Queues the write + fdatasync pair of a slot. Returns 0 if the kernel
+// took neither; the slot is then written synchronously.
+static int uringSubmitBatch(JournalRing* r, int slot) {
+    JournalSlot* s = &r->slots[slot];
+    struct io_uring_sqe* sqes = (struct io_uring_sqe*)r->sqes;
+    unsigned tail = *r->sqTail;
+    unsigned w = tail & *r->sqMask, f = (tail + 1) & *r->sqMask;
+    memset(&sqes[w], 0, sizeof(sqes[w]));
+    sqes[w].opcode = IORING_OP_WRITE;
+    sqes[w].fd = journal.fd;
+    sqes[w].addr = (uint64_t)(uintptr_t)s->buf;
+    sqes[w].len = (uint32_t)s->bytes;
+    sqes[w].off = (uint64_t)s->offset;
+    sqes[w].flags = IOSQE_IO_LINK;
+    sqes[w].user_data = (uint64_t)slot * 2;
+    memset(&sqes[f], 0, sizeof(sqes[f]));
+    sqes[f].opcode = IORING_OP_FSYNC;
+    sqes[f].fd = journal.fd;
+    sqes[f].fsync_flags = IORING_FSYNC_DATASYNC;
+    sqes[f].user_data = (uint64_t)slot * 2 + 1;
+    r->sqArray[w] = w;
+    r->sqArray[f] = f;
+    __atomic_store_n(r->sqTail, tail + 2, __ATOMIC_RELEASE);
+
+    int submitted = 0;
+    while (submitted < 2) {
+        int n = (int)syscall(__NR_io_uring_enter, r->fd, 2 - submitted, 0, 0, NULL, 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) continue;
+        if (n <= 0) break;
+        submitted += n;
+    }
+    if (submitted == 0) {
+        __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE); // Never seen by the kernel
+        return 0;
+    }
+    return 1;
+}
+
+// Collects completions, waiting for at least one if asked
+static void uringReap(JournalRing* r, int wait) {
+    if (wait) {
+        while (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno == EINTR);
+    }
+    struct io_uring_cqe* cqes = (struct io_uring_cqe*)r->cqes;
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &cqes[head & *r->cqMask];
+        JournalSlot* s = &r->slots[cqe->user_data / 2];
+        if (cqe->user_data % 2 == 0) {
+            s->written = cqe->res;
+        } else {
+            // A short or failed write cancels the linked fdatasync
+            s->done = (cqe->res < 0 || s->written != (int)s->bytes) ? -1 : 1;
+        }
+        head++;
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+}
+
+// Blocking fallback for a batch io_uring did not complete. Returns 0
+// with errno set if the batch is not durable.
+static int journalWriteAt(const char* data, size_t bytes, off_t offset) {
+    size_t off = 0;
+    while (off < bytes) {
+        ssize_t n = pwrite(journal.fd, data + off, bytes - off, offset + (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return 0;
+        }
+        off += (size_t)n;
+    }
+    return fdatasync(journal.fd) == 0;
+}
+
+static void* journalUringCommitter(void* arg) {
+    (void)arg;
+    JournalRing* r = &journal.ring;
+    pthread_mutex_lock(&journal.lock);
+    while (1) {
+        while (journalTakeable() == 0 && journal.running && r->inflight == 0)
+            pthread_cond_wait(&journal.work, &journal.lock);
+        if (journalTakeable() == 0 && r->inflight == 0) break;
+
+        if (journalTakeable() > 0 && r->inflight < JOURNAL_URING_INFLIGHT) {
+            if (r->inflight == 0) journalWaitWindow();
+            int slot = (r->slotHead + r->inflight) % JOURNAL_URING_INFLIGHT;
+            JournalSlot* s = &r->slots[slot];
+            s->bytes = journalTakeBatch(&s->buf, &s->cap, &s->take);
+            if (!s->bytes) {
+                journalFail("journal batch", ENOMEM);
+                continue;
+            }
+            s->offset = journal.offset;
+            journal.offset += (off_t)s->bytes;
+            s->written = 0;
+            s->done = 0;
+            r->inflight++;
+            pthread_mutex_unlock(&journal.lock);
+            if (!uringSubmitBatch(r, slot)) s->done = -1;
+            pthread_mutex_lock(&journal.lock);
+            continue;
+        }
+
+        // Only this thread changes the slots and the failed flag, so they
+        // are read unlocked. Once a batch fails, the ones after it are
+        // reaped but not counted: durableSeq never passes a lost record.
+        pthread_mutex_unlock(&journal.lock);
+        uringReap(r, r->slots[r->slotHead].done == 0);
+        int finished = 0, failed = journal.failed, err = 0;
+        unsigned long records = 0;
+        while (finished < r->inflight) {
+            JournalSlot* s = &r->slots[(r->slotHead + finished) % JOURNAL_URING_INFLIGHT];
+            if (s->done == 0) break;
+            if (s->done < 0 && !failed && !journalWriteAt(s->buf, s->bytes, s->offset)) {
+                failed = 1;
+                err = errno;
+            }
+            if (!failed) records += (unsigned long)s->take;
+            finished++;
+        }
+        pthread_mutex_lock(&journal.lock);
+        if (failed && !journal.failed) journalFail("journal write", err);
+        if (finished) {
+            r->slotHead = (r->slotHead + finished) % JOURNAL_URING_INFLIGHT;
+            r->inflight -= finished;
+            journal.durableSeq += records;
+            journal.batches += (unsigned long)finished;
+            journal.records += records;
+            pthread_cond_broadcast(&journal.done);
+        }
+    }
+    pthread_mutex_unlock(&journal.lock);
+    return NULL;
+}
+#endif
+
+// With io_uring the file is written at explicit offsets, so O_APPEND
+// (which would override them) is dropped
+static void journalAdoptFd(int fd) {
+    journal.fd = fd;
+    journal.offset = lseek(fd, 0, SEEK_END);
+    if (journal.ring.fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_APPEND);
+}
+
+const char* journalBackend() {
+    return journal.ring.fd >= 0 ? "io_uring" : "thread";
+}
+
+// A crash or a failed write can leave part of a record at the end of the
+// file. Replay skips it, but the next record would be appended to it, so
+// the file is cut back to its last complete record.
+static void journalTrimTornTail(int fd, const char* path) {
+    int in = open(path, O_RDONLY);
+    if (in < 0) return;
+    off_t size = lseek(in, 0, SEEK_END), keep = size;
+    char buf[512];
+    int ok = size >= 0;
+    while (ok && keep > 0) {
+        size_t n = keep < (off_t)sizeof(buf) ? (size_t)keep : sizeof(buf);
+        if (pread(in, buf, n, keep - (off_t)n) != (ssize_t)n) ok = 0;
+        while (ok && n > 0 && buf[n - 1] != '\n') {
+            n--;
+            keep--;
+        }
+        if (n > 0) break;
+    }
+    close(in);
+    if (ok && keep < size && ftruncate(fd, keep) == 0) fdatasync(fd);
+}
+
+int journalOpen(const char* path) {
+    snprintf(journal.path, sizeof(journal.path), "%s", path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        printf("Could not open journal: %s\n", path);
+        return 0;
+    }
+    journalTrimTornTail(fd, path);
+    void* (*committer)(void*) = journalCommitter;
+#ifdef HAVE_IO_URING
+    if (journal.useUring && uringSetup(&journal.ring)) committer = journalUringCommitter;
+#endif
+    journalAdoptFd(fd);
+    journal.appendedSeq = journal.takenSeq = journal.durableSeq = 0;
+    journal.rotatePending = 0;
+    journal.batches = journal.records = 0;
+    journal.failed = 0;
+    journal.running = 1;
+    if (pthread_create(&journal.thread, NULL, committer, NULL) != 0) {
+#ifdef HAVE_IO_URING
+        uringTeardown(&journal.ring);
+#endif
+        close(journal.fd);
+        journal.fd = -1;
+        journal.running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void journalClose() {
+    if (journal.fd < 0) return;
+    pthread_mutex_lock(&journal.lock);
+    journal.running = 0;
+    pthread_cond_signal(&journal.work);
+    pthread_mutex_unlock(&journal.lock);
+    pthread_join(journal.thread, NULL);
+#ifdef HAVE_IO_URING
+    uringTeardown(&journal.ring);
+#endif
+    close(journal.fd);
+    journal.fd = -1;
+    free(journal.pending);
+    free(journal.recordEnds);
+    journal.pending = NULL;
+    journal.recordEnds = NULL;
+    journal.pendingLen = journal.pendingCap = 0;
+    journal.recordCount = journal.recordCap = 0;
+}
+
+// Queues one record and returns its sequence number (0 if no journal is
+// open, JOURNAL_SEQ_FAILED if the record could not be queued)
+unsigned long journalAppend(const char* record, size_t len) {
+    if (journal.fd < 0) return 0;
+    pthread_mutex_lock(&journal.lock);
+    if (journal.failed) {
+        pthread_mutex_unlock(&journal.lock);
+        return JOURNAL_SEQ_FAILED;
+    }
+    if (journal.pendingLen + len > journal.pendingCap) {
+        size_t newCap = journal.pendingCap ? journal.pendingCap * 2 : 4096;
+        while (newCap < journal.pendingLen + len) newCap *= 2;
+        char* grown = (char*)realloc(journal.pending, newCap);
+        if (!grown) { pthread_mutex_unlock(&journal.lock); return JOURNAL_SEQ_FAILED; }
+        journal.pending = grown;
+        journal.pendingCap = newCap;
+    }
+    if (journal.recordCount == journal.recordCap) {
+        int newCap = journal.recordCap ? journal.recordCap * 2 : 256;
+        size_t* grown = (size_t*)realloc(journal.recordEnds, sizeof(size_t) * newCap);
+        if (!grown) { pthread_mutex_unlock(&journal.lock); return JOURNAL_SEQ_FAILED; }
+        journal.recordEnds = grown;
+        journal.recordCap = newCap;
+    }
+    memcpy(journal.pending + journal.pendingLen, record, len);
+    journal.pendingLen += len;
+    journal.recordEnds[journal.recordCount++] = journal.pendingLen;
+    unsigned long seq = ++journal.appendedSeq;
+    pthread_cond_signal(&journal.work);
+    pthread_mutex_unlock(&journal.lock);
+    return seq;
+}
+
+// The sequence to wait for after two records: the later one, or
+// JOURNAL_SEQ_FAILED (which sorts last) if either was not queued
+static unsigned long journalLaterSeq(unsigned long a, unsigned long b) {
+    return a > b ? a : b;
+}
+
+// Returns 1 once record seq is durable, 0 if it never will be
+int journalWaitDurable(unsigned long seq) {
+    if (seq == 0) return 1;
+    if (seq == JOURNAL_SEQ_FAILED) return 0;
+    pthread_mutex_lock(&journal.lock);
+    while (journal.durableSeq < seq && journal.running && !journal.failed)
+        pthread_cond_wait(&journal.done, &journal.lock);
+    int durable = journal.durableSeq >= seq;
+    pthread_mutex_unlock(&journal.lock);
+    return durable;
+}
+
+// Waits until every record queued so far is durable
+int journalSync() {
+    pthread_mutex_lock(&journal.lock);
+    unsigned long seq = journal.appendedSeq;
+    pthread_mutex_unlock(&journal.lock);
+    return journalWaitDurable(seq);
+}
+
+// Text fields are written the way csvPutField writes them, so names
+// with commas or quotes replay intact. A field must be shorter than
+// MAX_NAME_LEN and may not hold a newline, which would end the record.
+int journalTextOk(const char* s) {
+    return strlen(s) < MAX_NAME_LEN && !strchr(s, '\n');
+}
+
+// Quotes s into dst (JOURNAL_FIELD_LEN bytes) when it holds a delimiter
+const char* journalQuote(char* dst, const char* s) {
+    if (!strpbrk(s, ",\"\r")) return s;
+    char* out = dst;
+    *out++ = '"';
+    for (; *s; s++) {
+        if (*s == '"') *out++ = '"';
+        *out++ = *s;
+    }
+    *out++ = '"';
+    *out = '\0';
+    return dst;
+}
+
+int storageFormat(char* record, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Formats one change record into record (JOURNAL_RECORD_LEN bytes) and
+// returns its length, or -1 if it does not fit. Callers format before
+// changing any state, so a record that does not fit refuses the change
+// instead of applying one that cannot be journaled.
+int storageFormat(char* record, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(record, JOURNAL_RECORD_LEN, fmt, ap);
+    va_end(ap);
+    return (len < 0 || len >= JOURNAL_RECORD_LEN) ? -1 : len;
+}
+
+// Hands a formatted record to the storage engine once its change is
+// applied. Returns the sequence number to pass to commitChange.
+unsigned long storageApply(const char* record, int len) {
+    return storage->apply(record, (size_t)len);
+}
+
+static void syncDirectory() {
+    int dirFd = open(".", O_RDONLY);
+    if (dirFd < 0) return;
+    fsync(dirFd);
+    close(dirFd);
+}
+
+void journalGenerationPath(char* out, size_t size, const char* base, int generation) {
+    snprintf(out, size, JOURNAL_GENERATION_FMT, base, generation);
+}
+
+// Rotated files of the journal at base still on disk. They are numbered
+// from 1; replay stops at the first gap, so anything after it is ignored.
+int journalGenerationCount(const char* base) {
+    char path[sizeof(journal.path) + 16];
+    int count = 0;
+    while (1) {
+        journalGenerationPath(path, sizeof(path), base, count + 1);
+        if (access(path, F_OK) != 0) return count;
+        count++;
+    }
+}
+
+// Marks a checkpoint boundary: the records queued so far belong to the
+// snapshot being copied, and the committer stops before the next one
+// until journalRotateFinish has switched files. Callers must block every
+// appender (loanLock plus the library lock) so no record straddles the
+// boundary. No I/O happens here.
+void journalRotateMark() {
+    if (journal.fd < 0) return;
+    pthread_mutex_lock(&journal.lock);
+    journal.rotateSeq = journal.appendedSeq;
+    journal.rotatePending = 1;
+    pthread_mutex_unlock(&journal.lock);
+}
+
+// Completes a rotation after the checkpoint locks are released. Once the
+// records before the boundary are durable, the journal is renamed to the
+// next "<journal>.<n>" and a new file takes its place. On failure the
+// committer carries on in the same file and 0 is returned: a snapshot
+// must not be written then, or replay would apply those records twice.
+int journalRotateFinish() {
+    if (journal.fd < 0) return 1;
+    pthread_mutex_lock(&journal.lock);
+    while (journal.durableSeq < journal.rotateSeq && journal.running && !journal.failed)
+        pthread_cond_wait(&journal.done, &journal.lock);
+    int ok = journal.durableSeq >= journal.rotateSeq && !journal.failed;
+    pthread_mutex_unlock(&journal.lock);
+
+    // The committer is parked at the boundary, so the file is idle
+    int fd = -1;
+    if (ok) {
+        char prev[sizeof(journal.path) + 16];
+        journalGenerationPath(prev, sizeof(prev), journal.path, journalGenerationCount(journal.path) + 1);
+        if (rename(journal.path, prev) == 0) {
+            fd = open(journal.path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) rename(prev, journal.path);
+        }
+        if (fd < 0) {
+            perror("journal rotate");
+            ok = 0;
+        }
+    }
+
+    pthread_mutex_lock(&journal.lock);
+    if (ok) {
+        close(journal.fd);
+        journalAdoptFd(fd);
+    }
+    journal.rotatePending = 0;
+    pthread_cond_signal(&journal.work);
+    pthread_mutex_unlock(&journal.lock);
+    if (ok) syncDirectory();
+    return ok;
+}
+
+// Deletes the rotated files a checkpoint covers, newest first
+void journalDropGenerations(const char* base) {
+    char path[sizeof(journal.path) + 16];
+    for (int generation = journalGenerationCount(base); generation > 0; generation--) {
+        journalGenerationPath(path, sizeof(path), base, generation);
+        unlink(path);
+    }
+    syncDirectory();
+}
+
+// --- BACKGROUND CHECKPOINT ---
+// A checkpoint copies the resident state under every lock and marks the
+// journal boundary at the same instant; nothing under those locks
+// touches the disk. The journal file is then switched, and the CSV files
+// are written from the copy with temp file + rename while the foreground
+// keeps serving requests.
+
+void checkpointNoteChanges(int n) {
+    int dirty = __atomic_add_fetch(&checkpointer.dirty, n, __ATOMIC_RELAXED);
+    if (dirty >= checkpointer.dirtyThreshold && checkpointer.running) {
+        pthread_mutex_lock(&checkpointer.lock);
+        pthread_cond_signal(&checkpointer.wake);
+        pthread_mutex_unlock(&checkpointer.lock);
+    }
+}
+
+// Makes a journaled change durable and schedules it for the next
+// checkpoint. With --commit-mode async the caller does not wait; SYNC (or
+// journalSync) waits for everything queued so far. Returns 0 if the
+// journal failed, so the caller must not report the change as saved.
+int commitChange(unsigned long seq) {
+    checkpointNoteChanges(1);
+    if (seq == JOURNAL_SEQ_FAILED) return 0;
+    if (!journal.asyncCommit) return journalWaitDurable(seq);
+    return !__atomic_load_n(&journal.failed, __ATOMIC_RELAXED);
+}
+
+static void freeSnapshot(Snapshot* snap) {
+    free(snap->authors);
+    free(snap->students);
+    free(snap->books);
+    free(snap->copies);
+    free(snap->map);
+    free(snap->holdQueues);
+    free(snap->holds);
+    memset(snap, 0, sizeof(*snap));
+}
+
+// Caller holds every lock, so the lists cannot change underneath
+static int copySnapshot(Library* lib, Snapshot* snap) {
+    int authors = 0, students = 0, books = 0, copies = 0, queues = 0, holds = 0;
+    for (Author* a = lib->authors; a; a = a->next) authors++;
+    for (Student* t = lib->students; t; t = t->next) students++;
+    for (Book* b = lib->books; b; b = b->next) {
+        books++;
+        for (BookCopy* c = b->copies; c; c = c->next) copies++;
+        if (b->holds) {
+            queues++;
+            holds += b->holds->count;
+        }
+    }
+    snap->authors = (Author*)malloc(sizeof(Author) * (authors ? authors : 1));
+    snap->students = (Student*)malloc(sizeof(Student) * (students ? students : 1));
+    snap->books = (Book*)malloc(sizeof(Book) * (books ? books : 1));
+    snap->copies = (BookCopy*)malloc(sizeof(BookCopy) * (copies ? copies : 1));
+    snap->map = (BookAuthorMap*)malloc(sizeof(BookAuthorMap) * (lib->mapCount ? lib->mapCount : 1));
+    snap->holdQueues = (HoldQueue*)malloc(sizeof(HoldQueue) * (queues ? queues : 1));
+    snap->holds = (Hold*)malloc(sizeof(Hold) * (holds ? holds : 1));
+    if (!snap->authors || !snap->students || !snap->books || !snap->copies || !snap->map
+        || !snap->holdQueues || !snap->holds) return 0;
+
+    int i = 0;
+    for (Author* a = lib->authors; a; a = a->next, i++) {
+        snap->authors[i] = *a;
+        snap->authors[i].next = (i + 1 < authors) ? &snap->authors[i + 1] : NULL;
+    }
+    i = 0;
+    for (Student* t = lib->students; t; t = t->next, i++) {
+        snap->students[i] = *t;
+        snap->students[i].prev = NULL;
+        snap->students[i].next = (i + 1 < students) ? &snap->students[i + 1] : NULL;
+    }
+    i = 0;
+    int c = 0, q = 0, h = 0;
+    for (Book* b = lib->books; b; b = b->next, i++) {
+        snap->books[i] = *b;
+        snap->books[i].next = (i + 1 < books) ? &snap->books[i + 1] : NULL;
+        snap->books[i].copies = NULL;
+        snap->books[i].skip = NULL;
+        snap->books[i].holds = NULL;
+        if (b->holds) {
+            HoldQueue* queue = &snap->holdQueues[q++];
+            *queue = *b->holds;
+            queue->head = queue->tail = NULL;
+            for (Hold* src = b->holds->head; src; src = src->next) {
+                Hold* dst = &snap->holds[h++];
+                *dst = *src;
+                dst->next = NULL;
+                if (queue->tail) queue->tail->next = dst;
+                else queue->head = dst;
+                queue->tail = dst;
+            }
+            snap->books[i].holds = queue;
+        }
+        BookCopy* last = NULL;
+        for (BookCopy* bc = b->copies; bc; bc = bc->next, c++) {
+            snap->copies[c] = *bc;
+            snap->copies[c].next = NULL;
+            if (last) last->next = &snap->copies[c];
+            else snap->books[i].copies = &snap->copies[c];
+            last = &snap->copies[c];
+        }
+    }
+    snap->authorCount = authors;
+    snap->studentCount = students;
+    snap->bookCount = books;
+    if (lib->mapCount) memcpy(snap->map, lib->mapArr, sizeof(BookAuthorMap) * lib->mapCount);
+    snap->mapCount = lib->mapCount;
+    snap->loans = lib->loans;
+    statsRead(&snap->stats);
+    snap->stats.topCount = 0;
+    return 1;
+}
+
+// CSV engine checkpoint: one file per table, each written to a temp
+// file and renamed into place
+static int csvWriteSnapshot(Snapshot* snap) {
+    static const char* files[] = { FILE_AUTHORS, FILE_STUDENTS, FILE_BOOKS, FILE_COPIES, FILE_LOANS, FILE_BOOK_AUTHORS, FILE_STATS, FILE_HOLDS };
+    char tmp[8][64];
+    for (int i = 0; i < 8; i++) snprintf(tmp[i], sizeof(tmp[i]), "%s%s", files[i], CHECKPOINT_TMP_SUFFIX);
+
+    Book* books = snap->bookCount ? snap->books : NULL;
+    int ok = saveAuthorsToFile(snap->authorCount ? snap->authors : NULL, tmp[0])
+          && saveStudentsToFile(snap->studentCount ? snap->students : NULL, tmp[1])
+          && saveBooksToFile(books, tmp[2])
+          && saveBookCopiesToFile(books, tmp[3])
+          && saveLoansToFile(snap->loans, tmp[4])
+          && saveBookAuthorMapToFile(snap->map, snap->mapCount, tmp[5])
+          && saveStatsToFile(&snap->stats, tmp[6])
+          && saveHoldsToFile(books, tmp[7]);
+    for (int i = 0; ok && i < 8; i++) {
+        if (rename(tmp[i], files[i]) != 0) ok = 0;
+    }
+    if (!ok) {
+        for (int i = 0; i < 8; i++) unlink(tmp[i]);
+        return 0;
+    }
+    syncDirectory();
+    // The CSV files are now the newest snapshot
+    if (unlink(FILE_LIBRARY_BIN) == 0) syncDirectory();
+    return 1;
+}
+
+// Takes a snapshot and writes it out. Safe to call from any thread.
+int checkpointLibrary(Library* lib) {
+    Snapshot snap;
+    ArchivePlan plan;
+    memset(&plan, 0, sizeof(plan));
+    memset(&snap, 0, sizeof(snap));
+    if (!storage->checkpoint) return 1;
+
+    pthread_mutex_lock(&persistLock);
+    if (archiveHorizonDays > 0) {
+        // Only this thread ever unlinks history nodes, so the list can be
+        // scanned and the segments written without holding any lock
+        pthread_mutex_lock(&loanLock);
+        LoanTransaction* history = lib->loans;
+        pthread_mutex_unlock(&loanLock);
+        int today = (int)(time(NULL) / (60 * 60 * 24));
+        planArchive(history, today - archiveHorizonDays, &plan);
+        if (plan.count && !writeArchiveSegments(&plan)) printf("Archive: a segment was not written; its records stay resident.\n");
+        keepArchivedPairs(&plan);
+    }
+
+    // Unlinking history nodes needs every reader out of the lists
+    if (plan.count) {
+        pthread_rwlock_wrlock(&libraryLock);
+        intervalIndexSync(&lib->loans);
+    } else {
+        pthread_rwlock_rdlock(&libraryLock);
+    }
+    lockAllShards();
+    lockAllStudents();
+    pthread_mutex_lock(&loanLock);
+    if (plan.count) detachArchived(lib, &plan);
+    journalRotateMark();
+    int ok = copySnapshot(lib, &snap);
+    if (ok) {
+        snap.epoch = ++checkpointer.epoch;
+        __atomic_store_n(&checkpointer.dirty, 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&loanLock);
+    unlockAllStudents();
+    unlockAllShards();
+    pthread_rwlock_unlock(&libraryLock);
+
+    if (!journalRotateFinish() && ok) {
+        ok = 0;
+        printf("Checkpoint %lu skipped; the journal could not be rotated.\n", snap.epoch);
+    }
+    if (ok) {
+        ok = storage->checkpoint(&snap);
+        if (!ok) printf("Checkpoint %lu failed; the journal keeps the changes.\n", snap.epoch);
+    }
+    if (ok) {
+        // Derived from the snapshot just written; a failure only leaves
+        // kiosks and readers on the previous catalog
+        Book* books = snap.bookCount ? snap.books : NULL;
+        if (!saveCatalogPartitions(books)) printf("Checkpoint %lu: catalog partitions not written.\n", snap.epoch);
+        if (!publishCatalogImage(&snap)) printf("Checkpoint %lu: catalog image not published.\n", snap.epoch);
+    }
+    if (ok && journal.fd >= 0) journalDropGenerations(journal.path);
+    pthread_mutex_unlock(&persistLock);
+    freeSnapshot(&snap);
+    archivePlanFree(&plan);
+    return ok;
+}
+
+static void* checkpointThread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&checkpointer.lock);
+    while (checkpointer.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += checkpointer.intervalSec;
+        while (checkpointer.running && __atomic_load_n(&checkpointer.dirty, __ATOMIC_RELAXED) < checkpointer.dirtyThreshold) {
+            if (pthread_cond_timedwait(&checkpointer.wake, &checkpointer.lock, &deadline) == ETIMEDOUT) break;
+        }
+        if (!checkpointer.running) break;
+        if (__atomic_load_n(&checkpointer.dirty, __ATOMIC_RELAXED) == 0) continue;
+        pthread_mutex_unlock(&checkpointer.lock);
+        checkpointLibrary(checkpointer.lib);
+        pthread_mutex_lock(&checkpointer.lock);
+    }
+    pthread_mutex_unlock(&checkpointer.lock);
+    return NULL;
+}
+
+void checkpointerStart(Library* lib) {
+    checkpointer.lib = lib;
+    checkpointer.running = 1;
+    if (pthread_create(&checkpointer.thread, NULL, checkpointThread, NULL) != 0) checkpointer.running = 0;
+}
+
+void checkpointerStop() {
+    if (!checkpointer.running) return;
+    pthread_mutex_lock(&checkpointer.lock);
+    checkpointer.running = 0;
+    pthread_cond_signal(&checkpointer.wake);
+    pthread_mutex_unlock(&checkpointer.lock);
+    pthread_join(checkpointer.thread, NULL);
+}
+
+// --- LOAN FUNCTIONS ---
+
+// One loans.csv / archive segment row
+void csvPutLoan(CsvWriter* w, const LoanTransaction* t) {
+    csvPutStr(w, t->studentId);
+    csvPutChar(w, ',');
+    csvPutStr(w, t->bookLabelNo);
+    csvPutChar(w, ',');
+    csvPutInt(w, t->operationType);
+    csvPutChar(w, ',');
+    csvPutStr(w, t->date);
+    csvPutChar(w, '\n');
+}
+
+int saveLoansToFile(LoanTransaction* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    LoanTransaction* iter = head;
+    while (iter) {
+        csvPutLoan(&w, iter);
+        iter = iter->next;
+    }
+    return csvWriterClose(&w);
+}
+
+LoanTransaction* addLoanTransaction(LoanTransaction** head, const char* sId, const char* label, int type, const char* date) {
+    LoanTransaction* newNode = (LoanTransaction*)malloc(sizeof(LoanTransaction));
+    if (!newNode) return NULL;
+    strncpy(newNode->studentId, sId, STUDENT_ID_LEN - 1);
+    newNode->studentId[STUDENT_ID_LEN - 1] = '\0';
+
+    strncpy(newNode->bookLabelNo, label, sizeof(newNode->bookLabelNo) - 1);
+    newNode->bookLabelNo[sizeof(newNode->bookLabelNo) - 1] = '\0';
+
+    newNode->operationType = type;
+    strncpy(newNode->date, date, sizeof(newNode->date) - 1);
+    newNode->date[sizeof(newNode->date) - 1] = '\0';
+
+    newNode->next = *head;
+    *head = newNode;
+    loanHistoryAdded++;
+    return newNode;
+}
+
+// Open loans are reachable from the copy (its borrow record) and from the
+// borrower (a list through holderNext), so returns and deletes never scan
+// the history. Callers hold the copy's shard lock and the student's stripe.
+void openLoan(Student* student, BookCopy* copy, LoanTransaction* borrow) {
+    copy->loan = borrow;
+    if (!student) return;
+    copy->holderNext = student->loans;
+    student->loans = copy;
+}
+
+void closeLoan(Student* student, BookCopy* copy) {
+    copy->loan = NULL;
+    if (!student) return;
+    BookCopy** link = &student->loans;
+    while (*link && *link != copy) link = &(*link)->holderNext;
+    if (*link) *link = copy->holderNext;
+    copy->holderNext = NULL;
+}
+
+// Links every lent copy to its borrow record after loading. The history
+// is newest first, so the first record seen for a copy decides.
+void linkOpenLoans(Library* lib) {
+    static LoanTransaction unmatched; // Newest record is not the copy's borrow
+    int pending = 0;
+    for (Book* b = lib->books; b; b = b->next) {
+        for (BookCopy* c = b->copies; c; c = c->next) {
+            if (strcmp(c->borrowerStudentId, "SHELF") != 0) pending++;
+        }
+    }
+    int stray = 0;
+    for (LoanTransaction* t = lib->loans; t && pending > 0; t = t->next) {
+        Book* book = catalogFindN(t->bookLabelNo, isbnLengthOfLabel(t->bookLabelNo));
+        BookCopy* copy = book ? book->copies : NULL;
+        while (copy && strcmp(copy->labelNo, t->bookLabelNo) != 0) copy = copy->next;
+        if (!copy || copy->loan || strcmp(copy->borrowerStudentId, "SHELF") == 0) continue;
+        pending--;
+        if (t->operationType == OP_TYPE_BORROW && strcmp(t->studentId, copy->borrowerStudentId) == 0) {
+            openLoan(findStudent(lib->students, t->studentId), copy, t);
+        } else {
+            copy->loan = &unmatched;
+            stray++;
+        }
+    }
+    for (Book* b = lib->books; stray && b; b = b->next) {
+        for (BookCopy* c = b->copies; c; c = c->next) {
+            if (c->loan == &unmatched) c->loan = NULL;
+        }
+    }
+}
+
+// labelOut (optional, LABEL_LEN bytes) receives the label of the lent copy.
+// *seqOut receives the journal sequence of the change; the caller passes
+// it to commitChange once it has released the library lock, so a writer
+// queued on that lock does not wait behind the fdatasync.
+int processLoan(Student** sHead, LoanTransaction** lHead, const char* sId, const char* isbn, const char* date,
+                char* labelOut, unsigned long* seqOut) {
+    Student* student = findStudent(*sHead, sId);
+    if (!student) {
+        printf("Error: Student not found!\n");
+        return LOAN_ERR_STUDENT;
+    }
+    Book* book = catalogFind(isbn);
+    CatalogShard* shard = catalogShardOf(isbn, strlen(isbn));
+    pthread_mutex_t* sLock = studentLockOf(student->studentId);
+
+    unsigned long seq = 0;
+    char record[JOURNAL_RECORD_LEN];
+    int len;
+    pthread_mutex_lock(&shard->lock);
+    pthread_mutex_lock(sLock);
+    int rc = LOAN_OK;
+    if (student->score <= 0) {
+        rc = LOAN_ERR_SCORE;
+    } else {
+        BookCopy* copy = book ? book->copies : NULL;
+        while (copy && strcmp(copy->borrowerStudentId, "SHELF") != 0) copy = copy->next;
+        if (!copy) {
+            rc = LOAN_ERR_NO_COPY;
+        } else if ((len = storageFormat(record, "B,%s,%s,%s\n", sId, copy->labelNo, date)) < 0) {
+            rc = LOAN_ERR_RECORD;
+        } else {
+            snprintf(copy->borrowerStudentId, STUDENT_ID_LEN, "%s", sId);
+            statsRecordLoan(book, student);
+            if (book->holds) holdRemove(book, sId);
+            if (labelOut) snprintf(labelOut, LABEL_LEN, "%s", copy->labelNo);
+            pthread_mutex_lock(&loanLock);
+            LoanTransaction* borrow = addLoanTransaction(lHead, sId, copy->labelNo, OP_TYPE_BORROW, date);
+            seq = storageApply(record, len);
+            pthread_mutex_unlock(&loanLock);
+            openLoan(student, copy, borrow);
+        }
+    }
+    pthread_mutex_unlock(sLock);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (rc == LOAN_ERR_SCORE) printf("Error: Student score insufficient!\n");
+    if (rc == LOAN_ERR_NO_COPY) printf("Error: No copies available on shelf!\n");
+    if (rc == LOAN_ERR_RECORD) printf("Error: The change is too long to journal.\n");
+    *seqOut = seq;
+    return rc;
+}
+
+// Days since 1970-01-01 for "DD.MM.YYYY" (or "DD-MM-YYYY"), -1 if malformed.
+// Pure arithmetic, so it is safe to call from any thread.
+int dateToDayNumber(const char* date) {
+    int d, m, y;
+    if (sscanf(date, "%d%*[.-]%d%*[.-]%d", &d, &m, &y) != 3) return -1;
+    if (m < 1 || m > 12 || d < 1 || d > 31) return -1;
+    return daysFromCivil(y, m, d);
+}
+
+int daysFromCivil(int y, int m, int d) {
+    y -= (m <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int getDaysDifference(const char* start, const char* end) {
+    int d1 = dateToDayNumber(start);
+    int d2 = dateToDayNumber(end);
+    if (d1 < 0 || d2 < 0) return 0;
+    return d2 - d1;
+}
+
+char* findBorrowDate(LoanTransaction* head, const char* sId, const char* label) {
+    while (head) {
+        if (strcmp(head->studentId, sId) == 0 &&
+            strcmp(head->bookLabelNo, label) == 0 &&
+            head->operationType == OP_TYPE_BORROW) {
+            return head->date;
+        }
+        head = head->next;
+    }
+    return NULL;
+}
+
+// Commits like processLoan: the caller passes *seqOut to commitChange
+int processReturn(Student** sHead, LoanTransaction** lHead, const char* sId, const char* label, const char* date,
+                  unsigned long* seqOut) {
+    Student* student = findStudent(*sHead, sId);
+    if (!student) {
+        printf("Student not found.\n"); return LOAN_ERR_STUDENT;
+    }
+    size_t isbnLen = isbnLengthOfLabel(label);
+    Book* book = catalogFindN(label, isbnLen);
+    CatalogShard* shard = catalogShardOf(label, isbnLen);
+    pthread_mutex_t* sLock = studentLockOf(student->studentId);
+
+    unsigned long seq = 0;
+    char holder[STUDENT_ID_LEN] = "";
+    char record[JOURNAL_RECORD_LEN];
+    int len;
+    pthread_mutex_lock(&shard->lock);
+    pthread_mutex_lock(sLock);
+    int rc = LOAN_OK;
+    BookCopy* copy = book ? book->copies : NULL;
+    while (copy && strcmp(copy->labelNo, label) != 0) copy = copy->next;
+    if (!copy || strcmp(copy->borrowerStudentId, sId) != 0) {
+        rc = LOAN_ERR_NOT_BORROWED;
+    } else {
+        char* borrowDate = copy->loan ? copy->loan->date : NULL;
+        if (!borrowDate) {
+            // The history only grows at the head, so a snapshot of it is stable
+            pthread_mutex_lock(&loanLock);
+            LoanTransaction* history = *lHead;
+            pthread_mutex_unlock(&loanLock);
+            borrowDate = findBorrowDate(history, sId, label);
+        }
+        int diff = borrowDate ? getDaysDifference(borrowDate, date) : 0;
+        int penalty = (diff > 15) ? 10 : 0;
+        if (!borrowDate) {
+            rc = LOAN_ERR_NO_RECORD;
+        } else if ((len = storageFormat(record, "R,%s,%s,%s,%d\n", sId, label, date, penalty)) < 0) {
+            rc = LOAN_ERR_RECORD;
+        } else {
+            student->score -= penalty;
+            strcpy(copy->borrowerStudentId, "SHELF");
+            closeLoan(student, copy);
+            statsRecordReturn(book, student, diff, penalty);
+            pthread_mutex_lock(&loanLock);
+            addLoanTransaction(lHead, sId, label, OP_TYPE_RETURN, date);
+            seq = storageApply(record, len);
+            pthread_mutex_unlock(&loanLock);
+        }
+    }
+    pthread_mutex_unlock(sLock);
+    // Holders are locked one at a time after the returner's stripe is released
+    if (rc == LOAN_OK && book->holds) {
+        seq = journalLaterSeq(seq, dispatchHold(*sHead, book, copy, lHead, date, holder));
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (rc == LOAN_ERR_NOT_BORROWED) {
+        printf("Error: This book is not borrowed by this student.\n"); return rc;
+    }
+    if (rc == LOAN_ERR_NO_RECORD) {
+        printf("Error: Loan record not found.\n"); return rc;
+    }
+    if (rc == LOAN_ERR_RECORD) {
+        printf("Error: The change is too long to journal.\n"); return rc;
+    }
+    *seqOut = seq;
+    if (holder[0]) printf("Copy %s lent to waiting student %s.\n", label, holder);
+    return LOAN_OK;
+}
+
+const char* loanStatusMessage(int code) {
+    switch (code) {
+        case LOAN_OK: return "ok";
+        case LOAN_ERR_STUDENT: return "student not found";
+        case LOAN_ERR_SCORE: return "student score insufficient";
+        case LOAN_ERR_NO_COPY: return "no copies available on shelf";
+        case LOAN_ERR_NOT_BORROWED: return "book is not borrowed by this student";
+        case LOAN_ERR_NO_RECORD: return "loan record not found";
+        case LOAN_ERR_NO_BOOK: return "book not found";
+        case LOAN_ERR_ON_SHELF: return "a copy is on the shelf";
+        case LOAN_ERR_ALREADY_HELD: return "student already has or is waiting for this book";
+        case LOAN_ERR_RECORD: return "change too long to journal";
+    }
+    return "unknown error";
+}
+
+LoanTransaction* loadLoansFromFile() {
+    CsvReader csv;
+    if (!csvOpen(&csv, FILE_LOANS)) return NULL;
+    LoanTransaction* head = NULL;
+    LoanTransaction* tail = NULL;
+    while (csvNextRecord(&csv)) {
+        int op;
+        if (csv.fieldCount < 4 || !csvInt(csv.fields[2], &op)) continue;
+        LoanTransaction* newNode = (LoanTransaction*)malloc(sizeof(LoanTransaction));
+        if (!newNode) break;
+        csvCopy(csv.fields[0], newNode->studentId, STUDENT_ID_LEN);
+        csvCopy(csv.fields[1], newNode->bookLabelNo, sizeof(newNode->bookLabelNo));
+        newNode->operationType = op;
+        csvCopy(csv.fields[3], newNode->date, DATE_STR_LEN);
+        newNode->next = NULL;
+        if (!head) head = tail = newNode;
+        else { tail->next = newNode; tail = newNode; }
+    }
+    csvClose(&csv);
+    return head;
+}
+
+// --- HOLD QUEUES ---
+// Students can queue for a book that has no copy on the shelf. A
+// returned copy goes straight to the head of the queue instead of the
+// shelf. Queues are guarded by the book's shard lock. In the journal,
+// "h" adds a hold, "H" drops one, and a B record consumes the
+// borrower's hold.
+
+int holdEnqueue(Book* book, const char* sId, const char* date) {
+    Hold* hold = (Hold*)malloc(sizeof(Hold));
+    if (!hold) return 0;
+    if (!book->holds) {
+        book->holds = (HoldQueue*)calloc(1, sizeof(HoldQueue));
+        if (!book->holds) {
+            free(hold);
+            return 0;
+        }
+    }
+    strncpy(hold->studentId, sId, STUDENT_ID_LEN);
+    hold->studentId[STUDENT_ID_LEN - 1] = '\0';
+    strncpy(hold->date, date, DATE_STR_LEN);
+    hold->date[DATE_STR_LEN - 1] = '\0';
+    hold->next = NULL;
+    if (book->holds->tail) book->holds->tail->next = hold;
+    else book->holds->head = hold;
+    book->holds->tail = hold;
+    book->holds->count++;
+    return 1;
+}
+
+int holdPosition(Book* book, const char* sId) {
+    int pos = 1;
+    for (Hold* h = book->holds ? book->holds->head : NULL; h; h = h->next, pos++) {
+        if (strcmp(h->studentId, sId) == 0) return pos;
+    }
+    return 0;
+}
+
+// Removes the student's hold on the book, if any
+int holdRemove(Book* book, const char* sId) {
+    HoldQueue* q = book->holds;
+    if (!q) return 0;
+    Hold** link = &q->head;
+    Hold* prev = NULL;
+    while (*link && strcmp((*link)->studentId, sId) != 0) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    Hold* h = *link;
+    if (!h) return 0;
+    *link = h->next;
+    if (q->tail == h) q->tail = prev;
+    free(h);
+    if (--q->count == 0) {
+        free(q);
+        book->holds = NULL;
+    }
+    return 1;
+}
+
+void freeHolds(Book* book) {
+    if (!book->holds) return;
+    Hold* h = book->holds->head;
+    while (h) {
+        Hold* next = h->next;
+        free(h);
+        h = next;
+    }
+    free(book->holds);
+    book->holds = NULL;
+}
+
+// Commits like processLoan: the caller passes *seqOut to commitChange
+int placeHold(Student** sHead, const char* sId, const char* isbn, const char* date, unsigned long* seqOut) {
+    Student* student = findStudent(*sHead, sId);
+    if (!student) return LOAN_ERR_STUDENT;
+    Book* book = catalogFind(isbn);
+    if (!book) return LOAN_ERR_NO_BOOK;
+    CatalogShard* shard = catalogShardOf(isbn, strlen(isbn));
+    pthread_mutex_t* sLock = studentLockOf(student->studentId);
+
+    unsigned long seq = 0;
+    char record[JOURNAL_RECORD_LEN];
+    int len;
+    pthread_mutex_lock(&shard->lock);
+    pthread_mutex_lock(sLock);
+    int rc = LOAN_OK;
+    int onShelf = 0, mine = 0;
+    for (BookCopy* copy = book->copies; copy; copy = copy->next) {
+        if (strcmp(copy->borrowerStudentId, "SHELF") == 0) onShelf = 1;
+        else if (strcmp(copy->borrowerStudentId, sId) == 0) mine = 1;
+    }
+    if (student->score <= 0) rc = LOAN_ERR_SCORE;
+    else if (onShelf) rc = LOAN_ERR_ON_SHELF;
+    else if (mine || holdPosition(book, sId)) rc = LOAN_ERR_ALREADY_HELD;
+    else if ((len = storageFormat(record, "h,%s,%s,%s\n", sId, isbn, date)) < 0) rc = LOAN_ERR_RECORD;
+    else if (!holdEnqueue(book, sId, date)) rc = LOAN_ERR_NO_BOOK;
+    else seq = storageApply(record, len);
+    pthread_mutex_unlock(sLock);
+    pthread_mutex_unlock(&shard->lock);
+
+    *seqOut = seq;
+    return rc;
+}
+
+// Lends a just returned copy to the first eligible student in the queue.
+// Holders who no longer exist or have no score left are dropped. Caller
+// holds the book's shard lock but no student stripe. Returns the
+// journal sequence to wait for (0 if none) and the holder in holderOut.
+unsigned long dispatchHold(Student* sHead, Book* book, BookCopy* copy, LoanTransaction** lHead,
+                           const char* date, char* holderOut) {
+    unsigned long seq = 0;
+    char record[JOURNAL_RECORD_LEN];
+    while (book->holds) {
+        Hold* h = book->holds->head;
+        Student* holder = findStudent(sHead, h->studentId);
+        pthread_mutex_t* hLock = holder ? studentLockOf(holder->studentId) : NULL;
+        if (hLock) pthread_mutex_lock(hLock);
+        int eligible = holder && holder->score > 0;
+        int len = eligible ? storageFormat(record, "B,%s,%s,%s\n", h->studentId, copy->labelNo, date)
+                           : storageFormat(record, "H,%s,%s\n", h->studentId, book->isbn);
+        if (len < 0) {
+            // Leave the copy on the shelf and the queue as it is
+            if (hLock) pthread_mutex_unlock(hLock);
+            break;
+        }
+        if (eligible) {
+            strncpy(copy->borrowerStudentId, h->studentId, STUDENT_ID_LEN);
+            statsRecordLoan(book, holder);
+            if (holderOut) snprintf(holderOut, STUDENT_ID_LEN, "%s", h->studentId);
+            pthread_mutex_lock(&loanLock);
+            LoanTransaction* borrow = addLoanTransaction(lHead, h->studentId, copy->labelNo, OP_TYPE_BORROW, date);
+            seq = journalLaterSeq(seq, storageApply(record, len));
+            pthread_mutex_unlock(&loanLock);
+            openLoan(holder, copy, borrow);
+        } else {
+            seq = journalLaterSeq(seq, storageApply(record, len));
+        }
+        if (hLock) pthread_mutex_unlock(hLock);
+        holdRemove(book, h->studentId);
+        if (eligible) break;
+    }
+    return seq;
+}
+
+int saveHoldsToFile(Book* head, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    csvPutStr(&w, "ISBN,StudentID,Date\n");
+    for (; head; head = head->next) {
+        for (Hold* h = head->holds ? head->holds->head : NULL; h; h = h->next) {
+            csvPutStr(&w, head->isbn);
+            csvPutChar(&w, ',');
+            csvPutStr(&w, h->studentId);
+            csvPutChar(&w, ',');
+            csvPutStr(&w, h->date);
+            csvPutChar(&w, '\n');
+        }
+    }
+    return csvWriterClose(&w);
+}
+
+void loadHoldsFromFile(const char* filename) {
+    CsvReader csv;
+    if (!csvOpen(&csv, filename)) return;
+    csvNextRecord(&csv);
+    while (csvNextRecord(&csv)) {
+        if (csv.fieldCount < 3 || csv.fields[1].len == 0) continue;
+        Book* book = catalogFindN(csv.fields[0].ptr, csv.fields[0].len);
+        if (!book) continue;
+        char sId[STUDENT_ID_LEN], date[DATE_STR_LEN];
+        csvCopy(csv.fields[1], sId, sizeof(sId));
+        csvCopy(csv.fields[2], date, sizeof(date));
+        holdEnqueue(book, sId, date);
+    }
+    csvClose(&csv);
+}
+
+typedef struct QueueLength {
+    Book* book;
+    int count;
+} QueueLength;
+
+static int compareQueueLength(const void* a, const void* b) {
+    const QueueLength* x = (const QueueLength*)a;
+    const QueueLength* y = (const QueueLength*)b;
+    if (x->count != y->count) return y->count - x->count;
+    return strcmp(x->book->isbn, y->book->isbn);
+}
+
+// Books with waiting students, longest queue first. Caller holds the
+// library lock (either side) and frees *out.
+int collectQueueLengths(Book* head, QueueLength** out) {
+    int count = 0, cap = 0;
+    QueueLength* rows = NULL;
+    for (Book* b = head; b; b = b->next) {
+        CatalogShard* shard = catalogShardOf(b->isbn, ISBN_LEN);
+        pthread_mutex_lock(&shard->lock);
+        int waiting = b->holds ? b->holds->count : 0;
+        pthread_mutex_unlock(&shard->lock);
+        if (!waiting) continue;
+        if (count == cap) {
+            int newCap = cap ? cap * 2 : 16;
+            QueueLength* grown = (QueueLength*)realloc(rows, sizeof(QueueLength) * newCap);
+            if (!grown) break;
+            rows = grown;
+            cap = newCap;
+        }
+        rows[count].book = b;
+        rows[count].count = waiting;
+        count++;
+    }
+    if (count > 1) qsort(rows, count, sizeof(QueueLength), compareQueueLength);
+    *out = rows;
+    return count;
+}
+
+// --- CIRCULATION STATISTICS ---
+// Counters are updated by every borrow and return, so reports never scan
+// the history. Per-book and per-student counts live in the records
+// (checkedOut under the shard lock, activeLoans under the student stripe,
+// borrowCount under statsLock); statsLock is always taken last.
+
+static const int durationLimits[STATS_DURATION_BUCKETS - 1] = { 7, 14, 30, 60 };
+static const char* durationLabels[STATS_DURATION_BUCKETS] = { "0-7", "8-14", "15-30", "31-60", "61+" };
+
+static int durationBucket(int days) {
+    int i = 0;
+    while (i < STATS_DURATION_BUCKETS - 1 && days > durationLimits[i]) i++;
+    return i;
+}
+
+// Moves book to its place among the most borrowed. Borrow counts only
+// grow by one, so a book outside the list can pass at most the last
+// entry. Caller holds statsLock.
+static void statsPromote(Book* book) {
+    int i = 0;
+    while (i < circulation.topCount && circulation.top[i] != book) i++;
+    if (i == circulation.topCount) {
+        if (circulation.topCount < STATS_TOP_K) circulation.topCount++;
+        else if (circulation.top[STATS_TOP_K - 1]->borrowCount >= book->borrowCount) return;
+        i = circulation.topCount - 1;
+        circulation.top[i] = book;
+    }
+    while (i > 0 && circulation.top[i - 1]->borrowCount < book->borrowCount) {
+        circulation.top[i] = circulation.top[i - 1];
+        circulation.top[i - 1] = book;
+        i--;
+    }
+}
+
+// Caller holds the book's shard lock and the student's stripe
+void statsRecordLoan(Book* book, Student* student) {
+    book->checkedOut++;
+    if (student) student->activeLoans++;
+    pthread_mutex_lock(&statsLock);
+    book->borrowCount++;
+    circulation.loans++;
+    statsPromote(book);
+    pthread_mutex_unlock(&statsLock);
+}
+
+// days < 0 when the borrow date is unknown
+void statsRecordReturn(Book* book, Student* student, int days, int penalty) {
+    if (book->checkedOut > 0) book->checkedOut--;
+    if (student && student->activeLoans > 0) student->activeLoans--;
+    pthread_mutex_lock(&statsLock);
+    circulation.returns++;
+    if (days >= 0) {
+        circulation.loanDays += days;
+        circulation.durations[durationBucket(days)]++;
+    }
+    if (penalty > 0) {
+        circulation.penalties++;
+        circulation.penaltyPoints += penalty;
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+// Recomputes the top list, e.g. after a listed book was deleted.
+// Caller holds the library lock exclusively.
+void statsRebuildTop(Book* head) {
+    pthread_mutex_lock(&statsLock);
+    circulation.topCount = 0;
+    for (Book* b = head; b; b = b->next) {
+        if (b->borrowCount > 0) statsPromote(b);
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+// Drops a book that is being deleted from the top list.
+// Caller holds the library lock exclusively.
+void statsForgetBook(Book* head, Book* book) {
+    int listed = 0;
+    pthread_mutex_lock(&statsLock);
+    for (int i = 0; i < circulation.topCount; i++) {
+        if (circulation.top[i] == book) listed = 1;
+    }
+    pthread_mutex_unlock(&statsLock);
+    if (listed) statsRebuildTop(head);
+}
+
+// Copy of the counters; the top list is only valid while the caller
+// keeps books from being deleted
+void statsRead(CirculationStats* out) {
+    pthread_mutex_lock(&statsLock);
+    *out = circulation;
+    pthread_mutex_unlock(&statsLock);
+}
+
+void statsReset() {
+    pthread_mutex_lock(&statsLock);
+    memset(&circulation, 0, sizeof(circulation));
+    pthread_mutex_unlock(&statsLock);
+}
+
+int saveStatsToFile(const CirculationStats* stats, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    const char* names[] = { "loans", "returns", "penalties", "penaltyPoints", "loanDays" };
+    long values[] = { stats->loans, stats->returns, stats->penalties, stats->penaltyPoints, stats->loanDays };
+    csvPutStr(&w, "Counter,Value\n");
+    for (int i = 0; i < 5; i++) {
+        csvPutStr(&w, names[i]);
+        csvPutChar(&w, ',');
+        csvPutLong(&w, values[i]);
+        csvPutChar(&w, '\n');
+    }
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) {
+        csvPutStr(&w, "days ");
+        csvPutStr(&w, durationLabels[i]);
+        csvPutChar(&w, ',');
+        csvPutLong(&w, stats->durations[i]);
+        csvPutChar(&w, '\n');
+    }
+    return csvWriterClose(&w);
+}
+
+static int dictId(StringDict* d, const char* s, size_t len, int create);
+static void dictFree(StringDict* d);
+
+// Derives the counters from the resident history, for libraries saved
+// before statistics existed. Penalties follow the rule in processReturn.
+// One pass from the oldest record: each return is matched with the last
+// borrow of the same student and label, found through a hash of the
+// pair instead of a search down the rest of the history.
+static void statsRebuildFromHistory(Library* lib) {
+    for (Book* b = lib->books; b; b = b->next) b->borrowCount = 0;
+    int n = 0;
+    for (LoanTransaction* t = lib->loans; t; t = t->next) n++;
+    LoanTransaction** order = (LoanTransaction**)malloc(sizeof(LoanTransaction*) * (n ? n : 1));
+    if (!order) return;
+    int i = n;
+    for (LoanTransaction* t = lib->loans; t; t = t->next) order[--i] = t; // The list is newest first
+
+    StringDict pairs;
+    memset(&pairs, 0, sizeof(pairs));
+    LoanTransaction** lastBorrow = NULL;
+    int lastCap = 0;
+    for (i = 0; i < n; i++) {
+        LoanTransaction* t = order[i];
+        char key[STUDENT_ID_LEN + LABEL_LEN + 1];
+        int len = snprintf(key, sizeof(key), "%s,%s", t->studentId, t->bookLabelNo);
+        if (t->operationType == OP_TYPE_BORROW) {
+            Book* book = catalogFindN(t->bookLabelNo, isbnLengthOfLabel(t->bookLabelNo));
+            if (book) book->borrowCount++;
+            circulation.loans++;
+            int id = dictId(&pairs, key, (size_t)len, 1);
+            if (id < 0) continue;
+            if (id >= lastCap) {
+                int newCap = lastCap ? lastCap * 2 : 256;
+                while (newCap <= id) newCap *= 2;
+                LoanTransaction** grown = (LoanTransaction**)realloc(lastBorrow, sizeof(LoanTransaction*) * newCap);
+                if (!grown) continue;
+                memset(grown + lastCap, 0, sizeof(LoanTransaction*) * (newCap - lastCap));
+                lastBorrow = grown;
+                lastCap = newCap;
+            }
+            lastBorrow[id] = t;
+            continue;
+        }
+        circulation.returns++;
+        int id = dictId(&pairs, key, (size_t)len, 0);
+        if (id < 0 || id >= lastCap || !lastBorrow[id]) continue;
+        int days = getDaysDifference(lastBorrow[id]->date, t->date);
+        if (days >= 0) {
+            circulation.loanDays += days;
+            circulation.durations[durationBucket(days)]++;
+        }
+        if (days > 15) {
+            circulation.penalties++;
+            circulation.penaltyPoints += 10;
+        }
+    }
+    dictFree(&pairs);
+    free(lastBorrow);
+    free(order);
+}
+
+// Restores saved global counters (rebuilt from the history when there
+// are none) and derives the current loan counts from the copies. Runs
+// before the journal is replayed.
+void statsRestore(Library* lib, const CirculationStats* saved) {
+    statsReset();
+    for (Book* b = lib->books; b; b = b->next) {
+        for (BookCopy* c = b->copies; c; c = c->next) {
+            if (strcmp(c->borrowerStudentId, "SHELF") == 0) continue;
+            b->checkedOut++;
+            Student* student = findStudent(lib->students, c->borrowerStudentId);
+            if (student) student->activeLoans++;
+        }
+    }
+    if (saved) {
+        circulation.loans = saved->loans;
+        circulation.returns = saved->returns;
+        circulation.penalties = saved->penalties;
+        circulation.penaltyPoints = saved->penaltyPoints;
+        circulation.loanDays = saved->loanDays;
+        memcpy(circulation.durations, saved->durations, sizeof(circulation.durations));
+    } else {
+        statsRebuildFromHistory(lib);
+    }
+    statsRebuildTop(lib->books);
+}
+
+void loadStatistics(Library* lib) {
+    CsvReader csv;
+    if (!csvOpen(&csv, FILE_STATS)) {
+        statsRestore(lib, NULL);
+    } else {
+        CirculationStats saved;
+        memset(&saved, 0, sizeof(saved));
+        csvNextRecord(&csv);
+        while (csvNextRecord(&csv)) {
+            int value;
+            if (csv.fieldCount < 2 || !csvInt(csv.fields[1], &value)) continue;
+            CsvField key = csv.fields[0];
+            long* counter = NULL;
+            if (key.len == 5 && memcmp(key.ptr, "loans", 5) == 0) counter = &saved.loans;
+            else if (key.len == 7 && memcmp(key.ptr, "returns", 7) == 0) counter = &saved.returns;
+            else if (key.len == 9 && memcmp(key.ptr, "penalties", 9) == 0) counter = &saved.penalties;
+            else if (key.len == 13 && memcmp(key.ptr, "penaltyPoints", 13) == 0) counter = &saved.penaltyPoints;
+            else if (key.len == 8 && memcmp(key.ptr, "loanDays", 8) == 0) counter = &saved.loanDays;
+            for (int i = 0; !counter && i < STATS_DURATION_BUCKETS; i++) {
+                size_t len = strlen(durationLabels[i]);
+                if (key.len == len + 5 && memcmp(key.ptr, "days ", 5) == 0 && memcmp(key.ptr + 5, durationLabels[i], len) == 0) {
+                    counter = &saved.durations[i];
+                }
+            }
+            if (counter) *counter = value;
+        }
+        csvClose(&csv);
+        statsRestore(lib, &saved);
+    }
+}
+
+// --- COLUMNAR LOAN HISTORY ---
+// Read-only encoding of a run of loan records (see LoanColumns), used by
+// the archive segments on disk and by analytical scans in memory.
+
+static int dictGrow(StringDict* d) {
+    int newCount = d->slotCount ? d->slotCount * 2 : 256;
+    while ((d->count + 1) * 10 > newCount * 7) newCount *= 2;
+    int* slots = (int*)calloc(newCount, sizeof(int));
+    if (!slots) return 0;
+    for (int id = 0; id < d->count; id++) {
+        const char* name = d->text + d->offsets[id];
+        unsigned int i = hashString(name, strlen(name)) % (unsigned int)newCount;
+        while (slots[i]) i = (i + 1) % (unsigned int)newCount;
+        slots[i] = id + 1;
+    }
+    free(d->slots);
+    d->slots = slots;
+    d->slotCount = newCount;
+    return 1;
+}
+
+// Id of s[0..len), or -1. With create, unknown strings are added.
+static int dictId(StringDict* d, const char* s, size_t len, int create) {
+    if (create && (d->count + 1) * 10 > d->slotCount * 7) dictGrow(d);
+    if (!d->slotCount) return -1;
+    unsigned int i = hashString(s, len) % (unsigned int)d->slotCount;
+    while (d->slots[i]) {
+        const char* name = d->text + d->offsets[d->slots[i] - 1];
+        if (strncmp(name, s, len) == 0 && name[len] == '\0') return d->slots[i] - 1;
+        i = (i + 1) % (unsigned int)d->slotCount;
+    }
+    if (!create || (d->count + 1) * 10 > d->slotCount * 7) return -1;
+    if (d->count == d->cap) {
+        int newCap = d->cap ? d->cap * 2 : 64;
+        int* offsets = (int*)realloc(d->offsets, sizeof(int) * newCap);
+        if (!offsets) return -1;
+        d->offsets = offsets;
+        d->cap = newCap;
+    }
+    if (d->textLen + len + 1 > d->textCap) {
+        size_t newCap = d->textCap ? d->textCap * 2 : 1024;
+        while (newCap < d->textLen + len + 1) newCap *= 2;
+        char* text = (char*)realloc(d->text, newCap);
+        if (!text) return -1;
+        d->text = text;
+        d->textCap = newCap;
+    }
+    memcpy(d->text + d->textLen, s, len);
+    d->text[d->textLen + len] = '\0';
+    d->offsets[d->count] = (int)d->textLen;
+    d->textLen += len + 1;
+    d->slots[i] = d->count + 1;
+    return d->count++;
+}
+
+static const char* dictName(const StringDict* d, int id) {
+    return d->text + d->offsets[id];
+}
+
+static void dictFree(StringDict* d) {
+    free(d->text);
+    free(d->offsets);
+    free(d->slots);
+    memset(d, 0, sizeof(*d));
+}
+
+// Splits "ISBN_n" into the ISBN length and n + 1 (0 without a suffix)
+static unsigned int splitLabel(const char* label, size_t* isbnLen) {
+    const char* sep = strrchr(label, '_');
+    char* end = NULL;
+    long n = sep && sep[1] != '0' ? strtol(sep + 1, &end, 10) : 0;
+    if (!sep || !end || *end || n <= 0) {
+        *isbnLen = strlen(label);
+        return 0;
+    }
+    *isbnLen = (size_t)(sep - label);
+    return (unsigned int)n + 1;
+}
+
+static int bitsFor(uint64_t maxValue) {
+    int bits = 0;
+    while (bits < 64 && (maxValue >> bits)) bits++;
+    return bits;
+}
+
+static size_t packedWords(int count, int bits) {
+    return ((size_t)count * bits + 63) / 64 + 1;
+}
+
+static void bitPut(uint64_t* words, size_t index, int bits, uint64_t value) {
+    if (!bits) return;
+    size_t bit = index * bits;
+    int off = (int)(bit & 63);
+    words[bit >> 6] |= value << off;
+    if (off + bits > 64) words[(bit >> 6) + 1] |= value >> (64 - off);
+}
+
+static inline uint64_t bitGet(const uint64_t* words, size_t index, int bits) {
+    if (!bits) return 0;
+    size_t bit = index * bits;
+    int off = (int)(bit & 63);
+    uint64_t v = words[bit >> 6] >> off;
+    if (off + bits > 64) v |= words[(bit >> 6) + 1] << (64 - off);
+    return bits == 64 ? v : v & ((1ULL << bits) - 1);
+}
+
+static inline int readDayDelta(const unsigned char* p, size_t* pos) {
+    uint32_t z = 0;
+    int shift = 0;
+    unsigned char b;
+    do {
+        b = p[(*pos)++];
+        z |= (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return (int)(z >> 1) ^ -(int)(z & 1);
+}
+
+void columnsFree(LoanColumns* cols) {
+    dictFree(&cols->students);
+    dictFree(&cols->isbns);
+    free(cols->studentCol);
+    free(cols->isbnCol);
+    free(cols->copyCol);
+    free(cols->opCol);
+    free(cols->days);
+    memset(cols, 0, sizeof(*cols));
+}
+
+// Encodes rows (in the order given). Records with malformed dates keep
+// day -1.
+int columnsBuild(LoanColumns* cols, const LoanTransaction* rows, int n) {
+    memset(cols, 0, sizeof(*cols));
+    int* sIds = (int*)malloc(sizeof(int) * (n ? n : 1));
+    int* iIds = (int*)malloc(sizeof(int) * (n ? n : 1));
+    unsigned int* copies = (unsigned int*)malloc(sizeof(unsigned int) * (n ? n : 1));
+    cols->days = (unsigned char*)malloc((size_t)n * 5 + 1);
+    int ok = sIds && iIds && copies && cols->days;
+
+    unsigned int maxCopy = 0;
+    int prevDay = 0;
+    for (int i = 0; ok && i < n; i++) {
+        size_t isbnLen;
+        copies[i] = splitLabel(rows[i].bookLabelNo, &isbnLen);
+        if (copies[i] > maxCopy) maxCopy = copies[i];
+        sIds[i] = dictId(&cols->students, rows[i].studentId, strlen(rows[i].studentId), 1);
+        iIds[i] = dictId(&cols->isbns, rows[i].bookLabelNo, isbnLen, 1);
+        if (sIds[i] < 0 || iIds[i] < 0) ok = 0;
+
+        int day = dateToDayNumber(rows[i].date);
+        int delta = day - prevDay;
+        uint32_t z = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        prevDay = day;
+        do {
+            unsigned char b = z & 0x7f;
+            z >>= 7;
+            cols->days[cols->daysLen++] = b | (z ? 0x80 : 0);
+        } while (z);
+    }
+
+    if (ok) {
+        cols->count = n;
+        cols->studentBits = (unsigned char)bitsFor(cols->students.count ? cols->students.count - 1 : 0);
+        cols->isbnBits = (unsigned char)bitsFor(cols->isbns.count ? cols->isbns.count - 1 : 0);
+        cols->copyBits = (unsigned char)bitsFor(maxCopy);
+        cols->studentCol = (uint64_t*)calloc(packedWords(n, cols->studentBits), sizeof(uint64_t));
+        cols->isbnCol = (uint64_t*)calloc(packedWords(n, cols->isbnBits), sizeof(uint64_t));
+        cols->copyCol = (uint64_t*)calloc(packedWords(n, cols->copyBits), sizeof(uint64_t));
+        cols->opCol = (uint64_t*)calloc(packedWords(n, 1), sizeof(uint64_t));
+        ok = cols->studentCol && cols->isbnCol && cols->copyCol && cols->opCol;
+    }
+    for (int i = 0; ok && i < n; i++) {
+        bitPut(cols->studentCol, i, cols->studentBits, (uint64_t)sIds[i]);
+        bitPut(cols->isbnCol, i, cols->isbnBits, (uint64_t)iIds[i]);
+        bitPut(cols->copyCol, i, cols->copyBits, copies[i]);
+        if (rows[i].operationType == OP_TYPE_RETURN) cols->opCol[i >> 6] |= 1ULL << (i & 63);
+    }
+    free(sIds);
+    free(iIds);
+    free(copies);
+    if (!ok) columnsFree(cols);
+    return ok;
+}
+
+// Record i as a LoanTransaction; day is its decoded day number
+void columnsRow(const LoanColumns* cols, int i, int day, LoanTransaction* out) {
+    snprintf(out->studentId, sizeof(out->studentId), "%s",
+             dictName(&cols->students, (int)bitGet(cols->studentCol, i, cols->studentBits)));
+    const char* isbn = dictName(&cols->isbns, (int)bitGet(cols->isbnCol, i, cols->isbnBits));
+    unsigned int copy = (unsigned int)bitGet(cols->copyCol, i, cols->copyBits);
+    if (copy) snprintf(out->bookLabelNo, sizeof(out->bookLabelNo), "%s_%u", isbn, copy - 1);
+    else snprintf(out->bookLabelNo, sizeof(out->bookLabelNo), "%s", isbn);
+    out->operationType = (int)((cols->opCol[i >> 6] >> (i & 63)) & 1);
+    formatDayNumber(day, out->date, sizeof(out->date));
+    out->next = NULL;
+}
+
+// Decodes every record, in order. Caller frees *out.
+int columnsDecode(const LoanColumns* cols, LoanTransaction** out) {
+    *out = (LoanTransaction*)malloc(sizeof(LoanTransaction) * (cols->count ? cols->count : 1));
+    if (!*out) return 0;
+    size_t pos = 0;
+    int day = 0;
+    for (int i = 0; i < cols->count; i++) {
+        day += readDayDelta(cols->days, &pos);
+        columnsRow(cols, i, day, &(*out)[i]);
+    }
+    return cols->count;
+}
+
+// Bytes held by the encoded records, excluding the struct itself
+size_t columnsMemory(const LoanColumns* cols) {
+    size_t bytes = cols->students.textLen + cols->isbns.textLen
+                 + sizeof(int) * (size_t)(cols->students.count + cols->isbns.count) + cols->daysLen;
+    bytes += sizeof(uint64_t) * (packedWords(cols->count, cols->studentBits) + packedWords(cols->count, cols->isbnBits)
+                                 + packedWords(cols->count, cols->copyBits) + packedWords(cols->count, 1));
+    return bytes;
+}
+
+static void columnsPutPadded(CsvWriter* w, const void* data, size_t len) {
+    static const char zeros[8] = { 0 };
+    csvPutBytes(w, (const char*)data, len);
+    if (len % 8) csvPutBytes(w, zeros, 8 - len % 8);
+}
+
+int columnsWrite(const LoanColumns* cols, const char* filename) {
+    CsvWriter w;
+    if (!csvWriterOpen(&w, filename, 0)) return 0;
+    ColumnFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, COLUMNS_MAGIC, 4);
+    h.version = COLUMNS_VERSION;
+    h.count = (uint32_t)cols->count;
+    h.studentCount = (uint32_t)cols->students.count;
+    h.isbnCount = (uint32_t)cols->isbns.count;
+    h.studentTextLen = (uint32_t)cols->students.textLen;
+    h.isbnTextLen = (uint32_t)cols->isbns.textLen;
+    h.bits[0] = cols->studentBits;
+    h.bits[1] = cols->isbnBits;
+    h.bits[2] = cols->copyBits;
+    h.daysLen = cols->daysLen;
+    h.archivedBefore = cols->archivedBefore;
+    csvPutBytes(&w, (const char*)&h, sizeof(h));
+    columnsPutPadded(&w, cols->students.text, cols->students.textLen);
+    columnsPutPadded(&w, cols->isbns.text, cols->isbns.textLen);
+    csvPutBytes(&w, (const char*)cols->studentCol, sizeof(uint64_t) * packedWords(cols->count, cols->studentBits));
+    csvPutBytes(&w, (const char*)cols->isbnCol, sizeof(uint64_t) * packedWords(cols->count, cols->isbnBits));
+    csvPutBytes(&w, (const char*)cols->copyCol, sizeof(uint64_t) * packedWords(cols->count, cols->copyBits));
+    csvPutBytes(&w, (const char*)cols->opCol, sizeof(uint64_t) * packedWords(cols->count, 1));
+    csvPutBytes(&w, (const char*)cols->days, cols->daysLen);
+    return csvWriterClose(&w);
+}
+
+// Copies the next len bytes of the file, or fails past its end
+static void* columnsTake(CsvReader* r, size_t len, size_t padTo) {
+    size_t step = padTo ? (len + padTo - 1) / padTo * padTo : len;
+    if (r->pos + step > r->size || r->pos + step < r->pos) return NULL;
+    void* out = malloc(len ? len : 1);
+    if (out) memcpy(out, r->data + r->pos, len);
+    r->pos += step;
+    return out;
+}
+
+static int dictLoad(StringDict* d, char* text, size_t textLen, int count) {
+    d->text = text;
+    d->textLen = d->textCap = textLen;
+    d->offsets = (int*)malloc(sizeof(int) * (count ? count : 1));
+    if (!d->offsets) return 0;
+    size_t pos = 0;
+    for (int id = 0; id < count; id++) {
+        if (pos >= textLen) return 0;
+        d->offsets[id] = (int)pos;
+        char* nul = (char*)memchr(text + pos, '\0', textLen - pos);
+        if (!nul) return 0;
+        pos = (size_t)(nul - text) + 1;
+    }
+    d->count = d->cap = count;
+    return dictGrow(d);
+}
+
+// Checks what the decoders index without bounds checks: every packed id
+// names a dictionary entry, and the days hold one complete varint per
+// record (at most five bytes each) within daysLen
+static int columnsValid(const LoanColumns* cols) {
+    for (int i = 0; i < cols->count; i++) {
+        if (bitGet(cols->studentCol, i, cols->studentBits) >= (uint64_t)cols->students.count) return 0;
+        if (bitGet(cols->isbnCol, i, cols->isbnBits) >= (uint64_t)cols->isbns.count) return 0;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < cols->count; i++) {
+        int bytes = 0;
+        do {
+            if (pos >= cols->daysLen || ++bytes > 5) return 0;
+        } while (cols->days[pos++] & 0x80);
+    }
+    return 1;
+}
+
+int columnsRead(LoanColumns* cols, const char* filename) {
+    memset(cols, 0, sizeof(*cols));
+    CsvReader r;
+    if (!csvOpen(&r, filename)) return 0;
+    ColumnFileHeader h;
+    memset(&h, 0, sizeof(h));
+    size_t headerLen = offsetof(ColumnFileHeader, archivedBefore);
+    int ok = r.size >= headerLen;
+    if (ok) {
+        memcpy(&h, r.data, headerLen);
+        if (h.version >= 2) headerLen = sizeof(h);
+        ok = r.size >= headerLen;
+    }
+    if (ok) {
+        memcpy(&h, r.data, headerLen);
+        r.pos = headerLen;
+        ok = memcmp(h.magic, COLUMNS_MAGIC, 4) == 0 && h.version >= 1 && h.version <= COLUMNS_VERSION
+             && h.count <= INT_MAX && h.bits[0] <= 32 && h.bits[1] <= 32 && h.bits[2] <= 32;
+    }
+    if (ok) {
+        cols->count = (int)h.count;
+        cols->archivedBefore = h.archivedBefore;
+        cols->studentBits = h.bits[0];
+        cols->isbnBits = h.bits[1];
+        cols->copyBits = h.bits[2];
+        char* sText = (char*)columnsTake(&r, h.studentTextLen, 8);
+        ok = sText && dictLoad(&cols->students, sText, h.studentTextLen, (int)h.studentCount);
+        if (!sText) ok = 0;
+    }
+    if (ok) {
+        char* iText = (char*)columnsTake(&r, h.isbnTextLen, 8);
+        ok = iText && dictLoad(&cols->isbns, iText, h.isbnTextLen, (int)h.isbnCount);
+    }
+    if (ok) {
+        cols->studentCol = (uint64_t*)columnsTake(&r, sizeof(uint64_t) * packedWords(cols->count, cols->studentBits), 0);
+        cols->isbnCol = (uint64_t*)columnsTake(&r, sizeof(uint64_t) * packedWords(cols->count, cols->isbnBits), 0);
+        cols->copyCol = (uint64_t*)columnsTake(&r, sizeof(uint64_t) * packedWords(cols->count, cols->copyBits), 0);
+        cols->opCol = (uint64_t*)columnsTake(&r, sizeof(uint64_t) * packedWords(cols->count, 1), 0);
+        cols->days = (unsigned char*)columnsTake(&r, (size_t)h.daysLen, 0);
+        cols->daysLen = (size_t)h.daysLen;
+        ok = cols->studentCol && cols->isbnCol && cols->copyCol && cols->opCol && cols->days;
+    }
+    csvClose(&r);
+    if (ok) ok = columnsValid(cols);
+    if (!ok) columnsFree(cols);
+    return ok;
+}
+
+// Adds the month volumes (borrows, returns) of the records dated within
+// [fromDay, toDay] to volumes, indexed from firstMonth, and each borrow
+// to perIsbn[isbn id]. The days are decoded in one pass; the month is
+// recomputed only when a record falls outside the current one.
+void columnsScan(const LoanColumns* cols, int fromDay, int toDay, int firstMonth, long* volumes, long* perIsbn) {
+    size_t pos = 0;
+    int day = 0;
+    int monthStart = 1, monthEnd = 0, monthIndex = 0;
+    for (int i = 0; i < cols->count; i++) {
+        day += readDayDelta(cols->days, &pos);
+        if (day < fromDay || day > toDay) continue;
+        if (day < monthStart || day >= monthEnd) {
+            int y, m, d;
+            dayNumberToCivil(day, &y, &m, &d);
+            monthStart = day - (d - 1);
+            monthEnd = m == 12 ? daysFromCivil(y + 1, 1, 1) : daysFromCivil(y, m + 1, 1);
+            monthIndex = y * 12 + m - 1 - firstMonth;
+        }
+        int isReturn = (int)((cols->opCol[i >> 6] >> (i & 63)) & 1);
+        volumes[monthIndex * 2 + isReturn]++;
+        if (!isReturn) perIsbn[bitGet(cols->isbnCol, i, cols->isbnBits)]++;
+    }
+}
+
+// --- LOAN HISTORY ARCHIVE ---
+// Closed borrow/return pairs older than the horizon move out of the
+// resident history into per-month segment files (archive/loans_YYYY_MM.col,
+// columnar encoding). Open loans and recent history stay resident;
+// segments are only opened by history queries. Segments written as CSV
+// by older versions (loans_YYYY_MM.csv) are still read, and converted the
+// next time their month is archived into.
+//
+// A segment is renamed into place before the snapshot that drops its
+// records, so a crash or failed checkpoint in between leaves the records
+// in both. Each segment keeps the cutoff it was written with; records of
+// pairs returned before it are matched against the segment instead of
+// being appended again, and are dropped from the resident history on load.
+
+static int compareLoanPtr(const void* a, const void* b) {
+    LoanTransaction* const* x = (LoanTransaction* const*)a;
+    LoanTransaction* const* y = (LoanTransaction* const*)b;
+    return (*x < *y) ? -1 : (*x > *y);
+}
+
+typedef struct LoanRef {
+    LoanTransaction* node;
+    int pos;      // Chronological position (0 = oldest)
+    int month;    // year * 12 + month - 1 of the record date
+    int returned; // Return day of the pair (planned records only)
+    int pair;
+} LoanRef;
+
+static int compareRefByLabel(const void* a, const void* b) {
+    const LoanRef* x = (const LoanRef*)a;
+    const LoanRef* y = (const LoanRef*)b;
+    int c = strcmp(x->node->bookLabelNo, y->node->bookLabelNo);
+    if (c) return c;
+    return x->pos - y->pos;
+}
+
+static int compareRefByMonth(const void* a, const void* b) {
+    const LoanRef* x = (const LoanRef*)a;
+    const LoanRef* y = (const LoanRef*)b;
+    if (x->month != y->month) return x->month - y->month;
+    return x->pos - y->pos;
+}
+
+void dayNumberToCivil(int days, int* year, int* month, int* day) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = days - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+static int monthKeyOfDate(const char* date) {
+    int days = dateToDayNumber(date);
+    if (days < 0) return -1;
+    int y, m, d;
+    dayNumberToCivil(days, &y, &m, &d);
+    return y * 12 + m - 1;
+}
+
+static void segmentPath(char* out, size_t len, int monthKey, const char* ext) {
+    snprintf(out, len, "%s/loans_%04d_%02d.%s", ARCHIVE_DIR, monthKey / 12, monthKey % 12 + 1, ext);
+}
+
+void archivePlanFree(ArchivePlan* plan) {
+    free(plan->nodes);
+    free(plan->returned);
+    free(plan->pair);
+    free(plan->archived);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// Selects every borrow/return pair whose return is before cutoffDay.
+// The list is newest-first; plan->nodes comes back grouped by month,
+// oldest-first within each.
+int planArchive(LoanTransaction* head, int cutoffDay, ArchivePlan* plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->cutoffDay = cutoffDay;
+    int n = 0;
+    for (LoanTransaction* t = head; t; t = t->next) n++;
+    if (n < 2) return 0;
+
+    LoanRef* refs = (LoanRef*)malloc(sizeof(LoanRef) * n);
+    if (!refs) return 0;
+    int i = n;
+    for (LoanTransaction* t = head; t; t = t->next) {
+        i--;
+        refs[i].node = t;
+        refs[i].pos = i;
+        refs[i].month = monthKeyOfDate(t->date);
+    }
+
+    // Within one label the records alternate borrow, return, borrow, ...
+    qsort(refs, n, sizeof(LoanRef), compareRefByLabel);
+    int keep = 0, pairs = 0;
+    for (i = 0; i + 1 < n; i++) {
+        LoanTransaction* b = refs[i].node;
+        LoanTransaction* r = refs[i + 1].node;
+        if (b->operationType == OP_TYPE_BORROW && r->operationType == OP_TYPE_RETURN &&
+            strcmp(b->bookLabelNo, r->bookLabelNo) == 0 && strcmp(b->studentId, r->studentId) == 0) {
+            int returned = dateToDayNumber(r->date);
+            if (returned >= 0 && returned < cutoffDay && refs[i].month >= 0 && refs[i + 1].month >= 0) {
+                refs[keep] = refs[i];
+                refs[keep + 1] = refs[i + 1];
+                refs[keep].returned = refs[keep + 1].returned = returned;
+                refs[keep].pair = refs[keep + 1].pair = pairs++;
+                keep += 2;
+            }
+            i++;
+        }
+    }
+    if (keep == 0) {
+        free(refs);
+        return 0;
+    }
+
+    qsort(refs, keep, sizeof(LoanRef), compareRefByMonth);
+    plan->nodes = (LoanTransaction**)malloc(sizeof(LoanTransaction*) * keep);
+    plan->returned = (int*)malloc(sizeof(int) * keep);
+    plan->pair = (int*)malloc(sizeof(int) * keep);
+    plan->archived = (unsigned char*)calloc(keep, 1);
+    if (!plan->nodes || !plan->returned || !plan->pair || !plan->archived) {
+        archivePlanFree(plan);
+        plan->cutoffDay = cutoffDay;
+        free(refs);
+        return 0;
+    }
+    for (i = 0; i < keep; i++) {
+        plan->nodes[i] = refs[i].node;
+        plan->returned[i] = refs[i].returned;
+        plan->pair[i] = refs[i].pair;
+    }
+    plan->count = keep;
+    free(refs);
+    return keep;
+}
+
+static int appendHistoryRow(LoanTransaction** rows, int* count, int* cap, const LoanTransaction* t) {
+    if (*count == *cap) {
+        int newCap = *cap ? *cap * 2 : 64;
+        LoanTransaction* grown = (LoanTransaction*)realloc(*rows, sizeof(LoanTransaction) * newCap);
+        if (!grown) return 0;
+        *rows = grown;
+        *cap = newCap;
+    }
+    (*rows)[*count] = *t;
+    (*rows)[*count].next = NULL;
+    (*count)++;
+    return 1;
+}
+
+// Loads a month's segment, converting a legacy CSV segment on the fly.
+// Returns 0 if the month has none.
+int loadSegment(int monthKey, LoanColumns* cols) {
+    char path[64];
+    segmentPath(path, sizeof(path), monthKey, "col");
+    if (columnsRead(cols, path)) return 1;
+    segmentPath(path, sizeof(path), monthKey, "csv");
+    CsvReader csv;
+    if (!csvOpen(&csv, path)) return 0;
+    LoanTransaction* rows = NULL;
+    int count = 0, cap = 0;
+    while (csvNextRecord(&csv)) {
+        LoanTransaction t;
+        if (csv.fieldCount < 4 || !csvInt(csv.fields[2], &t.operationType)) continue;
+        csvCopy(csv.fields[0], t.studentId, sizeof(t.studentId));
+        csvCopy(csv.fields[1], t.bookLabelNo, sizeof(t.bookLabelNo));
+        csvCopy(csv.fields[3], t.date, sizeof(t.date));
+        appendHistoryRow(&rows, &count, &cap, &t);
+    }
+    csvClose(&csv);
+    int ok = columnsBuild(cols, rows, count);
+    free(rows);
+    return ok;
+}
+
+static int compareHeldRow(const void* a, const void* b) {
+    const LoanTransaction* x = *(const LoanTransaction* const*)a;
+    const LoanTransaction* y = *(const LoanTransaction* const*)b;
+    int c = strcmp(x->studentId, y->studentId);
+    if (!c) c = strcmp(x->bookLabelNo, y->bookLabelNo);
+    if (!c) c = x->operationType - y->operationType;
+    if (!c) c = dateToDayNumber(x->date) - dateToDayNumber(y->date);
+    return c;
+}
+
+// Marks the planned records of one month (plan rows [start, end)) that
+// its segment already holds. Only pairs returned before the segment's
+// cutoff can be there; each held row accounts for one planned record, so
+// a loan repeated on the same day is not mistaken for a copy.
+static int markHeldRows(ArchivePlan* plan, int start, int end, const LoanTransaction* held, int heldCount, int before) {
+    int wanted = 0;
+    for (int i = start; i < end; i++) {
+        if (plan->returned[i] < before) wanted = 1;
+    }
+    if (!wanted || heldCount == 0) return 1;
+
+    const LoanTransaction** sorted = (const LoanTransaction**)malloc(sizeof(LoanTransaction*) * heldCount);
+    unsigned char* used = (unsigned char*)calloc(heldCount, 1);
+    if (!sorted || !used) {
+        free(sorted);
+        free(used);
+        return 0;
+    }
+    for (int i = 0; i < heldCount; i++) sorted[i] = &held[i];
+    qsort(sorted, heldCount, sizeof(LoanTransaction*), compareHeldRow);
+    for (int i = start; i < end; i++) {
+        if (plan->returned[i] >= before) continue;
+        const LoanTransaction* key = plan->nodes[i];
+        const LoanTransaction** hit = (const LoanTransaction**)bsearch(&key, sorted, heldCount, sizeof(LoanTransaction*), compareHeldRow);
+        if (!hit) continue;
+        while (hit > sorted && compareHeldRow(hit - 1, &key) == 0) hit--;
+        for (; hit < sorted + heldCount && compareHeldRow(hit, &key) == 0; hit++) {
+            if (used[hit - sorted]) continue;
+            used[hit - sorted] = 1;
+            plan->archived[i] = 1;
+            break;
+        }
+    }
+    free(sorted);
+    free(used);
+    return 1;
+}
+
+static int planMonthEnd(ArchivePlan* plan, int start) {
+    int month = monthKeyOfDate(plan->nodes[start]->date);
+    int end = start;
+    while (end < plan->count && monthKeyOfDate(plan->nodes[end]->date) == month) end++;
+    return end;
+}
+
+// Rewrites the segment of each month in the plan with the planned records
+// it does not hold yet appended, and marks the records archived. Stops at
+// the first month that cannot be written.
+int writeArchiveSegments(ArchivePlan* plan) {
+    if (mkdir(ARCHIVE_DIR, 0755) != 0 && errno != EEXIST) return 0;
+    int i = 0;
+    while (i < plan->count) {
+        int month = monthKeyOfDate(plan->nodes[i]->date);
+        int start = i;
+        i = planMonthEnd(plan, start);
+        LoanTransaction* rows = NULL;
+        int count = 0, cap = 0, before = 0;
+        LoanColumns cols;
+        if (loadSegment(month, &cols)) {
+            before = cols.archivedBefore;
+            count = cap = columnsDecode(&cols, &rows);
+            columnsFree(&cols);
+            if (!rows) return 0;
+        }
+        if (!markHeldRows(plan, start, i, rows, count, before)) {
+            free(rows);
+            return 0;
+        }
+        int held = count;
+        for (int k = start; k < i; k++) {
+            if (plan->archived[k]) continue;
+            if (!appendHistoryRow(&rows, &count, &cap, plan->nodes[k])) {
+                free(rows);
+                return 0;
+            }
+        }
+        char path[64], tmp[72];
+        segmentPath(path, sizeof(path), month, "col");
+        int ok = 1;
+        if (count > held || before < plan->cutoffDay || access(path, F_OK) != 0) {
+            ok = columnsBuild(&cols, rows, count);
+            if (ok) {
+                cols.archivedBefore = before > plan->cutoffDay ? before : plan->cutoffDay;
+                snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+                ok = columnsWrite(&cols, tmp) && rename(tmp, path) == 0;
+                columnsFree(&cols);
+            }
+        }
+        free(rows);
+        if (!ok) return 0;
+        for (int k = start; k < i; k++) plan->archived[k] = 1;
+        segmentPath(path, sizeof(path), month, "csv");
+        unlink(path);
+    }
+    return 1;
+}
+
+// Drops the records whose pair is not wholly archived (its other month
+// failed to write), so the resident history never keeps half a pair
+void keepArchivedPairs(ArchivePlan* plan) {
+    if (plan->count == 0) return;
+    unsigned char* whole = (unsigned char*)malloc((size_t)plan->count / 2);
+    if (!whole) {
+        plan->count = 0;
+        return;
+    }
+    memset(whole, 1, (size_t)plan->count / 2);
+    for (int i = 0; i < plan->count; i++) {
+        if (!plan->archived[i]) whole[plan->pair[i]] = 0;
+    }
+    int keep = 0;
+    for (int i = 0; i < plan->count; i++) {
+        if (!whole[plan->pair[i]]) continue;
+        plan->nodes[keep] = plan->nodes[i];
+        plan->returned[keep] = plan->returned[i];
+        plan->pair[keep] = plan->pair[i];
+        plan->archived[keep] = 1;
+        keep++;
+    }
+    plan->count = keep;
+    free(whole);
+}
+
+// Cutoff of a month's columnar segment, read from its header alone.
+// 0 when the month has none or it predates the field.
+static int segmentArchivedBefore(int monthKey) {
+    char path[64];
+    segmentPath(path, sizeof(path), monthKey, "col");
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ColumnFileHeader h;
+    ssize_t n = read(fd, &h, sizeof(h));
+    close(fd);
+    if (n != (ssize_t)sizeof(h) || memcmp(h.magic, COLUMNS_MAGIC, 4) != 0 || h.version < 2) return 0;
+    return h.archivedBefore;
+}
+
+// Detaches loaded records that the segments already hold: the last run
+// stopped after writing a segment but before the snapshot without them.
+// Called once the snapshot and journal are loaded, before any thread runs.
+void dropArchivedHistory(Library* lib) {
+    if (access(ARCHIVE_DIR, F_OK) != 0) return;
+    ArchivePlan plan;
+    if (!planArchive(lib->loans, INT_MAX, &plan)) return;
+    int i = 0;
+    while (i < plan.count) {
+        int month = monthKeyOfDate(plan.nodes[i]->date);
+        int start = i;
+        i = planMonthEnd(&plan, start);
+        int before = segmentArchivedBefore(month);
+        int wanted = 0;
+        for (int k = start; k < i; k++) {
+            if (plan.returned[k] < before) wanted = 1;
+        }
+        LoanColumns cols;
+        if (!wanted || !loadSegment(month, &cols)) continue;
+        LoanTransaction* rows = NULL;
+        int count = columnsDecode(&cols, &rows);
+        columnsFree(&cols);
+        if (rows) markHeldRows(&plan, start, i, rows, count, before);
+        free(rows);
+    }
+    keepArchivedPairs(&plan);
+    if (plan.count) {
+        printf("Dropped %d loan records already in the archive\n", plan.count);
+        detachArchived(lib, &plan);
+    }
+    archivePlanFree(&plan);
+}
+
+// Caller holds the library lock exclusively (no reader walks the history)
+void detachArchived(Library* lib, ArchivePlan* plan) {
+    qsort(plan->nodes, plan->count, sizeof(LoanTransaction*), compareLoanPtr);
+    LoanTransaction** link = &lib->loans;
+    while (*link) {
+        LoanTransaction* t = *link;
+        if (bsearch(&t, plan->nodes, plan->count, sizeof(LoanTransaction*), compareLoanPtr)) {
+            *link = t->next;
+            free(t);
+        } else {
+            link = &t->next;
+        }
+    }
+}
+
+static int compareHistoryRow(const void* a, const void* b) {
+    const LoanTransaction* x = (const LoanTransaction*)a;
+    const LoanTransaction* y = (const LoanTransaction*)b;
+    int dx = dateToDayNumber(x->date), dy = dateToDayNumber(y->date);
+    if (dx != dy) return dx - dy;
+    return x->operationType - y->operationType;
+}
+
+// Every record of a student or label dated within [fromDay, toDay],
+// oldest first. Segments for the months in range are opened on demand.
+// Caller holds the library lock (shared) and frees *out.
+int queryLoanHistory(LoanTransaction** lHead, const char* key, int fromDay, int toDay, LoanTransaction** out) {
+    LoanTransaction* rows = NULL;
+    int count = 0, cap = 0;
+
+    pthread_mutex_lock(&loanLock);
+    LoanTransaction* history = *lHead;
+    pthread_mutex_unlock(&loanLock);
+    for (LoanTransaction* t = history; t; t = t->next) {
+        if (strcmp(t->studentId, key) != 0 && strcmp(t->bookLabelNo, key) != 0) continue;
+        int day = dateToDayNumber(t->date);
+        if (day >= fromDay && day <= toDay) appendHistoryRow(&rows, &count, &cap, t);
+    }
+
+    int y, m, d;
+    dayNumberToCivil(fromDay, &y, &m, &d);
+    int firstMonth = y * 12 + m - 1;
+    dayNumberToCivil(toDay, &y, &m, &d);
+    int lastMonth = y * 12 + m - 1;
+    size_t isbnLen;
+    unsigned int copy = splitLabel(key, &isbnLen);
+    for (int month = firstMonth; month <= lastMonth; month++) {
+        LoanColumns cols;
+        if (!loadSegment(month, &cols)) continue;
+        int sId = dictId(&cols.students, key, strlen(key), 0);
+        int iId = dictId(&cols.isbns, key, isbnLen, 0);
+        size_t pos = 0;
+        int day = 0;
+        for (int i = 0; (sId >= 0 || iId >= 0) && i < cols.count; i++) {
+            day += readDayDelta(cols.days, &pos);
+            if (day < fromDay || day > toDay) continue;
+            if ((int)bitGet(cols.studentCol, i, cols.studentBits) != sId &&
+                ((int)bitGet(cols.isbnCol, i, cols.isbnBits) != iId || bitGet(cols.copyCol, i, cols.copyBits) != copy)) continue;
+            LoanTransaction t;
+            columnsRow(&cols, i, day, &t);
+            appendHistoryRow(&rows, &count, &cap, &t);
+        }
+        columnsFree(&cols);
+    }
+
+    if (count > 1) qsort(rows, count, sizeof(LoanTransaction), compareHistoryRow);
+    *out = rows;
+    return count;
+}
+
+typedef struct TrendTitle {
+    char isbn[ISBN_LEN];
+    long count;
+} TrendTitle;
+
+typedef struct LoanTrends {
+    int firstMonth;  // year * 12 + month - 1
+    int monthCount;
+    long* volumes;   // Borrows and returns, two per month
+    TrendTitle top[TRENDS_TOP_TITLES];
+    int topCount;
+} LoanTrends;
+
+static void trendsCount(StringDict* all, long** counts, int* cap, const char* isbn, size_t len, long n) {
+    int id = dictId(all, isbn, len, 1);
+    if (id < 0) return;
+    if (id >= *cap) {
+        int newCap = *cap ? *cap * 2 : 256;
+        long* grown = (long*)realloc(*counts, sizeof(long) * newCap);
+        if (!grown) return;
+        memset(grown + *cap, 0, sizeof(long) * (newCap - *cap));
+        *counts = grown;
+        *cap = newCap;
+    }
+    (*counts)[id] += n;
+}
+
+// Monthly borrow/return volumes and the most borrowed ISBNs within
+// [fromDay, toDay]. Archived months are scanned column-wise; the
+// resident history is walked directly. Caller holds the library lock
+// (shared) and frees trends->volumes.
+int collectLoanTrends(LoanTransaction** lHead, int fromDay, int toDay, LoanTrends* trends) {
+    memset(trends, 0, sizeof(*trends));
+    int y, m, d;
+    dayNumberToCivil(fromDay, &y, &m, &d);
+    trends->firstMonth = y * 12 + m - 1;
+    dayNumberToCivil(toDay, &y, &m, &d);
+    trends->monthCount = y * 12 + m - trends->firstMonth;
+    if (trends->monthCount < 1) return 0;
+    trends->volumes = (long*)calloc((size_t)trends->monthCount * 2, sizeof(long));
+    if (!trends->volumes) return 0;
+
+    StringDict all;
+    memset(&all, 0, sizeof(all));
+    long* counts = NULL;
+    int countCap = 0;
+    for (int month = trends->firstMonth; month < trends->firstMonth + trends->monthCount; month++) {
+        LoanColumns cols;
+        if (!loadSegment(month, &cols)) continue;
+        long* perIsbn = (long*)calloc(cols.isbns.count ? cols.isbns.count : 1, sizeof(long));
+        if (perIsbn) {
+            columnsScan(&cols, fromDay, toDay, trends->firstMonth, trends->volumes, perIsbn);
+            for (int id = 0; id < cols.isbns.count; id++) {
+                const char* isbn = dictName(&cols.isbns, id);
+                if (perIsbn[id]) trendsCount(&all, &counts, &countCap, isbn, strlen(isbn), perIsbn[id]);
+            }
+            free(perIsbn);
+        }
+        columnsFree(&cols);
+    }
+
+    pthread_mutex_lock(&loanLock);
+    LoanTransaction* history = *lHead;
+    pthread_mutex_unlock(&loanLock);
+    for (LoanTransaction* t = history; t; t = t->next) {
+        int day = dateToDayNumber(t->date);
+        if (day < fromDay || day > toDay) continue;
+        dayNumberToCivil(day, &y, &m, &d);
+        trends->volumes[(y * 12 + m - 1 - trends->firstMonth) * 2 + (t->operationType == OP_TYPE_RETURN)]++;
+        if (t->operationType != OP_TYPE_BORROW) continue;
+        size_t isbnLen;
+        splitLabel(t->bookLabelNo, &isbnLen);
+        trendsCount(&all, &counts, &countCap, t->bookLabelNo, isbnLen, 1);
+    }
+
+    for (int id = 0; id < all.count; id++) {
+        int pos = trends->topCount;
+        if (pos == TRENDS_TOP_TITLES && counts[id] <= trends->top[pos - 1].count) continue;
+        if (pos == TRENDS_TOP_TITLES) pos--;
+        while (pos > 0 && trends->top[pos - 1].count < counts[id]) {
+            trends->top[pos] = trends->top[pos - 1];
+            pos--;
+        }
+        snprintf(trends->top[pos].isbn, ISBN_LEN, "%s", dictName(&all, id));
+        trends->top[pos].count = counts[id];
+        if (trends->topCount < TRENDS_TOP_TITLES) trends->topCount++;
+    }
+    dictFree(&all);
+    free(counts);
+    return 1;
+}
+
+// --- LOAN INTERVAL INDEX ---
+// Answers "who held this copy on a date" and "what did this student hold
+// between two dates" in O(log n + k) per label or student. The index is
+// built on first use from the archive segments and the resident history;
+// afterwards it only applies the records pushed onto the history head.
+
+static void intervalMapGrow(IntervalMap* map) {
+    int newCount = map->slotCount ? map->slotCount * 2 : 1024;
+    IntervalList* slots = (IntervalList*)calloc(newCount, sizeof(IntervalList));
+    if (!slots) return;
+    for (int i = 0; i < map->slotCount; i++) {
+        IntervalList* l = &map->slots[i];
+        if (!l->key) continue;
+        unsigned int j = hashString(l->key, strlen(l->key)) % (unsigned int)newCount;
+        while (slots[j].key) j = (j + 1) % (unsigned int)newCount;
+        slots[j] = *l;
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->slotCount = newCount;
+}
+
+static IntervalList* intervalListOf(IntervalMap* map, const char* key, int create) {
+    if (create && (map->count + 1) * 10 > map->slotCount * 7) intervalMapGrow(map);
+    if (!map->slotCount) return NULL;
+    unsigned int i = hashString(key, strlen(key)) % (unsigned int)map->slotCount;
+    while (map->slots[i].key) {
+        if (strcmp(map->slots[i].key, key) == 0) return &map->slots[i];
+        i = (i + 1) % (unsigned int)map->slotCount;
+    }
+    if (!create || (map->count + 1) * 10 > map->slotCount * 7) return NULL;
+    map->slots[i].key = internString(key);
+    map->count++;
+    return &map->slots[i];
+}
+
+static int intervalListInsert(IntervalList* l, int id) {
+    if (l->count == l->cap) {
+        int newCap = l->cap ? l->cap * 2 : 4;
+        int* items = (int*)realloc(l->items, sizeof(int) * newCap);
+        if (!items) return 0;
+        l->items = items;
+        int* maxEnd = (int*)realloc(l->maxEnd, sizeof(int) * newCap);
+        if (!maxEnd) return 0;
+        l->maxEnd = maxEnd;
+        l->cap = newCap;
+    }
+    // Records mostly arrive in date order; the rest are sorted on query
+    if (l->count && intervalIndex.intervals[l->items[l->count - 1]].start > intervalIndex.intervals[id].start) {
+        l->unsorted = 1;
+    }
+    l->items[l->count++] = id;
+    l->dirty = 1;
+    return 1;
+}
+
+static int compareIntervalStart(const void* a, const void* b) {
+    const LoanInterval* x = &intervalIndex.intervals[*(const int*)a];
+    const LoanInterval* y = &intervalIndex.intervals[*(const int*)b];
+    if (x->start != y->start) return (x->start > y->start) - (x->start < y->start);
+    return *(const int*)a - *(const int*)b;
+}
+
+static int intervalBuildMaxEnd(IntervalList* l, int lo, int hi) {
+    if (lo >= hi) return INT_MIN;
+    int mid = lo + (hi - lo) / 2;
+    int best = intervalIndex.intervals[l->items[mid]].end;
+    int left = intervalBuildMaxEnd(l, lo, mid);
+    int right = intervalBuildMaxEnd(l, mid + 1, hi);
+    if (left > best) best = left;
+    if (right > best) best = right;
+    l->maxEnd[mid] = best;
+    return best;
+}
+
+// A borrow opens an interval; a return closes the label's open interval
+// of the same student
+static void intervalApply(const char* sId, const char* label, int op, int day) {
+    if (day < 0) return;
+    IntervalIndex* idx = &intervalIndex;
+    if (op == OP_TYPE_BORROW) {
+        if (idx->count == idx->cap) {
+            int newCap = idx->cap ? idx->cap * 2 : 1024;
+            LoanInterval* grown = (LoanInterval*)realloc(idx->intervals, sizeof(LoanInterval) * newCap);
+            if (!grown) return;
+            idx->intervals = grown;
+            idx->cap = newCap;
+        }
+        IntervalList* byLabel = intervalListOf(&idx->byLabel, label, 1);
+        IntervalList* byStudent = intervalListOf(&idx->byStudent, sId, 1);
+        if (!byLabel || !byStudent) return;
+        int id = idx->count++;
+        idx->intervals[id].label = byLabel->key;
+        idx->intervals[id].studentId = byStudent->key;
+        idx->intervals[id].start = day;
+        idx->intervals[id].end = INTERVAL_OPEN;
+        intervalListInsert(byLabel, id);
+        intervalListInsert(byStudent, id);
+        return;
+    }
+    IntervalList* l = intervalListOf(&idx->byLabel, label, 0);
+    for (int i = l ? l->count - 1 : -1; i >= 0; i--) {
+        LoanInterval* iv = &idx->intervals[l->items[i]];
+        if (iv->end == INTERVAL_OPEN && strcmp(iv->studentId, sId) == 0) {
+            iv->end = day;
+            l->dirty = 1;
+            IntervalList* s = intervalListOf(&idx->byStudent, sId, 0);
+            if (s) s->dirty = 1;
+            return;
+        }
+    }
+}
+
+// Applies the records pushed onto the history since the last call.
+// Caller holds intervalIndex.lock and the library lock.
+static void intervalCatchUp(LoanTransaction** lHead) {
+    pthread_mutex_lock(&loanLock);
+    LoanTransaction* t = *lHead;
+    unsigned long added = loanHistoryAdded;
+    pthread_mutex_unlock(&loanLock);
+    unsigned long n = added - intervalIndex.consumed;
+    if (!n) return;
+    LoanTransaction** fresh = (LoanTransaction**)malloc(sizeof(LoanTransaction*) * n);
+    if (!fresh) return;
+    unsigned long i = 0;
+    for (; i < n && t; t = t->next) fresh[i++] = t;
+    while (i > 0) {
+        i--;
+        intervalApply(fresh[i]->studentId, fresh[i]->bookLabelNo, fresh[i]->operationType, dateToDayNumber(fresh[i]->date));
+    }
+    free(fresh);
+    intervalIndex.consumed = added;
+}
+
+static int compareInt(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Segments are read month by month, then the resident history oldest
+// first. Every archived pair is older than the resident records of its
+// label, so each label's records are applied in order.
+static void intervalBuild(LoanTransaction** lHead) {
+    int* months = NULL;
+    int monthCount = 0, monthCap = 0;
+    DIR* dir = opendir(ARCHIVE_DIR);
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir))) {
+        int y, m, used = 0;
+        if (sscanf(entry->d_name, "loans_%4d_%2d.%n", &y, &m, &used) != 2 || !used) continue;
+        if (strcmp(entry->d_name + used, "col") != 0 && strcmp(entry->d_name + used, "csv") != 0) continue;
+        if (monthCount == monthCap) {
+            int newCap = monthCap ? monthCap * 2 : 64;
+            int* grown = (int*)realloc(months, sizeof(int) * newCap);
+            if (!grown) break;
+            months = grown;
+            monthCap = newCap;
+        }
+        months[monthCount++] = y * 12 + m - 1;
+    }
+    if (dir) closedir(dir);
+    if (monthCount > 1) qsort(months, monthCount, sizeof(int), compareInt);
+
+    for (int i = 0; i < monthCount; i++) {
+        LoanColumns cols;
+        if (i > 0 && months[i] == months[i - 1]) continue; // Both .col and .csv
+        if (!loadSegment(months[i], &cols)) continue;
+        size_t pos = 0;
+        int day = 0;
+        for (int r = 0; r < cols.count; r++) {
+            LoanTransaction t;
+            day += readDayDelta(cols.days, &pos);
+            columnsRow(&cols, r, day, &t);
+            intervalApply(t.studentId, t.bookLabelNo, t.operationType, day);
+        }
+        columnsFree(&cols);
+    }
+    free(months);
+
+    pthread_mutex_lock(&loanLock);
+    LoanTransaction* head = *lHead;
+    intervalIndex.consumed = loanHistoryAdded;
+    pthread_mutex_unlock(&loanLock);
+    size_t n = 0;
+    for (LoanTransaction* t = head; t; t = t->next) n++;
+    LoanTransaction** rows = (LoanTransaction**)malloc(sizeof(LoanTransaction*) * (n ? n : 1));
+    if (!rows) return;
+    size_t i = 0;
+    for (LoanTransaction* t = head; t; t = t->next) rows[i++] = t;
+    while (i > 0) {
+        i--;
+        intervalApply(rows[i]->studentId, rows[i]->bookLabelNo, rows[i]->operationType, dateToDayNumber(rows[i]->date));
+    }
+    free(rows);
+}
+
+// Builds the index on first use. Called without the library lock: the
+// segments are read under persistLock, so no checkpoint appends to them
+// while the resident records are still in memory.
+void intervalIndexEnsure(LoanTransaction** lHead) {
+    if (__atomic_load_n(&intervalIndex.built, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&persistLock);
+    pthread_rwlock_rdlock(&libraryLock);
+    pthread_mutex_lock(&intervalIndex.lock);
+    if (!intervalIndex.built) {
+        intervalBuild(lHead);
+        __atomic_store_n(&intervalIndex.built, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&intervalIndex.lock);
+    pthread_rwlock_unlock(&libraryLock);
+    pthread_mutex_unlock(&persistLock);
+}
+
+// Called before archived records leave the resident history
+void intervalIndexSync(LoanTransaction** lHead) {
+    pthread_mutex_lock(&intervalIndex.lock);
+    if (intervalIndex.built) intervalCatchUp(lHead);
+    pthread_mutex_unlock(&intervalIndex.lock);
+}
+
+static void intervalMapFree(IntervalMap* map) {
+    for (int i = 0; i < map->slotCount; i++) {
+        free(map->slots[i].items);
+        free(map->slots[i].maxEnd);
+    }
+    free(map->slots);
+    memset(map, 0, sizeof(*map));
+}
+
+void intervalIndexReset(void) {
+    pthread_mutex_lock(&intervalIndex.lock);
+    intervalMapFree(&intervalIndex.byLabel);
+    intervalMapFree(&intervalIndex.byStudent);
+    free(intervalIndex.intervals);
+    intervalIndex.intervals = NULL;
+    intervalIndex.count = intervalIndex.cap = 0;
+    intervalIndex.consumed = 0;
+    __atomic_store_n(&intervalIndex.built, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&intervalIndex.lock);
+}
+
+static void intervalCollect(IntervalList* l, int lo, int hi, int fromDay, int toDay,
+                            LoanInterval** rows, int* count, int* cap) {
+    if (lo >= hi) return;
+    int mid = lo + (hi - lo) / 2;
+    if (l->maxEnd[mid] < fromDay) return;
+    intervalCollect(l, lo, mid, fromDay, toDay, rows, count, cap);
+    LoanInterval* iv = &intervalIndex.intervals[l->items[mid]];
+    if (iv->start > toDay) return;
+    if (iv->end >= fromDay) {
+        if (*count == *cap) {
+            int newCap = *cap ? *cap * 2 : 16;
+            LoanInterval* grown = (LoanInterval*)realloc(*rows, sizeof(LoanInterval) * newCap);
+            if (!grown) return;
+            *rows = grown;
+            *cap = newCap;
+        }
+        (*rows)[(*count)++] = *iv;
+    }
+    intervalCollect(l, mid + 1, hi, fromDay, toDay, rows, count, cap);
+}
+
+// Loans of a label or student that overlap [fromDay, toDay], by start
+// day. Call intervalIndexEnsure first; caller holds the library lock
+// (shared) and frees *out.
+int queryLoanIntervals(LoanTransaction** lHead, const char* key, int fromDay, int toDay, LoanInterval** out) {
+    LoanInterval* rows = NULL;
+    int count = 0, cap = 0;
+    pthread_mutex_lock(&intervalIndex.lock);
+    if (intervalIndex.built) {
+        intervalCatchUp(lHead);
+        IntervalList* l = intervalListOf(&intervalIndex.byLabel, key, 0);
+        if (!l) l = intervalListOf(&intervalIndex.byStudent, key, 0);
+        if (l && l->unsorted) {
+            qsort(l->items, l->count, sizeof(int), compareIntervalStart);
+            l->unsorted = 0;
+        }
+        if (l && l->dirty) {
+            intervalBuildMaxEnd(l, 0, l->count);
+            l->dirty = 0;
+        }
+        if (l) intervalCollect(l, 0, l->count, fromDay, toDay, &rows, &count, &cap);
+    }
+    pthread_mutex_unlock(&intervalIndex.lock);
+    *out = rows;
+    return count;
+}
+
+void formatDayNumber(int days, char* out, size_t len) {
+    int y, m, d;
+    dayNumberToCivil(days, &y, &m, &d);
+    snprintf(out, len, "%02d.%02d.%04d", d, m, y);
+}
+
+// --- BATCH AVAILABILITY ---
+// Reading lists of ISBNs or copy labels are answered in one pass. Keys
+// are hashed once and grouped by catalog shard, so every shard lock is
+// taken once per batch, and the bucket and book of keys a few positions
+// ahead are prefetched while the current key is probed.
+
+typedef struct AvailabilityRow {
+    const char* key;
+    Book* book;       // NULL when no book or copy matches
+    int total;        // Copies of the book, or 1 for a label
+    int available;
+    int holdersStart; // Into AvailabilityBatch.holders
+    int holderCount;
+} AvailabilityRow;
+
+typedef struct AvailabilityBatch {
+    AvailabilityRow* rows; // In key order
+    int count;
+    int found;
+    char (*holders)[STUDENT_ID_LEN];
+    int holderCount;
+    int holderCap;
+} AvailabilityBatch;
+
+// Splits text in place on whitespace and commas. Returns the key count.
+int splitKeys(char* text, char*** keys) {
+    int count = 0, cap = 0;
+    char* save = NULL;
+    *keys = NULL;
+    for (char* k = strtok_r(text, " ,\t\r\n", &save); k; k = strtok_r(NULL, " ,\t\r\n", &save)) {
+        if (count == cap) {
+            int newCap = cap ? cap * 2 : 64;
+            char** grown = (char**)realloc(*keys, sizeof(char*) * newCap);
+            if (!grown) break;
+            *keys = grown;
+            cap = newCap;
+        }
+        (*keys)[count++] = k;
+    }
+    return count;
+}
+
+static void availabilityAddHolder(AvailabilityBatch* batch, AvailabilityRow* row, const char* sId) {
+    if (batch->holderCount == batch->holderCap) {
+        int newCap = batch->holderCap ? batch->holderCap * 2 : 256;
+        char (*grown)[STUDENT_ID_LEN] = realloc(batch->holders, sizeof(*grown) * newCap);
+        if (!grown) return;
+        batch->holders = grown;
+        batch->holderCap = newCap;
+    }
+    memcpy(batch->holders[batch->holderCount++], sId, STUDENT_ID_LEN);
+    row->holderCount++;
+}
+
+// Fills a row from its book. Caller holds the book's shard lock.
+static void availabilityFill(AvailabilityBatch* batch, AvailabilityRow* row, Book* book, size_t isbnLen) {
+    row->book = book;
+    row->holdersStart = batch->holderCount;
+    int isLabel = row->key[isbnLen] != '\0';
+    for (BookCopy* c = book->copies; c; c = c->next) {
+        if (isLabel && strcmp(c->labelNo, row->key) != 0) continue;
+        row->total++;
+        if (strcmp(c->borrowerStudentId, "SHELF") == 0) row->available++;
+        else availabilityAddHolder(batch, row, c->borrowerStudentId);
+    }
+    if (isLabel && row->total == 0) row->book = NULL;
+}
+
+// Looks up every key. Caller holds libraryLock (read) so the books stay
+// valid until the rows are printed. Returns 0 on allocation failure.
+int availabilityLookup(char** keys, int count, AvailabilityBatch* batch) {
+    memset(batch, 0, sizeof(*batch));
+    batch->rows = (AvailabilityRow*)calloc(count ? count : 1, sizeof(AvailabilityRow));
+    unsigned int* hashes = (unsigned int*)malloc(sizeof(unsigned int) * (count ? count : 1));
+    size_t* lens = (size_t*)malloc(sizeof(size_t) * (count ? count : 1));
+    int* order = (int*)malloc(sizeof(int) * (count ? count : 1));
+    int shardStart[CATALOG_SHARDS + 1] = {0};
+    if (!batch->rows || !hashes || !lens || !order) {
+        free(batch->rows);
+        batch->rows = NULL;
+        free(hashes);
+        free(lens);
+        free(order);
+        return 0;
+    }
+    batch->count = count;
+
+    // Counting sort of the keys by shard
+    for (int i = 0; i < count; i++) {
+        batch->rows[i].key = keys[i];
+        lens[i] = strchr(keys[i], '_') ? isbnLengthOfLabel(keys[i]) : strlen(keys[i]);
+        hashes[i] = hashString(keys[i], lens[i]);
+        shardStart[hashes[i] % CATALOG_SHARDS + 1]++;
+    }
+    for (int s = 0; s < CATALOG_SHARDS; s++) shardStart[s + 1] += shardStart[s];
+    int fill[CATALOG_SHARDS];
+    memcpy(fill, shardStart, sizeof(fill));
+    for (int i = 0; i < count; i++) order[fill[hashes[i] % CATALOG_SHARDS]++] = i;
+
+    for (int s = 0; s < CATALOG_SHARDS; s++) {
+        int start = shardStart[s], end = shardStart[s + 1];
+        if (start == end) continue;
+        CatalogShard* shard = &catalogShards[s];
+        pthread_mutex_lock(&shard->lock);
+        if (shard->bucketCount) {
+            for (int j = start; j < end; j++) {
+                int ahead = j + AVAIL_PREFETCH_DISTANCE;
+                if (ahead < end) __builtin_prefetch(catalogBucket(shard, hashes[order[ahead]]));
+                ahead = j + AVAIL_PREFETCH_DISTANCE / 2;
+                if (ahead < end) {
+                    Book* next = *catalogBucket(shard, hashes[order[ahead]]);
+                    if (next) __builtin_prefetch(next);
+                }
+                int i = order[j];
+                Book* b = catalogProbe(shard, hashes[i], keys[i], lens[i]);
+                if (b) availabilityFill(batch, &batch->rows[i], b, lens[i]);
+                if (batch->rows[i].book) batch->found++;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    free(hashes);
+    free(lens);
+    free(order);
+    return 1;
+}
+
+void availabilityFree(AvailabilityBatch* batch) {
+    free(batch->rows);
+    free(batch->holders);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void printAvailability(AvailabilityBatch* batch) {
+    printf("%-18s %-9s %-40s %s\n", "ISBN/Label", "Avail", "Title", "Holders");
+    for (int i = 0; i < batch->count; i++) {
+        AvailabilityRow* r = &batch->rows[i];
+        if (!r->book) {
+            printf("%-18s %-9s (not found)\n", r->key, "-");
+            continue;
+        }
+        char avail[24];
+        snprintf(avail, sizeof(avail), "%d/%d", r->available, r->total);
+        printf("%-18s %-9s %-40.40s ", r->key, avail, r->book->title);
+        for (int h = 0; h < r->holderCount; h++) printf("%s%s", h ? ";" : "", batch->holders[r->holdersStart + h]);
+        printf("\n");
+    }
+    printf("%d of %d keys found.\n", batch->found, batch->count);
+}
+
+// Reads keys from a file ("-" for stdin) and prints their availability
+int runAvailabilityReport(const char* path) {
+    FILE* fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        printf("Could not open file: %s\n", path);
+        return 1;
+    }
+    size_t len = 0, cap = 4096;
+    char* text = (char*)malloc(cap);
+    size_t n;
+    while (text && (n = fread(text + len, 1, cap - len - 1, fp)) > 0) {
+        len += n;
+        if (cap - len < 2) {
+            char* grown = (char*)realloc(text, cap * 2);
+            if (!grown) break;
+            text = grown;
+            cap *= 2;
+        }
+    }
+    if (fp != stdin) fclose(fp);
+    if (!text) return 1;
+    text[len] = '\0';
+
+    char** keys = NULL;
+    int count = splitKeys(text, &keys);
+    AvailabilityBatch batch;
+    pthread_rwlock_rdlock(&libraryLock);
+    int ok = availabilityLookup(keys, count, &batch);
+    if (ok) printAvailability(&batch);
+    pthread_rwlock_unlock(&libraryLock);
+    availabilityFree(&batch);
+    free(keys);
+    free(text);
+    return ok ? 0 : 1;
+}
+
+// --- MENUS ---
+
+// Says so when a change made from a menu does not fit in a journal record
+static int menuRecordFits(int len) {
+    if (len >= 0) return 1;
+    printf("Error: The change is too long to journal; nothing was changed.\n");
+    return 0;
+}
+
+// Commits a change made from a menu and says so if it was not saved
+static int menuCommit(unsigned long seq) {
+    if (commitChange(seq)) return 1;
+    printf("Error: The journal could not be written; the change may be lost on restart.\n");
+    return 0;
+}
+
+void menuAddAuthor(Author** head) {
+    char name[MAX_NAME_LEN], surname[MAX_NAME_LEN];
+    printf("Name: "); fgets(name, MAX_NAME_LEN, stdin); name[strcspn(name, "\n")] = 0;
+    printf("Surname: "); fgets(surname, MAX_NAME_LEN, stdin); surname[strcspn(surname, "\n")] = 0;
+    char qName[JOURNAL_FIELD_LEN], qSurname[JOURNAL_FIELD_LEN], record[JOURNAL_RECORD_LEN];
+    int len = storageFormat(record, "a,%s,%s\n", journalQuote(qName, name), journalQuote(qSurname, surname));
+    if (!menuRecordFits(len)) return;
+    pthread_rwlock_wrlock(&libraryLock);
+    addAuthor(head, name, surname);
+    unsigned long seq = storageApply(record, len);
+    pthread_rwlock_unlock(&libraryLock);
+    menuCommit(seq);
+}
+
+void menuDeleteAuthor(Author** head, BookAuthorMap** arr, int* count) {
+    int id;
+    printf("Author ID to delete: "); scanf("%d", &id); while(getchar()!='\n');
+    char record[JOURNAL_RECORD_LEN];
+    int len = storageFormat(record, "d,%d\n", id);
+    if (!menuRecordFits(len)) return;
+    pthread_rwlock_wrlock(&libraryLock);
+    *head = deleteAuthor(*head, id, arr, count);
+    unsigned long seq = storageApply(record, len);
+    pthread_rwlock_unlock(&libraryLock);
+    menuCommit(seq);
+}
+
+void menuAuthors(Author** head, BookAuthorMap** arr, int* count) {
+    int choice;
+    do {
+        printf("\n--- Author Menu ---\n1. Add Author\n2. Delete Author\n3. List Authors\n0. Back\nChoice: ");
+        scanf("%d", &choice); while(getchar()!='\n');
+        switch(choice) {
+            case 1: menuAddAuthor(head); break;
+            case 2: menuDeleteAuthor(head, arr, count); break;
+            case 3: listAuthors(*head); break;
+        }
+    } while(choice != 0);
+}
+
+void menuStudents(Student** sHead, LoanTransaction** lHead) {
+    int choice;
+    do {
+        printf("\n--- Student Menu ---\n1. Add Student\n2. Delete Student\n3. List Students\n4. Borrow/Return\n5. Loan History\n6. Who Held a Copy\n0. Back\nChoice: ");
+        scanf("%d", &choice); 
+        while(getchar()!='\n'); // Buffer temizliği
+
+        switch(choice) {
+            case 1: {
+                // Buffer boyutlarını güvenli hale getirdik (9 -> 20)
+                char id[20], name[MAX_NAME_LEN], sur[MAX_NAME_LEN]; 
+                
+                printf("ID: "); 
+                fgets(id, sizeof(id), stdin); 
+                id[strcspn(id, "\n")] = 0;
+
+                printf("Name: "); 
+                fgets(name, sizeof(name), stdin); 
+                name[strcspn(name, "\n")] = 0;
+
+                printf("Surname: "); 
+                fgets(sur, sizeof(sur), stdin); 
+                sur[strcspn(sur, "\n")] = 0;
+
+                char qName[JOURNAL_FIELD_LEN], qSur[JOURNAL_FIELD_LEN], record[JOURNAL_RECORD_LEN];
+                int len = storageFormat(record, "s,%.8s,%s,%s\n", id, journalQuote(qName, name), journalQuote(qSur, sur));
+                if (!menuRecordFits(len)) break;
+                pthread_rwlock_wrlock(&libraryLock);
+                *sHead = addStudent(*sHead, id, name, sur);
+                unsigned long seq = storageApply(record, len);
+                pthread_rwlock_unlock(&libraryLock);
+                menuCommit(seq);
+                break;
+            }
+            case 2: {
+                char id[20]; // Burayı da arttırdık
+                printf("ID to delete: "); 
+                fgets(id, sizeof(id), stdin); 
+                id[strcspn(id, "\n")] = 0;
+                
+                char record[JOURNAL_RECORD_LEN];
+                int len = storageFormat(record, "x,%s\n", id);
+                if (!menuRecordFits(len)) break;
+                pthread_rwlock_wrlock(&libraryLock);
+                int rc = deleteStudent(sHead, id);
+                unsigned long seq = rc == DELETE_OK ? storageApply(record, len) : 0;
+                pthread_rwlock_unlock(&libraryLock);
+                if (rc == DELETE_OK) menuCommit(seq);
+                else if (rc == DELETE_ERR_ON_LOAN) printf("Error: Student still has borrowed books.\n");
+                else printf("Student not found.\n");
+                break;
+            }
+            case 3: {
+                Student* t = *sHead;
+                printf("ID\tName\tScore\n");
+                while(t){ 
+                    printf("%s\t%s %s\t%d\n", t->studentId, t->name, t->surname, t->score); 
+                    t=t->next; 
+                }
+                break;
+            }
+            case 4: {
+                int op;
+                // KRİTİK DÜZELTME BURADA: sId[9] yerine sId[20] yaptık
+                char sId[20], info[50], date[20]; 
+                
+                printf("1. Borrow\n2. Return\n3. Place Hold\nSelect: "); 
+                scanf("%d", &op); 
+                while(getchar()!='\n'); // scanf sonrası temizlik
+
+                printf("Student ID: "); 
+                fgets(sId, sizeof(sId), stdin); 
+                sId[strcspn(sId, "\n")] = 0;
+
+                if(op==1 || op==3) { 
+                    printf("Book ISBN: "); 
+                    fgets(info, sizeof(info), stdin); 
+                    info[strcspn(info, "\n")] = 0; 
+                }
+                else { 
+                    printf("Label (ISBN_1): "); 
+                    fgets(info, sizeof(info), stdin); 
+                    info[strcspn(info, "\n")] = 0; 
+                }
+
+                printf("Date (DD.MM.YYYY): "); 
+                fgets(date, sizeof(date), stdin); 
+                date[strcspn(date, "\n")] = 0;
+                
+                unsigned long seq = 0;
+                int rc;
+                pthread_rwlock_rdlock(&libraryLock);
+                if(op==1) rc = processLoan(sHead, lHead, sId, info, date, NULL, &seq);
+                else if(op==2) rc = processReturn(sHead, lHead, sId, info, date, &seq);
+                else rc = placeHold(sHead, sId, info, date, &seq);
+                pthread_rwlock_unlock(&libraryLock);
+                int saved = rc == LOAN_OK && menuCommit(seq);
+                if (op == 2 && saved) printf("Book returned successfully.\n");
+                if (op == 3) {
+                    if (saved) printf("Hold placed; the next returned copy goes to the first student in line.\n");
+                    else if (rc != LOAN_OK) printf("Error: %s\n", loanStatusMessage(rc));
+                }
+                break;
+            }
+            case 5: {
+                char key[LABEL_LEN], from[20], to[20];
+                printf("Student ID or Label: ");
+                fgets(key, sizeof(key), stdin);
+                key[strcspn(key, "\n")] = 0;
+                printf("From (DD.MM.YYYY): ");
+                fgets(from, sizeof(from), stdin);
+                from[strcspn(from, "\n")] = 0;
+                printf("To (DD.MM.YYYY): ");
+                fgets(to, sizeof(to), stdin);
+                to[strcspn(to, "\n")] = 0;
+
+                int fromDay = dateToDayNumber(from), toDay = dateToDayNumber(to);
+                if (fromDay < 0 || toDay < 0) {
+                    printf("Error: Invalid date.\n");
+                    break;
+                }
+                LoanTransaction* rows = NULL;
+                pthread_rwlock_rdlock(&libraryLock);
+                int n = queryLoanHistory(lHead, key, fromDay, toDay, &rows);
+                pthread_rwlock_unlock(&libraryLock);
+                printf("Date\t\tStudent\t\tLabel\t\t\tOperation\n");
+                for (int k = 0; k < n; k++) {
+                    printf("%s\t%s\t%s\t%s\n", rows[k].date, rows[k].studentId, rows[k].bookLabelNo,
+                           rows[k].operationType == OP_TYPE_BORROW ? "Borrow" : "Return");
+                }
+                free(rows);
+                break;
+            }
+            case 6: {
+                char key[LABEL_LEN], from[20], to[20];
+                printf("Label or Student ID: ");
+                fgets(key, sizeof(key), stdin);
+                key[strcspn(key, "\n")] = 0;
+                printf("On / From (DD.MM.YYYY): ");
+                fgets(from, sizeof(from), stdin);
+                from[strcspn(from, "\n")] = 0;
+                printf("To (empty = same day): ");
+                fgets(to, sizeof(to), stdin);
+                to[strcspn(to, "\n")] = 0;
+
+                int fromDay = dateToDayNumber(from), toDay = to[0] ? dateToDayNumber(to) : fromDay;
+                if (fromDay < 0 || toDay < 0) {
+                    printf("Error: Invalid date.\n");
+                    break;
+                }
+                LoanInterval* rows = NULL;
+                intervalIndexEnsure(lHead);
+                pthread_rwlock_rdlock(&libraryLock);
+                int n = queryLoanIntervals(lHead, key, fromDay, toDay, &rows);
+                pthread_rwlock_unlock(&libraryLock);
+                if (!n) printf("No loans in that period.\n");
+                else printf("Label\t\t\tStudent\t\tBorrowed\tReturned\n");
+                for (int k = 0; k < n; k++) {
+                    char start[DATE_STR_LEN], end[DATE_STR_LEN] = "-";
+                    formatDayNumber(rows[k].start, start, sizeof(start));
+                    if (rows[k].end != INTERVAL_OPEN) formatDayNumber(rows[k].end, end, sizeof(end));
+                    printf("%s\t%s\t%s\t%s\n", rows[k].label, rows[k].studentId, start, end);
+                }
+                free(rows);
+                break;
+            }
+        }
+    } while(choice!=0);
+}
+
+// --- BOOK AUTHOR LINKING MENU ---
+
+void menuLinkBookAuthor(Book* bHead, Author* aHead, BookAuthorMap** map, int* count) {
+    char isbn[14];
+    int authorId;
+
+    printf("\n--- Available Books ---\n");
+    Book* bTmp = bHead;
+    while(bTmp) {
+        printf("ISBN: %s | Title: %s\n", bTmp->isbn, bTmp->title);
+        bTmp = bTmp->next;
+    }
+
+    printf("\nEnter Book ISBN to Link: ");
+    fgets(isbn, sizeof(isbn), stdin);
+    isbn[strcspn(isbn, "\n")] = 0;
+
+    printf("\n--- Available Authors ---\n");
+    listAuthors(aHead); 
+
+    printf("\nEnter Author ID: ");
+    scanf("%d", &authorId);
+    while(getchar()!='\n'); 
+
+    char record[JOURNAL_RECORD_LEN];
+    int len = storageFormat(record, "l,%s,%d\n", isbn, authorId);
+    if (!menuRecordFits(len)) return;
+    pthread_rwlock_wrlock(&libraryLock);
+    int linked = addBookAuthorRelation(map, count, isbn, authorId);
+    unsigned long seq = linked ? storageApply(record, len) : 0;
+    pthread_rwlock_unlock(&libraryLock);
+    if (linked) {
+        if (menuCommit(seq)) printf("Success: Book linked to Author.\n");
+    } else {
+        printf("Error: Book not found, relation already exists or memory error.\n");
+    }
+}
+
+// Prints books from start in title order, one page at a time. Stops
+// after the titles that begin with (or sort before) last, if given.
+void listBookPages(Book* start, const char* last) {
+    size_t lastLen = last ? strlen(last) : 0;
+    int shown = 0;
+    for (Book* tmp = start; tmp; tmp = tmp->next) {
+        if (last && strncmp(tmp->title, last, lastLen) > 0) break;
+        printf("%s (ISBN: %s) Qty: %d\n", tmp->title, tmp->isbn, tmp->quantity);
+        if (++shown % TITLE_PAGE_SIZE == 0 && tmp->next) {
+            char answer[8];
+            printf("-- Enter for more, q to stop -- ");
+            if (!fgets(answer, sizeof(answer), stdin) || answer[0] == 'q') break;
+        }
+    }
+    if (!shown) printf("No books found.\n");
+}
+
+void menuBooks(Book** head, Author* aHead, BookAuthorMap** map, int* count) {
+    int choice;
+    do {
+        printf("\n--- Book Menu ---\n");
         printf("1. Add Book\n");
         printf("2. Delete Book\n");
         printf("3. List Books\n");
         printf("4. Assign Author to Book\n"); 
+        printf("5. List Titles in Range\n");
+        printf("6. Hold Queues\n");
+        printf("7. Update Book\n");
+        printf("8. Check Reading List\n");
         printf("0. Back\n");
         printf("Choice: ");
         scanf("%d", &choice); 
         while(getchar()!='\n');
 
-        switch(choice) {
-            case 1: {
-                char t[50], i[14]; int q;
-                printf("Title: "); fgets(t,50,stdin); t[strcspn(t,"\n")]=0;
-                printf("ISBN: "); fgets(i,14,stdin); i[strcspn(i,"\n")]=0;
-                printf("Quantity: "); scanf("%d", &q);
-                Book* n = NULL;
-                *head = addBook(*head, t, i, q, &n);
-                saveBooksToFile(*head, FILE_BOOKS);
-                if(n) saveBookCopiesToFile(*head, FILE_COPIES);
-                break;
+        switch(choice) {
+            case 1: {
+                char t[MAX_NAME_LEN], i[14]; int q;
+                printf("Title: "); fgets(t,MAX_NAME_LEN,stdin); t[strcspn(t,"\n")]=0;
+                printf("ISBN: "); fgets(i,14,stdin); i[strcspn(i,"\n")]=0;
+                printf("Quantity: "); scanf("%d", &q);
+                Book* n = NULL;
+                char qt[JOURNAL_FIELD_LEN], record[JOURNAL_RECORD_LEN];
+                int len = storageFormat(record, "k,%s,%d,%s\n", i, q, journalQuote(qt, t));
+                if (!menuRecordFits(len)) break;
+                pthread_rwlock_wrlock(&libraryLock);
+                int exists = catalogFind(i) != NULL;
+                if (!exists) *head = addBook(*head, t, i, q, &n);
+                unsigned long seq = n ? storageApply(record, len) : 0;
+                pthread_rwlock_unlock(&libraryLock);
+                if(n) menuCommit(seq);
+                else if (exists) printf("Error: A book with this ISBN already exists.\n");
+                else printf("Error: Quantity cannot be negative.\n");
+                break;
+            }
+            case 2: {
+                char i[14]; printf("ISBN: "); fgets(i,14,stdin); i[strcspn(i,"\n")]=0;
+                char record[JOURNAL_RECORD_LEN];
+                int len = storageFormat(record, "K,%s\n", i);
+                if (!menuRecordFits(len)) break;
+                pthread_rwlock_wrlock(&libraryLock);
+                int rc = deleteBook(head, i, map, count);
+                unsigned long seq = rc == DELETE_OK ? storageApply(record, len) : 0;
+                pthread_rwlock_unlock(&libraryLock);
+                if (rc == DELETE_OK) menuCommit(seq);
+                else if (rc == DELETE_ERR_ON_LOAN) printf("Error: Copies of this book are still borrowed.\n");
+                else printf("Book not found.\n");
+                break;
+            }
+            case 3: {
+                char from[MAX_NAME_LEN];
+                printf("Start at title (empty = first): "); fgets(from,MAX_NAME_LEN,stdin); from[strcspn(from,"\n")]=0;
+                listBookPages(titleIndexSeek(*head, from), NULL);
+                break;
+            }
+            case 4: {
+                // YENİ EKLENEN EŞLEŞTİRME MENÜSÜ ÇAĞRISI
+                menuLinkBookAuthor(*head, aHead, map, count);
+                break;
+            }
+            case 5: {
+                char from[MAX_NAME_LEN], to[MAX_NAME_LEN];
+                printf("From title: "); fgets(from,MAX_NAME_LEN,stdin); from[strcspn(from,"\n")]=0;
+                printf("To title: "); fgets(to,MAX_NAME_LEN,stdin); to[strcspn(to,"\n")]=0;
+                listBookPages(titleIndexSeek(*head, from), to);
+                break;
+            }
+            case 6: {
+                QueueLength* rows = NULL;
+                int n = collectQueueLengths(*head, &rows);
+                if (!n) printf("No students are waiting.\n");
+                for (int k = 0; k < n; k++) {
+                    printf("%s (ISBN: %s) Qty: %d, %d waiting\n", rows[k].book->title, rows[k].book->isbn,
+                           rows[k].book->quantity, rows[k].count);
+                }
+                free(rows);
+                break;
+            }
+            case 7: {
+                char i[20], t[MAX_NAME_LEN]; int q = -1;
+                printf("ISBN: "); fgets(i,sizeof(i),stdin); i[strcspn(i,"\n")]=0;
+                printf("New Title: "); fgets(t,MAX_NAME_LEN,stdin); t[strcspn(t,"\n")]=0;
+                printf("New Quantity: "); scanf("%d", &q); while(getchar()!='\n');
+                char qt[JOURNAL_FIELD_LEN], record[JOURNAL_RECORD_LEN];
+                int len = storageFormat(record, "u,%s,%d,%s\n", i, q, journalQuote(qt, t));
+                if (!menuRecordFits(len)) break;
+                pthread_rwlock_wrlock(&libraryLock);
+                int rc = updateBook(head, i, t, q);
+                unsigned long seq = rc == DELETE_OK ? storageApply(record, len) : 0;
+                pthread_rwlock_unlock(&libraryLock);
+                if (rc == DELETE_OK) menuCommit(seq);
+                else if (rc == DELETE_ERR_ON_LOAN) printf("Error: Copies above the new quantity are still borrowed.\n");
+                else printf("Book not found.\n");
+                break;
+            }
+            case 8: {
+                char line[SERVER_LINE_LEN * 8];
+                printf("ISBNs or labels (space separated), or @file: ");
+                fgets(line,sizeof(line),stdin); line[strcspn(line,"\n")]=0;
+                if (line[0] == '@') {
+                    runAvailabilityReport(line + 1);
+                    break;
+                }
+                char** keys = NULL;
+                int n = splitKeys(line, &keys);
+                AvailabilityBatch batch;
+                pthread_rwlock_rdlock(&libraryLock);
+                if (availabilityLookup(keys, n, &batch)) printAvailability(&batch);
+                pthread_rwlock_unlock(&libraryLock);
+                availabilityFree(&batch);
+                free(keys);
+                break;
+            }
+        }
+    } while(choice!=0);
+}
+
+// Summary, or the counters of one book (ISBN) or student (ID)
+void menuStatistics(Library* lib) {
+    char key[ISBN_LEN + 6];
+    printf("ISBN, student ID or T for loan trends (empty = summary): ");
+    fgets(key, sizeof(key), stdin); key[strcspn(key, "\n")] = 0;
+
+    if (strcmp(key, "T") == 0 || strcmp(key, "t") == 0) {
+        char from[20], to[20];
+        printf("From (DD.MM.YYYY): ");
+        fgets(from, sizeof(from), stdin); from[strcspn(from, "\n")] = 0;
+        printf("To (DD.MM.YYYY): ");
+        fgets(to, sizeof(to), stdin); to[strcspn(to, "\n")] = 0;
+        int fromDay = dateToDayNumber(from), toDay = dateToDayNumber(to);
+        LoanTrends trends;
+        if (fromDay < 0 || toDay < 0) {
+            printf("Error: Invalid date.\n");
+            return;
+        }
+        pthread_rwlock_rdlock(&libraryLock);
+        if (!collectLoanTrends(&lib->loans, fromDay, toDay, &trends)) {
+            pthread_rwlock_unlock(&libraryLock);
+            printf("Error: Invalid range.\n");
+            return;
+        }
+        printf("Month\t\tBorrows\tReturns\n");
+        for (int i = 0; i < trends.monthCount; i++) {
+            int month = trends.firstMonth + i;
+            printf("%04d-%02d\t\t%ld\t%ld\n", month / 12, month % 12 + 1, trends.volumes[i * 2], trends.volumes[i * 2 + 1]);
+        }
+        printf("Most borrowed in range:\n");
+        for (int i = 0; i < trends.topCount; i++) {
+            Book* b = catalogFind(trends.top[i].isbn);
+            printf("%2d. %s (ISBN: %s) %ld loans\n", i + 1, b ? b->title : "-", trends.top[i].isbn, trends.top[i].count);
+        }
+        pthread_rwlock_unlock(&libraryLock);
+        free(trends.volumes);
+        return;
+    }
+
+    if (key[0]) {
+        Book* book = catalogFind(key);
+        Student* student = book ? NULL : findStudent(lib->students, key);
+        if (book) {
+            printf("%s (ISBN: %s): borrowed %d times, %d of %d copies out, %d waiting\n",
+                   book->title, book->isbn, book->borrowCount, book->checkedOut, book->quantity,
+                   book->holds ? book->holds->count : 0);
+        } else if (student) {
+            printf("%s %s (%s): %d active loans, score %d\n",
+                   student->name, student->surname, student->studentId, student->activeLoans, student->score);
+        } else {
+            printf("No book or student with that key.\n");
+        }
+        return;
+    }
+
+    CirculationStats st;
+    statsRead(&st);
+    long closed = 0;
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) closed += st.durations[i];
+    printf("Loans: %ld  Returns: %ld  Out now: %ld\n", st.loans, st.returns, st.loans - st.returns);
+    printf("Average loan: %.1f days\n", closed ? (double)st.loanDays / closed : 0.0);
+    printf("Loan durations (days):");
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) printf("  %s: %ld", durationLabels[i], st.durations[i]);
+    printf("\nPenalties: %ld (%ld points)\n", st.penalties, st.penaltyPoints);
+    printf("Most borrowed:\n");
+    for (int i = 0; i < st.topCount; i++) {
+        printf("%2d. %s (ISBN: %s) %d loans\n", i + 1, st.top[i]->title, st.top[i]->isbn, st.top[i]->borrowCount);
+    }
+}
+
+// --- MEMORY CLEANUP ---
+void freeBookCopies(BookCopy* head) {
+    BookCopy* tmp;
+    while (head) { tmp = head; head = head->next; free(tmp); }
+}
+void freeBookList(Book* head) {
+    Book* tmp;
+    while (head) { catalogRemove(head); freeBookCopies(head->copies); freeHolds(head); free(head->authorRows); free(head->skip); tmp = head; head = head->next; free(tmp); }
+    titleIndexClear();
+}
+void freeAuthorList(Author* head) {
+    Author* tmp;
+    while(head){ tmp=head; head=head->next; free(tmp); }
+}
+void freeStudentList(Student* head) {
+    Student* tmp;
+    while(head){ tmp=head; head=head->next; free(tmp); }
+}
+void freeLoanList(LoanTransaction* head) {
+    LoanTransaction* tmp;
+    while(head){ tmp=head; head=head->next; free(tmp); }
+}
+
+// --- LIBRARY STATE ---
+
+// Splits a record body into r->fields, undoing journalQuote in place
+static int journalFields(CsvReader* r, char* body) {
+    memset(r, 0, sizeof(*r));
+    r->data = body;
+    r->size = strlen(body);
+    return csvNextRecord(r);
+}
+
+// Re-applies the records written after the last checkpoint.
+// A torn final record (no newline) is ignored.
+int replayJournal(Library* lib, const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+    char line[JOURNAL_RECORD_LEN];
+    int applied = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strchr(line, '\n')) break;
+        char sId[STUDENT_ID_LEN], label[LABEL_LEN], date[DATE_STR_LEN];
+        char name[MAX_NAME_LEN], surname[MAX_NAME_LEN], isbn[ISBN_LEN];
+        int num = 0;
+        char* body = line + 2;
+        CsvReader rec;
+        switch (line[0]) {
+            case 'B':
+            case 'R': {
+                if (sscanf(body, "%8[^,],%29[^,],%10[^,\n],%d", sId, label, date, &num) < 3) continue;
+                Book* book = catalogFindN(label, isbnLengthOfLabel(label));
+                BookCopy* copy = book ? book->copies : NULL;
+                while (copy && strcmp(copy->labelNo, label) != 0) copy = copy->next;
+                if (!copy) continue;
+                Student* student = findStudent(lib->students, sId);
+                if (line[0] == 'B') {
+                    strncpy(copy->borrowerStudentId, sId, STUDENT_ID_LEN);
+                    statsRecordLoan(book, student);
+                    holdRemove(book, sId);
+                    openLoan(student, copy, addLoanTransaction(&lib->loans, sId, label, OP_TYPE_BORROW, date));
+                } else {
+                    char* borrowDate = copy->loan ? copy->loan->date : findBorrowDate(lib->loans, sId, label);
+                    if (student) student->score -= num;
+                    strcpy(copy->borrowerStudentId, "SHELF");
+                    closeLoan(student, copy);
+                    statsRecordReturn(book, student, borrowDate ? getDaysDifference(borrowDate, date) : -1, num);
+                    addLoanTransaction(&lib->loans, sId, label, OP_TYPE_RETURN, date);
+                }
+                break;
+            }
+            case 'a':
+                if (journalFields(&rec, body) != 2) continue;
+                csvCopy(rec.fields[0], name, sizeof(name));
+                csvCopy(rec.fields[1], surname, sizeof(surname));
+                addAuthor(&lib->authors, name, surname);
+                break;
+            case 'd':
+                if (sscanf(body, "%d", &num) != 1) continue;
+                lib->authors = deleteAuthor(lib->authors, num, &lib->mapArr, &lib->mapCount);
+                break;
+            case 's':
+                if (journalFields(&rec, body) != 3) continue;
+                csvCopy(rec.fields[0], sId, sizeof(sId));
+                csvCopy(rec.fields[1], name, sizeof(name));
+                csvCopy(rec.fields[2], surname, sizeof(surname));
+                lib->students = addStudent(lib->students, sId, name, surname);
+                break;
+            case 'x':
+                if (sscanf(body, "%8[^\n]", sId) != 1) continue;
+                if (deleteStudent(&lib->students, sId) != DELETE_OK) continue;
+                break;
+            case 'k': {
+                char title[MAX_NAME_LEN];
+                Book* n = NULL;
+                if (journalFields(&rec, body) != 3 || !csvInt(rec.fields[1], &num)) continue;
+                csvCopy(rec.fields[0], isbn, sizeof(isbn));
+                csvCopy(rec.fields[2], title, sizeof(title));
+                lib->books = addBook(lib->books, title, isbn, num, &n);
+                break;
+            }
+            case 'K':
+                if (sscanf(body, "%13[^\n]", isbn) != 1) continue;
+                if (deleteBook(&lib->books, isbn, &lib->mapArr, &lib->mapCount) != DELETE_OK) continue;
+                break;
+            case 'u': {
+                char title[MAX_NAME_LEN];
+                if (journalFields(&rec, body) != 3 || !csvInt(rec.fields[1], &num)) continue;
+                csvCopy(rec.fields[0], isbn, sizeof(isbn));
+                csvCopy(rec.fields[2], title, sizeof(title));
+                if (updateBook(&lib->books, isbn, title, num) != DELETE_OK) continue;
+                break;
+            }
+            case 'h':
+            case 'H': {
+                if (sscanf(body, "%8[^,],%13[^,\n],%10[^,\n]", sId, isbn, date) < 2) continue;
+                Book* book = catalogFind(isbn);
+                if (!book) continue;
+                if (line[0] == 'h') holdEnqueue(book, sId, date);
+                else holdRemove(book, sId);
+                break;
+            }
+            case 'l':
+                if (sscanf(body, "%13[^,],%d", isbn, &num) != 2) continue;
+                addBookAuthorRelation(&lib->mapArr, &lib->mapCount, isbn, num);
+                break;
+            default:
+                continue;
+        }
+        applied++;
+    }
+    fclose(fp);
+    if (applied) printf("Recovered %d transactions from %s\n", applied, path);
+    return applied;
+}
+
+// Replays the rotated files of the journal at base, oldest first, and
+// then the live journal
+int replayJournalGenerations(Library* lib, const char* base) {
+    char path[sizeof(journal.path) + 16];
+    int applied = 0, generations = journalGenerationCount(base);
+    for (int generation = 1; generation <= generations; generation++) {
+        journalGenerationPath(path, sizeof(path), base, generation);
+        applied += replayJournal(lib, path);
+    }
+    return applied + replayJournal(lib, base);
+}
+
+// Loads whichever snapshot the last checkpoint wrote (library.bin or the
+// CSV files), then replays the journal. Shared by the journaled engines,
+// so the engine can be switched between runs.
+void snapshotLoadAll(Library* lib) {
+    if (access(FILE_LIBRARY_BIN, F_OK) == 0 && binaryLoad(lib)) {
+        replayJournalGenerations(lib, FILE_JOURNAL);
+        dropArchivedHistory(lib);
+        return;
+    }
+    lib->lastAuthorID = 0;
+    lib->authors = loadAuthorsFromFile(&lib->lastAuthorID);
+    lib->students = loadStudentsFromFile();
+    // Load books and then load copies into them
+    lib->books = loadBooksFromFile(FILE_BOOKS, FILE_COPIES);
+    loadBookCopiesFromFile(FILE_COPIES);
+
+    lib->loans = loadLoansFromFile();
+
+    lib->mapCount = 0;
+    lib->mapArr = loadBookAuthorMap(&lib->mapCount);
+    indexBookAuthorMap(lib->mapArr, &lib->mapCount);
+    linkOpenLoans(lib);
+    loadHoldsFromFile(FILE_HOLDS);
+    loadStatistics(lib);
+
+    replayJournalGenerations(lib, FILE_JOURNAL);
+    dropArchivedHistory(lib);
+}
+
+void loadLibrary(Library* lib) {
+    storage->loadAll(lib);
+}
+
+void saveLibrary(Library* lib) {
+    checkpointLibrary(lib);
+}
+
+void freeLibrary(Library* lib) {
+    freeAuthorList(lib->authors);
+    freeStudentList(lib->students);
+    freeBookList(lib->books);
+    freeLoanList(lib->loans);
+    if (lib->mapArr) free(lib->mapArr);
+    statsReset();
+    intervalIndexReset();
+}
+
+// --- STORAGE ENGINES ---
+// csv:    one CSV file per table plus the journal (default)
+// binary: one binary snapshot, library.bin, plus the same journal. Rows
+//         are fixed-size or length-prefixed, so loading does no parsing.
+// memory: nothing is read or written; for tests and benchmarks.
+// Each checkpoint removes the other format's snapshot, so the journaled
+// engines can be switched between runs.
+
+typedef struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t authors;
+    uint32_t students;
+    uint32_t books;
+    uint32_t mapRows;
+    uint32_t loans;
+    int64_t counters[5 + STATS_DURATION_BUCKETS]; // loans, returns, penalties, penaltyPoints, loanDays, durations
+} BinaryHeader;
+
+typedef struct BinaryLoan {
+    char studentId[STUDENT_ID_LEN];
+    char label[ISBN_LEN + 5];
+    char date[DATE_STR_LEN];
+    char op;
+} BinaryLoan;
+
+typedef struct BinaryCursor {
+    const char* p; // NULL once a read ran past the end
+    const char* end;
+} BinaryCursor;
+
+static void binPutU32(CsvWriter* w, uint32_t v) {
+    csvPutBytes(w, (const char*)&v, sizeof(v));
+}
+
+static void binPutStr(CsvWriter* w, const char* s) {
+    size_t len = strlen(s);
+    uint16_t n = (uint16_t)(len < 0xffff ? len : 0xffff);
+    csvPutBytes(w, (const char*)&n, sizeof(n));
+    csvPutBytes(w, s, n);
+}
+
+static const char* binTake(BinaryCursor* c, size_t n) {
+    if (!c->p || (size_t)(c->end - c->p) < n) {
+        c->p = NULL;
+        return NULL;
+    }
+    const char* at = c->p;
+    c->p += n;
+    return at;
+}
+
+static uint32_t binU32(BinaryCursor* c) {
+    uint32_t v = 0;
+    const char* at = binTake(c, sizeof(v));
+    if (at) memcpy(&v, at, sizeof(v));
+    return v;
+}
+
+static const char* binStr(BinaryCursor* c, size_t* len) {
+    uint16_t n = 0;
+    const char* at = binTake(c, sizeof(n));
+    if (at) memcpy(&n, at, sizeof(n));
+    *len = n;
+    return binTake(c, n);
+}
+
+// Copies a fixed-size field and terminates it
+static void binCopy(char* dst, const char* src, size_t size) {
+    memcpy(dst, src, size);
+    dst[size - 1] = '\0';
+}
+
+static int binaryWriteSnapshot(Snapshot* snap) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s%s", FILE_LIBRARY_BIN, CHECKPOINT_TMP_SUFFIX);
+    CsvWriter w;
+    if (!csvWriterOpen(&w, tmp, 0)) return 0;
+
+    BinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BINARY_MAGIC, sizeof(h.magic));
+    h.version = BINARY_VERSION;
+    h.authors = (uint32_t)snap->authorCount;
+    h.students = (uint32_t)snap->studentCount;
+    h.books = (uint32_t)snap->bookCount;
+    h.mapRows = (uint32_t)snap->mapCount;
+    for (LoanTransaction* t = snap->loans; t; t = t->next) h.loans++;
+    long counters[] = { snap->stats.loans, snap->stats.returns, snap->stats.penalties,
+                        snap->stats.penaltyPoints, snap->stats.loanDays };
+    for (int i = 0; i < 5; i++) h.counters[i] = counters[i];
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) h.counters[5 + i] = snap->stats.durations[i];
+    csvPutBytes(&w, (const char*)&h, sizeof(h));
+
+    for (int i = 0; i < snap->authorCount; i++) {
+        binPutU32(&w, (uint32_t)snap->authors[i].id);
+        binPutStr(&w, snap->authors[i].name);
+        binPutStr(&w, snap->authors[i].surname);
+    }
+    for (int i = 0; i < snap->studentCount; i++) {
+        csvPutBytes(&w, snap->students[i].studentId, STUDENT_ID_LEN);
+        binPutU32(&w, (uint32_t)snap->students[i].score);
+        binPutStr(&w, snap->students[i].name);
+        binPutStr(&w, snap->students[i].surname);
+    }
+    for (int i = 0; i < snap->bookCount; i++) {
+        Book* b = &snap->books[i];
+        csvPutBytes(&w, b->isbn, ISBN_LEN);
+        binPutU32(&w, (uint32_t)b->quantity);
+        binPutU32(&w, (uint32_t)b->borrowCount);
+        binPutStr(&w, b->title);
+        uint32_t copies = 0;
+        for (BookCopy* c = b->copies; c; c = c->next) copies++;
+        binPutU32(&w, copies);
+        for (BookCopy* c = b->copies; c; c = c->next) csvPutBytes(&w, c->borrowerStudentId, STUDENT_ID_LEN);
+        binPutU32(&w, b->holds ? (uint32_t)b->holds->count : 0);
+        for (Hold* hold = b->holds ? b->holds->head : NULL; hold; hold = hold->next) {
+            csvPutBytes(&w, hold->studentId, STUDENT_ID_LEN);
+            csvPutBytes(&w, hold->date, DATE_STR_LEN);
+        }
+    }
+    for (int i = 0; i < snap->mapCount; i++) {
+        csvPutBytes(&w, snap->map[i].bookISBN, ISBN_LEN);
+        binPutU32(&w, (uint32_t)snap->map[i].authorID);
+    }
+    for (LoanTransaction* t = snap->loans; t; t = t->next) {
+        BinaryLoan row;
+        memcpy(row.studentId, t->studentId, STUDENT_ID_LEN);
+        memcpy(row.label, t->bookLabelNo, sizeof(row.label));
+        memcpy(row.date, t->date, DATE_STR_LEN);
+        row.op = (char)t->operationType;
+        csvPutBytes(&w, (const char*)&row, sizeof(row));
+    }
+
+    if (!csvWriterClose(&w) || rename(tmp, FILE_LIBRARY_BIN) != 0) {
+        unlink(tmp);
+        return 0;
+    }
+    syncDirectory();
+    return 1;
+}
+
+// Walks library.bin. Without lib the file is only validated, so a
+// damaged snapshot is rejected before anything is built.
+static int binaryParse(const char* data, size_t size, Library* lib) {
+    BinaryCursor c = { data, data + size };
+    BinaryHeader h;
+    const char* at = binTake(&c, sizeof(h));
+    if (!at) return 0;
+    memcpy(&h, at, sizeof(h));
+    if (memcmp(h.magic, BINARY_MAGIC, sizeof(h.magic)) != 0 || h.version != BINARY_VERSION) return 0;
+    if (lib) memset(lib, 0, sizeof(*lib));
+
+    Author* authorTail = NULL;
+    for (uint32_t i = 0; i < h.authors; i++) {
+        size_t nameLen, surnameLen;
+        int id = (int)binU32(&c);
+        const char* name = binStr(&c, &nameLen);
+        const char* surname = binStr(&c, &surnameLen);
+        if (!c.p) return 0;
+        if (!lib) continue;
+        Author* a = (Author*)malloc(sizeof(Author));
+        if (!a) return 0;
+        a->id = id;
+        a->name = internStringN(name, nameLen);
+        a->surname = internStringN(surname, surnameLen);
+        a->next = NULL;
+        if (authorTail) authorTail->next = a;
+        else lib->authors = a;
+        authorTail = a;
+        if (id > lib->lastAuthorID) lib->lastAuthorID = id;
+    }
+
+    // Snapshot order is already sorted by ID
+    Student* studentTail = NULL;
+    for (uint32_t i = 0; i < h.students; i++) {
+        size_t nameLen, surnameLen;
+        const char* id = binTake(&c, STUDENT_ID_LEN);
+        int score = (int)binU32(&c);
+        const char* name = binStr(&c, &nameLen);
+        const char* surname = binStr(&c, &surnameLen);
+        if (!c.p) return 0;
+        if (!lib) continue;
+        Student* st = (Student*)calloc(1, sizeof(Student));
+        if (!st) return 0;
+        binCopy(st->studentId, id, STUDENT_ID_LEN);
+        st->score = score;
+        st->name = internStringN(name, nameLen);
+        st->surname = internStringN(surname, surnameLen);
+        st->prev = studentTail;
+        if (studentTail) studentTail->next = st;
+        else lib->students = st;
+        studentTail = st;
+    }
+
+    for (uint32_t i = 0; i < h.books; i++) {
+        size_t titleLen;
+        char isbn[ISBN_LEN];
+        at = binTake(&c, ISBN_LEN);
+        int qty = (int)binU32(&c);
+        int borrowed = (int)binU32(&c);
+        const char* title = binStr(&c, &titleLen);
+        uint32_t copies = binU32(&c);
+        const char* borrowers = binTake(&c, (size_t)copies * STUDENT_ID_LEN);
+        uint32_t holds = binU32(&c);
+        const char* holdRows = binTake(&c, (size_t)holds * (STUDENT_ID_LEN + DATE_STR_LEN));
+        if (!c.p) return 0;
+        if (!lib) continue;
+        binCopy(isbn, at, ISBN_LEN);
+        Book* book = NULL;
+        lib->books = addBook(lib->books, internStringN(title, titleLen), isbn, qty, &book);
+        if (!book) continue;
+        book->borrowCount = borrowed;
+        // addBook numbers copies the same way, so they line up in order
+        BookCopy* copy = book->copies;
+        for (uint32_t k = 0; k < copies && copy; k++, copy = copy->next)
+            binCopy(copy->borrowerStudentId, borrowers + (size_t)k * STUDENT_ID_LEN, STUDENT_ID_LEN);
+        for (uint32_t k = 0; k < holds; k++) {
+            char sId[STUDENT_ID_LEN], date[DATE_STR_LEN];
+            const char* row = holdRows + (size_t)k * (STUDENT_ID_LEN + DATE_STR_LEN);
+            binCopy(sId, row, STUDENT_ID_LEN);
+            binCopy(date, row + STUDENT_ID_LEN, DATE_STR_LEN);
+            holdEnqueue(book, sId, date);
+        }
+    }
+
+    const char* mapRows = binTake(&c, (size_t)h.mapRows * (ISBN_LEN + sizeof(uint32_t)));
+    const char* loanRows = binTake(&c, (size_t)h.loans * sizeof(BinaryLoan));
+    if (!c.p || c.p != c.end) return 0;
+    if (!lib) return 1;
+
+    lib->mapArr = (BookAuthorMap*)malloc(sizeof(BookAuthorMap) * (h.mapRows ? h.mapRows : 1));
+    if (!lib->mapArr) return 0;
+    for (uint32_t i = 0; i < h.mapRows; i++) {
+        const char* row = mapRows + (size_t)i * (ISBN_LEN + sizeof(uint32_t));
+        uint32_t authorId;
+        binCopy(lib->mapArr[i].bookISBN, row, ISBN_LEN);
+        memcpy(&authorId, row + ISBN_LEN, sizeof(authorId));
+        lib->mapArr[i].authorID = (int)authorId;
+    }
+    lib->mapCount = (int)h.mapRows;
+
+    LoanTransaction* loanTail = NULL;
+    for (uint32_t i = 0; i < h.loans; i++) {
+        BinaryLoan row;
+        memcpy(&row, loanRows + (size_t)i * sizeof(row), sizeof(row));
+        LoanTransaction* t = (LoanTransaction*)malloc(sizeof(LoanTransaction));
+        if (!t) break;
+        binCopy(t->studentId, row.studentId, STUDENT_ID_LEN);
+        binCopy(t->bookLabelNo, row.label, sizeof(t->bookLabelNo));
+        binCopy(t->date, row.date, DATE_STR_LEN);
+        t->operationType = row.op;
+        t->next = NULL;
+        if (loanTail) loanTail->next = t;
+        else lib->loans = t;
+        loanTail = t;
+    }
+
+    indexBookAuthorMap(lib->mapArr, &lib->mapCount);
+    linkOpenLoans(lib);
+    CirculationStats saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.loans = h.counters[0];
+    saved.returns = h.counters[1];
+    saved.penalties = h.counters[2];
+    saved.penaltyPoints = h.counters[3];
+    saved.loanDays = h.counters[4];
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) saved.durations[i] = h.counters[5 + i];
+    statsRestore(lib, &saved);
+    return 1;
+}
+
+// Loads library.bin. Returns 0 (and builds nothing) if it is unreadable.
+int binaryLoad(Library* lib) {
+    int fd = open(FILE_LIBRARY_BIN, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    int ok = binaryParse((const char*)map, (size_t)st.st_size, NULL);
+    if (ok) ok = binaryParse((const char*)map, (size_t)st.st_size, lib);
+    else printf("%s is damaged; loading the CSV files.\n", FILE_LIBRARY_BIN);
+    munmap(map, (size_t)st.st_size);
+    return ok;
+}
+
+static int journalOpenDefault(void) {
+    return journalOpen(FILE_JOURNAL);
+}
+
+static void memoryLoadAll(Library* lib) {
+    memset(lib, 0, sizeof(*lib));
+    statsReset();
+}
+
+static int memoryOpen(void) {
+    return 1;
+}
+
+static unsigned long memoryApply(const char* record, size_t len) {
+    (void)record;
+    (void)len;
+    return 0;
+}
+
+static void memoryClose(void) {
+}
+
+const StorageEngine csvEngine = { "csv", snapshotLoadAll, journalOpenDefault, journalAppend, csvWriteSnapshot, journalClose };
+const StorageEngine binaryEngine = { "binary", snapshotLoadAll, journalOpenDefault, journalAppend, binaryWriteSnapshot, journalClose };
+const StorageEngine memoryEngine = { "memory", memoryLoadAll, memoryOpen, memoryApply, NULL, memoryClose };
+
+const StorageEngine* storageFind(const char* name) {
+    const StorageEngine* engines[] = { &csvEngine, &binaryEngine, &memoryEngine };
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i]->name, name) == 0) return engines[i];
+    }
+    return NULL;
+}
+
+// --- SERVER MODE ---
+// Line protocol over a Unix domain socket. Each request is one line,
+// e.g. "BORROW 18011055 9780132350884 01.02.2025". Each response is
+// zero or more data lines prefixed with "* " followed by a final
+// status line starting with "OK" or "ERR".
+
+typedef struct Reply {
+    char* data;
+    size_t len;
+    size_t cap;
+} Reply;
+
+typedef struct Server {
+    Library* lib;
+    PartitionedCatalog* parts; // Kiosk mode: read-only lookups, no Library
+    int listenFd;
+    int workerCount;
+    pthread_t* workers;
+    int* activeFds;
+    int nextSlot;
+    pthread_mutex_t queueLock;
+    pthread_cond_t queueCond;
+    int queue[SERVER_QUEUE_LEN];
+    int queueHead;
+    int queueCount;
+} Server;
+
+static volatile sig_atomic_t serverStopping = 0;
+
+static void serverSignalHandler(int sig) {
+    (void)sig;
+    serverStopping = 1;
+}
+
+static void replyAppend(Reply* r, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void replyAppend(Reply* r, const char* fmt, ...) {
+    va_list ap;
+    while (1) {
+        size_t avail = r->cap - r->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(r->data + r->len, avail, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < avail) {
+            r->len += n;
+            return;
+        }
+        size_t newCap = r->cap * 2 + n;
+        char* grown = (char*)realloc(r->data, newCap);
+        if (!grown) return;
+        r->data = grown;
+        r->cap = newCap;
+    }
+}
+
+static int sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int countShelfCopies(Book* book) {
+    int n = 0;
+    BookCopy* c = book->copies;
+    while (c) {
+        if (strcmp(c->borrowerStudentId, "SHELF") == 0) n++;
+        c = c->next;
+    }
+    return n;
+}
+
+static int countShelfCopiesLocked(Book* book) {
+    CatalogShard* shard = catalogShardOf(book->isbn, ISBN_LEN);
+    pthread_mutex_lock(&shard->lock);
+    int n = countShelfCopies(book);
+    pthread_mutex_unlock(&shard->lock);
+    return n;
+}
+
+// Read-only requests run concurrently under the read lock
+static int serverHandleQuery(Server* srv, char* cmd, char* args, Reply* out) {
+    Library* lib = srv->lib;
+    if (strcmp(cmd, "FIND") == 0) {
+        CatalogShard* shard = catalogShardOf(args, strlen(args));
+        pthread_mutex_lock(&shard->lock);
+        Book* b = catalogFind(args);
+        BookCopy* c = b ? b->copies : NULL;
+        while (c && strcmp(c->borrowerStudentId, "SHELF") != 0) c = c->next;
+        if (c) replyAppend(out, "OK %s\n", c->labelNo);
+        else replyAppend(out, "ERR no copies available on shelf\n");
+        pthread_mutex_unlock(&shard->lock);
+    } else if (strcmp(cmd, "BOOK") == 0) {
+        Book* b = catalogFind(args);
+        if (!b) {
+            replyAppend(out, "ERR book not found\n");
+            return 1;
+        }
+        CatalogShard* shard = catalogShardOf(b->isbn, ISBN_LEN);
+        pthread_mutex_lock(&shard->lock);
+        replyAppend(out, "* %s,%s,%d,%d\n", b->isbn, b->title, b->quantity, countShelfCopies(b));
+        BookCopy* c = b->copies;
+        while (c) {
+            replyAppend(out, "* %s,%s\n", c->labelNo, c->borrowerStudentId);
+            c = c->next;
+        }
+        pthread_mutex_unlock(&shard->lock);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "AVAIL") == 0) {
+        char** keys = NULL;
+        int n = splitKeys(args, &keys);
+        AvailabilityBatch batch;
+        if (!availabilityLookup(keys, n, &batch)) {
+            free(keys);
+            replyAppend(out, "ERR out of memory\n");
+            return 1;
+        }
+        for (int i = 0; i < batch.count; i++) {
+            AvailabilityRow* r = &batch.rows[i];
+            if (!r->book) {
+                replyAppend(out, "* %s,not found\n", r->key);
+                continue;
+            }
+            replyAppend(out, "* %s,%s,%d,%d,", r->key, r->book->title, r->total, r->available);
+            for (int h = 0; h < r->holderCount; h++)
+                replyAppend(out, "%s%s", h ? ";" : "", batch.holders[r->holdersStart + h]);
+            replyAppend(out, "\n");
+        }
+        replyAppend(out, "OK %d of %d found\n", batch.found, batch.count);
+        availabilityFree(&batch);
+        free(keys);
+    } else if (strcmp(cmd, "BOOKS") == 0 || strcmp(cmd, "SEARCH") == 0) {
+        int searching = (cmd[0] == 'S');
+        Book* b = lib->books;
+        while (b) {
+            if (!searching || strstr(b->title, args) || strstr(b->isbn, args)) {
+                replyAppend(out, "* %s,%s,%d,%d\n", b->isbn, b->title, b->quantity, countShelfCopiesLocked(b));
+            }
+            b = b->next;
+        }
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "STUDENTS") == 0) {
+        Student* t = lib->students;
+        lockAllStudents();
+        while (t) {
+            replyAppend(out, "* %s,%s,%s,%d\n", t->studentId, t->name, t->surname, t->score);
+            t = t->next;
+        }
+        unlockAllStudents();
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "HISTORY") == 0) {
+        char key[SERVER_LINE_LEN], from[SERVER_LINE_LEN], to[SERVER_LINE_LEN];
+        if (sscanf(args, "%29s %19s %19s", key, from, to) != 3 || dateToDayNumber(from) < 0 || dateToDayNumber(to) < 0) {
+            replyAppend(out, "ERR usage: HISTORY <studentId|label> <fromDate> <toDate>\n");
+            return 1;
+        }
+        LoanTransaction* rows = NULL;
+        int n = queryLoanHistory(&lib->loans, key, dateToDayNumber(from), dateToDayNumber(to), &rows);
+        for (int i = 0; i < n; i++) {
+            replyAppend(out, "* %s,%s,%s,%s\n", rows[i].date, rows[i].studentId, rows[i].bookLabelNo,
+                        rows[i].operationType == OP_TYPE_BORROW ? "BORROW" : "RETURN");
+        }
+        free(rows);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "TRENDS") == 0) {
+        char from[SERVER_LINE_LEN], to[SERVER_LINE_LEN];
+        LoanTrends trends;
+        if (sscanf(args, "%19s %19s", from, to) != 2 || dateToDayNumber(from) < 0 || dateToDayNumber(to) < 0 ||
+            !collectLoanTrends(&lib->loans, dateToDayNumber(from), dateToDayNumber(to), &trends)) {
+            replyAppend(out, "ERR usage: TRENDS <fromDate> <toDate>\n");
+            return 1;
+        }
+        for (int i = 0; i < trends.monthCount; i++) {
+            int month = trends.firstMonth + i;
+            replyAppend(out, "* month,%04d-%02d,%ld,%ld\n", month / 12, month % 12 + 1,
+                        trends.volumes[i * 2], trends.volumes[i * 2 + 1]);
+        }
+        for (int i = 0; i < trends.topCount; i++) {
+            Book* b = catalogFind(trends.top[i].isbn);
+            replyAppend(out, "* title,%s,%s,%ld\n", trends.top[i].isbn, b ? b->title : "-", trends.top[i].count);
+        }
+        free(trends.volumes);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "HELD") == 0) {
+        char key[SERVER_LINE_LEN], from[SERVER_LINE_LEN], to[SERVER_LINE_LEN];
+        int fields = sscanf(args, "%29s %19s %19s", key, from, to);
+        int fromDay = fields >= 2 ? dateToDayNumber(from) : -1;
+        int toDay = fields == 3 ? dateToDayNumber(to) : fromDay;
+        if (fromDay < 0 || toDay < 0) {
+            replyAppend(out, "ERR usage: HELD <label|studentId> <date> [toDate]\n");
+            return 1;
+        }
+        LoanInterval* rows = NULL;
+        int n = queryLoanIntervals(&lib->loans, key, fromDay, toDay, &rows);
+        for (int i = 0; i < n; i++) {
+            char start[DATE_STR_LEN], end[DATE_STR_LEN] = "-";
+            formatDayNumber(rows[i].start, start, sizeof(start));
+            if (rows[i].end != INTERVAL_OPEN) formatDayNumber(rows[i].end, end, sizeof(end));
+            replyAppend(out, "* %s,%s,%s,%s\n", rows[i].label, rows[i].studentId, start, end);
+        }
+        free(rows);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "STATS") == 0) {
+        if (args[0]) {
+            Book* b = catalogFind(args);
+            Student* t = b ? NULL : findStudent(lib->students, args);
+            if (b) {
+                CatalogShard* shard = catalogShardOf(b->isbn, ISBN_LEN);
+                pthread_mutex_lock(&shard->lock);
+                replyAppend(out, "* %s,%s,%d,%d,%d,%d\n", b->isbn, b->title, b->borrowCount, b->checkedOut, b->quantity,
+                            b->holds ? b->holds->count : 0);
+                pthread_mutex_unlock(&shard->lock);
+            } else if (t) {
+                pthread_mutex_t* sLock = studentLockOf(t->studentId);
+                pthread_mutex_lock(sLock);
+                replyAppend(out, "* %s,%d,%d\n", t->studentId, t->activeLoans, t->score);
+                pthread_mutex_unlock(sLock);
+            } else {
+                replyAppend(out, "ERR no book or student with that key\n");
+                return 1;
+            }
+            replyAppend(out, "OK\n");
+            return 1;
+        }
+        CirculationStats st;
+        statsRead(&st);
+        long closed = 0;
+        for (int i = 0; i < STATS_DURATION_BUCKETS; i++) closed += st.durations[i];
+        replyAppend(out, "* loans,%ld\n* returns,%ld\n* out,%ld\n", st.loans, st.returns, st.loans - st.returns);
+        replyAppend(out, "* averageDays,%.1f\n", closed ? (double)st.loanDays / closed : 0.0);
+        replyAppend(out, "* penalties,%ld,%ld\n", st.penalties, st.penaltyPoints);
+        for (int i = 0; i < STATS_DURATION_BUCKETS; i++) replyAppend(out, "* days %s,%ld\n", durationLabels[i], st.durations[i]);
+        for (int i = 0; i < st.topCount; i++) {
+            replyAppend(out, "* top,%d,%s,%s,%d\n", i + 1, st.top[i]->isbn, st.top[i]->title, st.top[i]->borrowCount);
+        }
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "QUEUES") == 0) {
+        QueueLength* rows = NULL;
+        int n = collectQueueLengths(lib->books, &rows);
+        for (int i = 0; i < n; i++) {
+            replyAppend(out, "* %s,%s,%d,%d\n", rows[i].book->isbn, rows[i].book->title, rows[i].book->quantity, rows[i].count);
+        }
+        free(rows);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "AUTHORS") == 0) {
+        Author* a = lib->authors;
+        while (a) {
+            replyAppend(out, "* %d,%s,%s\n", a->id, a->name, a->surname);
+            a = a->next;
+        }
+        replyAppend(out, "OK\n");
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Borrow/return only read the catalog structure; the book's shard lock
+// and the student's lock stripe keep unrelated loans running in parallel
+static int serverHandleCirculation(Server* srv, char* cmd, char* args, Reply* out, unsigned long* seq) {
+    Library* lib = srv->lib;
+    char a1[SERVER_LINE_LEN], a2[SERVER_LINE_LEN], a3[SERVER_LINE_LEN];
+    if (strcmp(cmd, "BORROW") == 0) {
+        if (sscanf(args, "%19s %19s %19s", a1, a2, a3) != 3) {
+            replyAppend(out, "ERR usage: BORROW <studentId> <isbn> <date>\n");
+            return 1;
+        }
+        char label[LABEL_LEN] = "";
+        int rc = processLoan(&lib->students, &lib->loans, a1, a2, a3, label, seq);
+        if (rc == LOAN_OK) replyAppend(out, "OK %s\n", label);
+        else replyAppend(out, "ERR %s\n", loanStatusMessage(rc));
+    } else if (strcmp(cmd, "RETURN") == 0) {
+        if (sscanf(args, "%19s %29s %19s", a1, a2, a3) != 3) {
+            replyAppend(out, "ERR usage: RETURN <studentId> <label> <date>\n");
+            return 1;
+        }
+        int rc = processReturn(&lib->students, &lib->loans, a1, a2, a3, seq);
+        if (rc == LOAN_OK) replyAppend(out, "OK\n");
+        else replyAppend(out, "ERR %s\n", loanStatusMessage(rc));
+    } else if (strcmp(cmd, "HOLD") == 0) {
+        if (sscanf(args, "%19s %19s %19s", a1, a2, a3) != 3) {
+            replyAppend(out, "ERR usage: HOLD <studentId> <isbn> <date>\n");
+            return 1;
+        }
+        int rc = placeHold(&lib->students, a1, a2, a3, seq);
+        if (rc == LOAN_OK) replyAppend(out, "OK\n");
+        else replyAppend(out, "ERR %s\n", loanStatusMessage(rc));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Structural changes are serialized under the write lock
+static int serverHandleUpdate(Server* srv, char* cmd, char* args, Reply* out, unsigned long* seq) {
+    Library* lib = srv->lib;
+    char a1[SERVER_LINE_LEN], a2[SERVER_LINE_LEN], a3[SERVER_LINE_LEN];
+    char q1[JOURNAL_FIELD_LEN], q2[JOURNAL_FIELD_LEN], record[JOURNAL_RECORD_LEN];
+    int len;
+    if (strcmp(cmd, "ADDBOOK") == 0) {
+        int qty, used = 0;
+        if (sscanf(args, "%13s %d %n", a1, &qty, &used) != 2 || args[used] == '\0' || qty < 0) {
+            replyAppend(out, "ERR usage: ADDBOOK <isbn> <quantity> <title>\n");
+            return 1;
+        }
+        // Same bound as the menu's title prompt and the journal replay
+        if (!journalTextOk(args + used)) {
+            replyAppend(out, "ERR title longer than %d characters\n", MAX_NAME_LEN - 1);
+            return 1;
+        }
+        if (catalogFind(a1)) {
+            replyAppend(out, "ERR book already exists\n");
+            return 1;
+        }
+        if ((len = storageFormat(record, "k,%s,%d,%s\n", a1, qty, journalQuote(q1, args + used))) < 0) {
+            replyAppend(out, "ERR change too long to journal\n");
+            return 1;
+        }
+        Book* n = NULL;
+        lib->books = addBook(lib->books, args + used, a1, qty, &n);
+        *seq = storageApply(record, len);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "ADDSTUDENT") == 0) {
+        if (sscanf(args, "%19s %255s %255[^\n]", a1, a2, a3) != 3 || strlen(a1) >= STUDENT_ID_LEN) {
+            replyAppend(out, "ERR usage: ADDSTUDENT <id> <name> <surname>\n");
+            return 1;
+        }
+        if (isStudentExists(lib->students, a1)) {
+            replyAppend(out, "ERR student already exists\n");
+            return 1;
+        }
+        if ((len = storageFormat(record, "s,%s,%s,%s\n", a1, journalQuote(q1, a2), journalQuote(q2, a3))) < 0) {
+            replyAppend(out, "ERR change too long to journal\n");
+            return 1;
+        }
+        lib->students = addStudent(lib->students, a1, a2, a3);
+        *seq = storageApply(record, len);
+        replyAppend(out, "OK\n");
+    } else if (strcmp(cmd, "ADDAUTHOR") == 0) {
+        if (sscanf(args, "%255s %255[^\n]", a1, a2) != 2) {
+            replyAppend(out, "ERR usage: ADDAUTHOR <name> <surname>\n");
+            return 1;
+        }
+        if ((len = storageFormat(record, "a,%s,%s\n", journalQuote(q1, a1), journalQuote(q2, a2))) < 0) {
+            replyAppend(out, "ERR change too long to journal\n");
+            return 1;
+        }
+        addAuthor(&lib->authors, a1, a2);
+        *seq = storageApply(record, len);
+        replyAppend(out, "OK\n");
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Commits the change a handler journaled. If the journal failed, the
+// handler's OK (everything after mark) is replaced with an error.
+static void serverCommit(unsigned long seq, Reply* out, size_t mark) {
+    if (!seq || commitChange(seq)) return;
+    out->len = mark;
+    replyAppend(out, "ERR journal write failed; change not durable\n");
+}
+
+static void serverHandleLine(Server* srv, char* line, Reply* out) {
+    char* cmd = line;
+    char* args = line + strcspn(line, " ");
+    if (*args) *args++ = '\0';
+    while (*args == ' ') args++;
+
+    if (strcmp(cmd, "PING") == 0) {
+        replyAppend(out, "OK pong\n");
+        return;
+    }
+    if (strcmp(cmd, "SYNC") == 0) {
+        if (journalSync()) replyAppend(out, "OK durable\n");
+        else replyAppend(out, "ERR journal write failed\n");
+        return;
+    }
+
+    // Built on first use, before the read lock is taken
+    if (strcmp(cmd, "HELD") == 0) intervalIndexEnsure(&srv->lib->loans);
+
+    // Changes are committed after the lock is released, so a writer waiting
+    // for it does not hold up every new request behind an fdatasync
+    unsigned long seq = 0;
+    size_t mark = out->len;
+    pthread_rwlock_rdlock(&libraryLock);
+    int handled = serverHandleQuery(srv, cmd, args, out);
+    if (!handled) handled = serverHandleCirculation(srv, cmd, args, out, &seq);
+    pthread_rwlock_unlock(&libraryLock);
+    serverCommit(seq, out, mark);
+    if (handled) return;
+
+    pthread_rwlock_wrlock(&libraryLock);
+    handled = serverHandleUpdate(srv, cmd, args, out, &seq);
+    pthread_rwlock_unlock(&libraryLock);
+    serverCommit(seq, out, mark);
+    if (!handled) replyAppend(out, "ERR unknown command: %s\n", cmd);
+}
+
+// Kiosk mode answers lookups from the partitioned catalog
+static void kioskHandleLine(PartitionedCatalog* pc, char* line, Reply* out) {
+    char* cmd = line;
+    char* args = line + strcspn(line, " ");
+    if (*args) *args++ = '\0';
+    while (*args == ' ') args++;
+
+    if (strcmp(cmd, "PING") == 0) {
+        replyAppend(out, "OK pong\n");
+        return;
+    }
+    pthread_mutex_lock(&pc->lock);
+    if (strcmp(cmd, "FIND") == 0 || strcmp(cmd, "BOOK") == 0) {
+        Book* b = partitionFind(pc, args);
+        if (!b) {
+            replyAppend(out, "ERR book not found\n");
+        } else if (cmd[0] == 'F') {
+            BookCopy* c = b->copies;
+            while (c && strcmp(c->borrowerStudentId, "SHELF") != 0) c = c->next;
+            if (c) replyAppend(out, "OK %s\n", c->labelNo);
+            else replyAppend(out, "ERR no copies available on shelf\n");
+        } else {
+            replyAppend(out, "* %s,%s,%d,%d\n", b->isbn, b->title, b->quantity, b->quantity - b->checkedOut);
+            for (BookCopy* c = b->copies; c; c = c->next) replyAppend(out, "* %s,%s\n", c->labelNo, c->borrowerStudentId);
+            replyAppend(out, "OK\n");
+        }
+    } else if (strcmp(cmd, "STATUS") == 0) {
+        int loaded = 0, books = 0;
+        for (int p = 0; p < CATALOG_PARTITIONS; p++) {
+            if (pc->parts[p].books) loaded++;
+            books += pc->parts[p].bookCount;
+        }
+        replyAppend(out, "* partitions,%d,%d\n* books,%d\n", loaded, CATALOG_PARTITIONS, books);
+        replyAppend(out, "* resident,%zu,%zu\n", pc->resident, pc->budget);
+        replyAppend(out, "* lookups,%lu\n* bloomSkips,%lu\n* loads,%lu\n* evictions,%lu\n",
+                    pc->lookups, pc->bloomSkips, pc->loads, pc->evictions);
+        replyAppend(out, "OK\n");
+    } else {
+        replyAppend(out, "ERR unknown command in kiosk mode: %s\n", cmd);
+    }
+    pthread_mutex_unlock(&pc->lock);
+}
+
+static void serverServeClient(Server* srv, int fd) {
+    char buf[SERVER_LINE_LEN * 8];
+    size_t used = 0;
+    Reply out = {0};
+    out.cap = 4096;
+    out.data = (char*)malloc(out.cap);
+    if (!out.data) return;
+
+    while (!serverStopping) {
+        ssize_t n = recv(fd, buf + used, sizeof(buf) - used, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += (size_t)n;
+
+        // Answer every complete line in the buffer with a single send
+        char* start = buf;
+        char* nl;
+        out.len = 0;
+        int quit = 0;
+        while (!quit && (nl = memchr(start, '\n', used - (size_t)(start - buf)))) {
+            *nl = '\0';
+            if (nl > start && nl[-1] == '\r') nl[-1] = '\0';
+            if (strcmp(start, "QUIT") == 0) {
+                replyAppend(&out, "OK bye\n");
+                quit = 1;
+            } else if (*start) {
+                if (srv->parts) kioskHandleLine(srv->parts, start, &out);
+                else serverHandleLine(srv, start, &out);
+            }
+            start = nl + 1;
+        }
+        if (out.len && !sendAll(fd, out.data, out.len)) break;
+        if (quit) break;
+
+        used -= (size_t)(start - buf);
+        memmove(buf, start, used);
+        if (used == sizeof(buf)) {
+            const char* msg = "ERR line too long\n";
+            sendAll(fd, msg, strlen(msg));
+            break;
+        }
+    }
+    free(out.data);
+}
+
+static void* serverWorker(void* arg) {
+    Server* srv = (Server*)arg;
+    pthread_mutex_lock(&srv->queueLock);
+    int slot = srv->nextSlot++;
+    pthread_mutex_unlock(&srv->queueLock);
+
+    while (1) {
+        pthread_mutex_lock(&srv->queueLock);
+        while (srv->queueCount == 0 && !serverStopping)
+            pthread_cond_wait(&srv->queueCond, &srv->queueLock);
+        if (srv->queueCount == 0) {
+            pthread_mutex_unlock(&srv->queueLock);
+            break;
+        }
+        int fd = srv->queue[srv->queueHead];
+        srv->queueHead = (srv->queueHead + 1) % SERVER_QUEUE_LEN;
+        srv->queueCount--;
+        srv->activeFds[slot] = fd;
+        pthread_mutex_unlock(&srv->queueLock);
+
+        serverServeClient(srv, fd);
+
+        pthread_mutex_lock(&srv->queueLock);
+        srv->activeFds[slot] = -1;
+        pthread_mutex_unlock(&srv->queueLock);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int serverRun(Server* srv, const char* path) {
+    int workerCount = srv->workerCount;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    srv->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv->listenFd < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path);
+    if (bind(srv->listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(srv->listenFd, SERVER_QUEUE_LEN) < 0) {
+        perror("bind/listen");
+        close(srv->listenFd);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serverSignalHandler; // No SA_RESTART: accept() must return on signal
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pthread_mutex_init(&srv->queueLock, NULL);
+    pthread_cond_init(&srv->queueCond, NULL);
+    srv->workers = (pthread_t*)calloc(workerCount, sizeof(pthread_t));
+    srv->activeFds = (int*)malloc(sizeof(int) * workerCount);
+    if (!srv->workers || !srv->activeFds) {
+        printf("Memory allocation error!\n");
+        close(srv->listenFd);
+        return 1;
+    }
+    for (int i = 0; i < workerCount; i++) srv->activeFds[i] = -1;
+    for (int i = 0; i < workerCount; i++) pthread_create(&srv->workers[i], NULL, serverWorker, srv);
+
+    printf("Serving on %s with %d workers (Ctrl+C to stop)\n", path, workerCount);
+    fflush(stdout);
+
+    while (!serverStopping) {
+        int fd = accept(srv->listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        pthread_mutex_lock(&srv->queueLock);
+        if (srv->queueCount == SERVER_QUEUE_LEN) {
+            pthread_mutex_unlock(&srv->queueLock);
+            const char* msg = "ERR server busy\n";
+            sendAll(fd, msg, strlen(msg));
+            close(fd);
+            continue;
+        }
+        srv->queue[(srv->queueHead + srv->queueCount) % SERVER_QUEUE_LEN] = fd;
+        srv->queueCount++;
+        pthread_cond_signal(&srv->queueCond);
+        pthread_mutex_unlock(&srv->queueLock);
+    }
+
+    // Wake idle workers and cut off clients that are still connected
+    serverStopping = 1;
+    pthread_mutex_lock(&srv->queueLock);
+    for (int i = 0; i < workerCount; i++) {
+        if (srv->activeFds[i] >= 0) shutdown(srv->activeFds[i], SHUT_RDWR);
+    }
+    while (srv->queueCount > 0) {
+        close(srv->queue[srv->queueHead]);
+        srv->queueHead = (srv->queueHead + 1) % SERVER_QUEUE_LEN;
+        srv->queueCount--;
+    }
+    pthread_cond_broadcast(&srv->queueCond);
+    pthread_mutex_unlock(&srv->queueLock);
+    for (int i = 0; i < workerCount; i++) pthread_join(srv->workers[i], NULL);
+
+    close(srv->listenFd);
+    unlink(path);
+    free(srv->workers);
+    free(srv->activeFds);
+    pthread_mutex_destroy(&srv->queueLock);
+    pthread_cond_destroy(&srv->queueCond);
+    printf("Server stopped.\n");
+    return 0;
+}
+
+int runServer(Library* lib, const char* path, int workerCount) {
+    Server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.lib = lib;
+    srv.workerCount = workerCount;
+    return serverRun(&srv, path);
+}
+
+// Serves FIND, BOOK and STATUS from catalog/ without loading the library.
+// Partitions are built once from the CSV files if none exist yet.
+int runKiosk(const char* path, int workerCount, size_t budget) {
+    PartitionedCatalog pc;
+    if (!partitionsOpen(&pc, budget)) {
+        partitionsClose(&pc);
+        printf("No catalog partitions yet; building them from the CSV files.\n");
+        Library lib;
+        loadLibrary(&lib);
+        int built = saveCatalogPartitions(lib.books);
+        freeLibrary(&lib);
+        if (!built || !partitionsOpen(&pc, budget)) {
+            printf("Could not write %s\n", FILE_CATALOG_DIRECTORY);
+            return 1;
+        }
+    }
+    Server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.parts = &pc;
+    srv.workerCount = workerCount;
+    int rc = serverRun(&srv, path);
+    partitionsClose(&pc);
+    return rc;
+}
+
+// --- STRESS TEST ---
+// Runs concurrent borrows/returns against a synthetic in-memory library
+// and then checks that every copy agrees with its latest loan record.
+
+typedef struct StressWorker {
+    Library* lib;
+    int ops;
+    unsigned int seed;
+    int held;
+    char heldStudent[STRESS_MAX_HELD][STUDENT_ID_LEN];
+    char heldLabel[STRESS_MAX_HELD][LABEL_LEN];
+    long loans;
+    long returns;
+} StressWorker;
+
+static void* stressWorker(void* arg) {
+    StressWorker* w = (StressWorker*)arg;
+    Library* lib = w->lib;
+    for (int i = 0; i < w->ops; i++) {
+        if (w->held > 0 && (w->held == STRESS_MAX_HELD || rand_r(&w->seed) % 2)) {
+            int k = rand_r(&w->seed) % w->held;
+            unsigned long seq = 0;
+            if (processReturn(&lib->students, &lib->loans, w->heldStudent[k], w->heldLabel[k], "01.01.2025", &seq) == LOAN_OK) {
+                commitChange(seq);
+                w->returns++;
             }
-            case 2: {
-                char i[14]; printf("ISBN: "); fgets(i,14,stdin); i[strcspn(i,"\n")]=0;
-                deleteBook(head, i);
-                saveBooksToFile(*head, FILE_BOOKS);
-                saveBookCopiesToFile(*head, FILE_COPIES);
-                break;
+            w->held--;
+            if (k != w->held) {
+                memcpy(w->heldStudent[k], w->heldStudent[w->held], STUDENT_ID_LEN);
+                memcpy(w->heldLabel[k], w->heldLabel[w->held], LABEL_LEN);
             }
-            case 3: {
-                Book* tmp = *head;
-                while(tmp) {
-                    printf("%s (ISBN: %s) Qty: %d\n", tmp->title, tmp->isbn, tmp->quantity);
-                    tmp = tmp->next;
-                }
-                break;
+        } else {
+            char sId[STUDENT_ID_LEN], isbn[ISBN_LEN];
+            snprintf(sId, sizeof(sId), "2000%04d", rand_r(&w->seed) % STRESS_STUDENTS);
+            snprintf(isbn, sizeof(isbn), "978000000%04d", rand_r(&w->seed) % STRESS_BOOKS);
+            unsigned long seq = 0;
+            if (processLoan(&lib->students, &lib->loans, sId, isbn, "01.01.2025", w->heldLabel[w->held], &seq) == LOAN_OK) {
+                commitChange(seq);
+                strcpy(w->heldStudent[w->held], sId);
+                w->held++;
+                w->loans++;
             }
-            case 4: {
-                // YENİ EKLENEN EŞLEŞTİRME MENÜSÜ ÇAĞRISI
-                menuLinkBookAuthor(*head, aHead, map, count);
-                break;
+        }
+    }
+    return NULL;
+}
+
+void buildSyntheticLibrary(Library* lib) {
+    memset(lib, 0, sizeof(*lib));
+    for (int i = 0; i < STRESS_BOOKS; i++) {
+        char isbn[ISBN_LEN], title[MAX_NAME_LEN];
+        snprintf(isbn, sizeof(isbn), "978000000%04d", i);
+        snprintf(title, sizeof(title), "Stress Title %d", i);
+        Book* n = NULL;
+        lib->books = addBook(lib->books, title, isbn, STRESS_COPIES, &n);
+    }
+    for (int i = 0; i < STRESS_STUDENTS; i++) {
+        char id[STUDENT_ID_LEN];
+        snprintf(id, sizeof(id), "2000%04d", i);
+        lib->students = addStudent(lib->students, id, "Stress", "Student");
+    }
+}
+
+// Keeps the per-operation console messages out of benchmark reports
+int silenceStdout() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) {
+        dup2(devNull, STDOUT_FILENO);
+        close(devNull);
+    }
+    return saved;
+}
+
+void restoreStdout(int saved) {
+    fflush(stdout);
+    if (saved < 0) return;
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+int runStressTest(int threadCount, int opsPerThread) {
+    Library lib;
+    buildSyntheticLibrary(&lib);
+
+    StressWorker* workers = (StressWorker*)calloc(threadCount, sizeof(StressWorker));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (!workers || !tids) {
+        printf("Memory allocation error!\n");
+        return 1;
+    }
+
+    const StorageEngine* saved = storage;
+    storage = &memoryEngine;
+    int savedStdout = silenceStdout();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].lib = &lib;
+        workers[i].ops = opsPerThread;
+        workers[i].seed = 12345u + (unsigned int)i;
+        pthread_create(&tids[i], NULL, stressWorker, &workers[i]);
+    }
+    long loans = 0, returns = 0, held = 0;
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(tids[i], NULL);
+        loans += workers[i].loans;
+        returns += workers[i].returns;
+        held += workers[i].held;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    restoreStdout(savedStdout);
+    storage = saved;
+
+    // Latest transaction per label (the history is newest-first)
+    int tableSize = STRESS_BOOKS * STRESS_COPIES * 4;
+    LoanTransaction** latest = (LoanTransaction**)calloc(tableSize, sizeof(LoanTransaction*));
+    if (!latest) return 1;
+    long records = 0;
+    for (LoanTransaction* t = lib.loans; t; t = t->next) {
+        unsigned int h = hashString(t->bookLabelNo, LABEL_LEN) % tableSize;
+        while (latest[h] && strcmp(latest[h]->bookLabelNo, t->bookLabelNo) != 0) h = (h + 1) % tableSize;
+        if (!latest[h]) latest[h] = t;
+        records++;
+    }
+
+    int errors = 0;
+    long lent = 0;
+    for (Book* b = lib.books; b; b = b->next) {
+        for (BookCopy* c = b->copies; c; c = c->next) {
+            unsigned int h = hashString(c->labelNo, LABEL_LEN) % tableSize;
+            while (latest[h] && strcmp(latest[h]->bookLabelNo, c->labelNo) != 0) h = (h + 1) % tableSize;
+            LoanTransaction* t = latest[h];
+            int onShelf = strcmp(c->borrowerStudentId, "SHELF") == 0;
+            if (!onShelf) lent++;
+            if (onShelf && t && t->operationType != OP_TYPE_RETURN) errors++;
+            if (!onShelf && (!t || t->operationType != OP_TYPE_BORROW || strcmp(t->studentId, c->borrowerStudentId) != 0)) errors++;
+        }
+    }
+    if (lent != held || records != loans + returns || loans - returns != held) errors++;
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d threads, %ld loans, %ld returns, %ld copies out, %ld records in %.3f s (%.0f ops/s)\n",
+           threadCount, loans, returns, lent, records, secs, secs > 0 ? (loans + returns) / secs : 0.0);
+    printf("Stress test %s (%d inconsistencies)\n", errors ? "FAILED" : "passed", errors);
+
+    free(latest);
+    free(workers);
+    free(tids);
+    freeLibrary(&lib);
+    return errors ? 1 : 0;
+}
+
+// --- GROUP COMMIT BENCHMARK ---
+// Every borrow and return waits until its journal record is fsynced.
+// Throughput is measured for several batch limits on the same workload.
+
+typedef struct CommitBenchWorker {
+    Library* lib;
+    int index;
+    int transactions;
+    unsigned int seed;
+} CommitBenchWorker;
+
+static void* commitBenchWorker(void* arg) {
+    CommitBenchWorker* w = (CommitBenchWorker*)arg;
+    Library* lib = w->lib;
+    char sId[STUDENT_ID_LEN], isbn[ISBN_LEN], label[LABEL_LEN];
+    snprintf(sId, sizeof(sId), "2000%04d", w->index % STRESS_STUDENTS);
+    for (int i = 0; i + 1 < w->transactions; i += 2) {
+        snprintf(isbn, sizeof(isbn), "978000000%04d", rand_r(&w->seed) % STRESS_BOOKS);
+        unsigned long seq = 0;
+        if (processLoan(&lib->students, &lib->loans, sId, isbn, "01.01.2025", label, &seq) == LOAN_OK) {
+            commitChange(seq);
+            if (processReturn(&lib->students, &lib->loans, sId, label, "01.01.2025", &seq) == LOAN_OK) commitChange(seq);
+        }
+    }
+    return NULL;
+}
+
+int runCommitBenchmark(int threadCount, int transactions) {
+    static const int batchSizes[] = { 1, 8, 32, 128 };
+    CommitBenchWorker* workers = (CommitBenchWorker*)calloc(threadCount, sizeof(CommitBenchWorker));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (!workers || !tids) return 1;
+
+    printf("Group commit: %d threads x %d transactions, window %d us\n", threadCount, transactions, journal.windowUs);
+    printf("MaxBatch\tTx/s\t\tAvgBatch\tFsyncs\n");
+    for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+        Library lib;
+        buildSyntheticLibrary(&lib);
+        unlink(FILE_BENCH_JOURNAL);
+        journal.maxBatch = batchSizes[b];
+        if (!journalOpen(FILE_BENCH_JOURNAL)) return 1;
+
+        int savedStdout = silenceStdout();
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < threadCount; i++) {
+            workers[i].lib = &lib;
+            workers[i].index = i;
+            workers[i].transactions = transactions;
+            workers[i].seed = 777u + (unsigned int)i;
+            pthread_create(&tids[i], NULL, commitBenchWorker, &workers[i]);
+        }
+        for (int i = 0; i < threadCount; i++) pthread_join(tids[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        restoreStdout(savedStdout);
+
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        unsigned long records = journal.records, batches = journal.batches;
+        printf("%d\t\t%.0f\t\t%.1f\t\t%lu\n", batchSizes[b], secs > 0 ? records / secs : 0.0,
+               batches ? (double)records / batches : 0.0, batches);
+        journalClose();
+        freeLibrary(&lib);
+        unlink(FILE_BENCH_JOURNAL);
+    }
+    free(workers);
+    free(tids);
+    return 0;
+}
+
+// --- COMMIT LATENCY BENCHMARK ---
+// Times every borrow and return individually with the thread and the
+// io_uring committer, and with asynchronous commits, and reports the
+// latency percentiles next to throughput.
+
+typedef struct LatencyBenchWorker {
+    CommitBenchWorker base;
+    long* samples;
+    int count;
+} LatencyBenchWorker;
+
+static long nanosSince(struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1000000000L + (t1.tv_nsec - t0->tv_nsec);
+}
+
+static void* latencyBenchWorker(void* arg) {
+    LatencyBenchWorker* w = (LatencyBenchWorker*)arg;
+    Library* lib = w->base.lib;
+    char sId[STUDENT_ID_LEN], isbn[ISBN_LEN], label[LABEL_LEN];
+    snprintf(sId, sizeof(sId), "2000%04d", w->base.index % STRESS_STUDENTS);
+    for (int i = 0; i + 1 < w->base.transactions; i += 2) {
+        snprintf(isbn, sizeof(isbn), "978000000%04d", rand_r(&w->base.seed) % STRESS_BOOKS);
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        unsigned long seq = 0;
+        int rc = processLoan(&lib->students, &lib->loans, sId, isbn, "01.01.2025", label, &seq);
+        if (rc == LOAN_OK) commitChange(seq);
+        w->samples[w->count++] = nanosSince(&t0);
+        if (rc != LOAN_OK) continue;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (processReturn(&lib->students, &lib->loans, sId, label, "01.01.2025", &seq) == LOAN_OK) commitChange(seq);
+        w->samples[w->count++] = nanosSince(&t0);
+    }
+    return NULL;
+}
+
+static int compareLong(const void* a, const void* b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+int runLatencyBenchmark(int threadCount, int transactions) {
+    static const struct { int useUring; int async; const char* commit; } modes[] = {
+        { 0, 0, "wait" }, { 1, 0, "wait" }, { 1, 1, "async" },
+    };
+    LatencyBenchWorker* workers = (LatencyBenchWorker*)calloc(threadCount, sizeof(LatencyBenchWorker));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    long* all = (long*)malloc(sizeof(long) * threadCount * transactions);
+    if (!workers || !tids || !all) return 1;
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].samples = all + (size_t)i * transactions;
+    }
+
+    printf("Commit latency: %d threads x %d transactions, window %d us, batch %d\n", threadCount, transactions,
+           journal.windowUs, journal.maxBatch);
+    printf("Backend\t\tCommit\tTx/s\t\tp50 us\tp99 us\tp99.9 us\tmax us\n");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        Library lib;
+        buildSyntheticLibrary(&lib);
+        unlink(FILE_BENCH_JOURNAL);
+        journal.useUring = modes[m].useUring;
+        journal.asyncCommit = modes[m].async;
+        if (!journalOpen(FILE_BENCH_JOURNAL)) return 1;
+
+        int savedStdout = silenceStdout();
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < threadCount; i++) {
+            workers[i].base.lib = &lib;
+            workers[i].base.index = i;
+            workers[i].base.transactions = transactions;
+            workers[i].base.seed = 777u + (unsigned int)i;
+            workers[i].count = 0;
+            pthread_create(&tids[i], NULL, latencyBenchWorker, &workers[i]);
+        }
+        for (int i = 0; i < threadCount; i++) pthread_join(tids[i], NULL);
+        journalSync();
+        double secs = nanosSince(&t0) / 1e9;
+        restoreStdout(savedStdout);
+
+        // Gather the samples at the front of the shared array
+        long n = 0;
+        for (int i = 0; i < threadCount; i++) {
+            memmove(all + n, workers[i].samples, sizeof(long) * workers[i].count);
+            n += workers[i].count;
+        }
+        qsort(all, n, sizeof(long), compareLong);
+        unsigned long records = journal.records;
+        printf("%-8s\t%s\t%.0f\t\t%.1f\t%.1f\t%.1f\t\t%.1f\n", journalBackend(), modes[m].commit,
+               secs > 0 ? records / secs : 0.0, n ? all[n / 2] / 1e3 : 0.0, n ? all[n * 99 / 100] / 1e3 : 0.0,
+               n ? all[n * 999 / 1000] / 1e3 : 0.0, n ? all[n - 1] / 1e3 : 0.0);
+        journalClose();
+        freeLibrary(&lib);
+        unlink(FILE_BENCH_JOURNAL);
+    }
+    journal.useUring = 1;
+    journal.asyncCommit = 0;
+    free(all);
+    free(workers);
+    free(tids);
+    return 0;
+}
+
+// --- STORAGE ENGINE BENCHMARK ---
+// Runs the same workload on every storage engine in a scratch directory:
+// concurrent borrows and returns through apply, a checkpoint of the
+// result, and a load of that checkpoint into a fresh library.
+
+typedef struct StorageCounts {
+    long books;
+    long lent;
+    long loans;
+    long scores;
+} StorageCounts;
+
+static void countLibrary(Library* lib, StorageCounts* out) {
+    memset(out, 0, sizeof(*out));
+    for (Book* b = lib->books; b; b = b->next) {
+        out->books++;
+        for (BookCopy* c = b->copies; c; c = c->next) out->lent += strcmp(c->borrowerStudentId, "SHELF") != 0;
+    }
+    for (LoanTransaction* t = lib->loans; t; t = t->next) out->loans++;
+    for (Student* st = lib->students; st; st = st->next) out->scores += st->score;
+}
+
+// Synthetic library plus bookCount extra titles, a closed loan for each
+// and an open loan on every tenth
+static void buildStorageBenchLibrary(Library* lib, int bookCount) {
+    buildSyntheticLibrary(lib);
+    char isbn[ISBN_LEN], title[MAX_NAME_LEN], label[LABEL_LEN], sId[STUDENT_ID_LEN];
+    for (int i = 0; i < bookCount; i++) {
+        snprintf(isbn, sizeof(isbn), "979%010d", i);
+        snprintf(title, sizeof(title), "Volume %07d, Collected Papers", i);
+        Book* book = NULL;
+        lib->books = addBook(lib->books, title, isbn, STRESS_COPIES, &book);
+        if (!book) continue;
+        snprintf(label, sizeof(label), "%s_1", isbn);
+        snprintf(sId, sizeof(sId), "2000%04d", i % STRESS_STUDENTS);
+        addLoanTransaction(&lib->loans, sId, label, OP_TYPE_BORROW, "03.02.2025");
+        addLoanTransaction(&lib->loans, sId, label, OP_TYPE_RETURN, "10.02.2025");
+        if (i % 10 == 0) {
+            strcpy(book->copies->borrowerStudentId, sId);
+            addLoanTransaction(&lib->loans, sId, book->copies->labelNo, OP_TYPE_BORROW, "01.03.2025");
+        }
+        book->borrowCount = 1 + (i % 10 == 0);
+    }
+    linkOpenLoans(lib);
+    CirculationStats none;
+    memset(&none, 0, sizeof(none));
+    statsRestore(lib, &none);
+}
+
+static void removeStorageFiles(void) {
+    static const char* files[] = { FILE_AUTHORS, FILE_STUDENTS, FILE_BOOKS, FILE_COPIES, FILE_LOANS,
+                                   FILE_BOOK_AUTHORS, FILE_STATS, FILE_HOLDS, FILE_LIBRARY_BIN, FILE_JOURNAL };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) unlink(files[i]);
+}
+
+static long storageFileBytes(void) {
+    static const char* files[] = { FILE_AUTHORS, FILE_STUDENTS, FILE_BOOKS, FILE_COPIES, FILE_LOANS,
+                                   FILE_BOOK_AUTHORS, FILE_STATS, FILE_HOLDS, FILE_LIBRARY_BIN };
+    long total = 0;
+    struct stat st;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (stat(files[i], &st) == 0) total += (long)st.st_size;
+    }
+    return total;
+}
+
+int runStorageBenchmark(int bookCount, int threadCount, int transactions) {
+    static const StorageEngine* engines[] = { &csvEngine, &binaryEngine, &memoryEngine };
+    const StorageEngine* selected = storage;
+    CommitBenchWorker* workers = (CommitBenchWorker*)calloc(threadCount, sizeof(CommitBenchWorker));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (!workers || !tids) return 1;
+    if ((mkdir(STORAGE_BENCH_DIR, 0755) != 0 && errno != EEXIST) || chdir(STORAGE_BENCH_DIR) != 0) {
+        printf("Could not use directory: %s\n", STORAGE_BENCH_DIR);
+        return 1;
+    }
+    removeStorageFiles();
+
+    printf("%d books, %d threads x %d transactions\n", bookCount + STRESS_BOOKS, threadCount, transactions);
+    printf("Engine\t\tTx/s\t\tCheckpoint ms\tSize MB\t\tLoad ms\t\tReloaded\n");
+    int failed = 0;
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        storage = engines[e];
+        Library lib;
+        buildStorageBenchLibrary(&lib, bookCount);
+        if (!storage->open()) return 1;
+
+        int savedStdout = silenceStdout();
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < threadCount; i++) {
+            workers[i].lib = &lib;
+            workers[i].index = i;
+            workers[i].transactions = transactions;
+            workers[i].seed = 777u + (unsigned int)i;
+            pthread_create(&tids[i], NULL, commitBenchWorker, &workers[i]);
+        }
+        for (int i = 0; i < threadCount; i++) pthread_join(tids[i], NULL);
+        double txSecs = nanosSince(&t0) / 1e9;
+        restoreStdout(savedStdout);
+        storage->close();
+
+        // The snapshot covers the journal, as after a rotation
+        Snapshot snap;
+        memset(&snap, 0, sizeof(snap));
+        int ok = copySnapshot(&lib, &snap);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (ok && storage->checkpoint) ok = storage->checkpoint(&snap);
+        double checkpointSecs = nanosSince(&t0) / 1e9;
+        freeSnapshot(&snap);
+        unlink(FILE_JOURNAL);
+        StorageCounts before, after;
+        countLibrary(&lib, &before);
+        freeLibrary(&lib);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        storage->loadAll(&lib);
+        double loadSecs = nanosSince(&t0) / 1e9;
+        countLibrary(&lib, &after);
+        freeLibrary(&lib);
+
+        int reloaded = ok && memcmp(&before, &after, sizeof(before)) == 0;
+        if (storage->checkpoint && !reloaded) failed = 1;
+        printf("%-8s\t%.0f\t\t%.1f\t\t%.1f\t\t%.1f\t\t%s\n", storage->name,
+               txSecs > 0 ? (double)threadCount * transactions / txSecs : 0.0, checkpointSecs * 1e3,
+               storageFileBytes() / (1024.0 * 1024.0), loadSecs * 1e3,
+               storage->checkpoint ? (reloaded ? "yes" : "MISMATCH") : "-");
+        removeStorageFiles();
+    }
+    storage = selected;
+    if (chdir("..") != 0 || rmdir(STORAGE_BENCH_DIR) != 0) printf("Could not remove %s\n", STORAGE_BENCH_DIR);
+    free(workers);
+    free(tids);
+    return failed;
+}
+
+// --- CSV PARSE BENCHMARK ---
+// Parses a generated copies-style file with the CSV reader and with the
+// previous fgets + strtok loop, and reports throughput in MB/s.
+
+static double elapsedSeconds(struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+int runParseBenchmark(int rows) {
+    FILE* fp = fopen(FILE_BENCH_PARSE, "w");
+    if (!fp) {
+        printf("Could not open file: %s\n", FILE_BENCH_PARSE);
+        return 1;
+    }
+    fprintf(fp, "LabelNo,ISBN,BorrowerID,Title\n");
+    for (int i = 0; i < rows; i++) {
+        int book = i / STRESS_COPIES;
+        fprintf(fp, "978000%07d_%d,978000%07d,%s,\"Collected Works, Vol. %d\"\n", book, i % STRESS_COPIES + 1,
+                book, (i % 4) ? "SHELF" : "20001234", book % 100);
+    }
+    fclose(fp);
+    struct stat st;
+    if (stat(FILE_BENCH_PARSE, &st) != 0) return 1;
+    double mb = st.st_size / (1024.0 * 1024.0);
+    printf("Parsing %d rows (%.1f MB), best of 5 passes\n", rows, mb);
+
+    double bestCsv = 0, bestOld = 0;
+    long fieldsCsv = 0, fieldsOld = 0;
+    for (int pass = 0; pass < 5; pass++) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        CsvReader csv;
+        if (!csvOpen(&csv, FILE_BENCH_PARSE)) return 1;
+        long fields = 0;
+        while (csvNextRecord(&csv)) fields += csv.fieldCount;
+        csvClose(&csv);
+        double secs = elapsedSeconds(&t0);
+        if (pass == 0 || secs < bestCsv) bestCsv = secs;
+        fieldsCsv = fields;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        FILE* in = fopen(FILE_BENCH_PARSE, "r");
+        if (!in) return 1;
+        char line[256];
+        fields = 0;
+        while (fgets(line, sizeof(line), in)) {
+            for (char* tok = strtok(line, ",\n"); tok; tok = strtok(NULL, ",\n")) fields++;
+        }
+        fclose(in);
+        secs = elapsedSeconds(&t0);
+        if (pass == 0 || secs < bestOld) bestOld = secs;
+        fieldsOld = fields;
+    }
+    unlink(FILE_BENCH_PARSE);
+
+    printf("Parser\t\tMB/s\t\tFields\n");
+    printf("csv reader\t%.0f\t\t%ld\n", bestCsv > 0 ? mb / bestCsv : 0.0, fieldsCsv);
+    printf("fgets+strtok\t%.0f\t\t%ld (splits quoted commas)\n", bestOld > 0 ? mb / bestOld : 0.0, fieldsOld);
+    return 0;
+}
+
+// --- CSV SAVE BENCHMARK ---
+// Writes a synthetic copies.csv with the buffered writer and with the
+// previous fprintf loop. Both paths end with fsync.
+
+static int saveBookCopiesWithFprintf(Book* head, const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return 0;
+    fprintf(fp, "LabelNo,ISBN,BorrowerID\n");
+    for (; head; head = head->next) {
+        for (BookCopy* copy = head->copies; copy; copy = copy->next) {
+            fprintf(fp, "%s,%s,%s\n", copy->labelNo, head->isbn, copy->borrowerStudentId);
+        }
+    }
+    int ok = (fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+int runSaveBenchmark(int copies) {
+    // Books are linked directly; the catalog index is not needed here
+    int bookCount = (copies + STRESS_COPIES - 1) / STRESS_COPIES;
+    Book* books = NULL;
+    for (int b = bookCount - 1; b >= 0; b--) {
+        Book* book = (Book*)calloc(1, sizeof(Book));
+        if (!book) return 1;
+        char title[32];
+        snprintf(title, sizeof(title), "Book %d", b);
+        book->title = internString(title);
+        snprintf(book->isbn, sizeof(book->isbn), "978%010d", b);
+        for (int c = 1; c <= STRESS_COPIES && b * STRESS_COPIES + c <= copies; c++) {
+            BookCopy* copy = (BookCopy*)calloc(1, sizeof(BookCopy));
+            if (!copy) return 1;
+            snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", book->isbn, c);
+            snprintf(copy->borrowerStudentId, sizeof(copy->borrowerStudentId), "%s", (c == 1) ? "20001234" : "SHELF");
+            copy->next = book->copies;
+            book->copies = copy;
+            book->quantity++;
+        }
+        book->next = books;
+        books = book;
+    }
+
+    printf("Saving %d copies, best of 5 passes\n", copies);
+    double best[2] = { 0, 0 };
+    for (int pass = 0; pass < 5; pass++) {
+        for (int way = 0; way < 2; way++) {
+            struct timespec t0;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            int ok = way ? saveBookCopiesWithFprintf(books, FILE_BENCH_SAVE) : saveBookCopiesToFile(books, FILE_BENCH_SAVE);
+            double secs = elapsedSeconds(&t0);
+            if (!ok) {
+                printf("Could not write %s\n", FILE_BENCH_SAVE);
+                return 1;
             }
+            if (pass == 0 || secs < best[way]) best[way] = secs;
         }
-    } while(choice!=0);
+    }
+    struct stat st;
+    double mb = (stat(FILE_BENCH_SAVE, &st) == 0) ? st.st_size / (1024.0 * 1024.0) : 0.0;
+    unlink(FILE_BENCH_SAVE);
+
+    printf("Writer\t\tSeconds\t\tMB/s\n");
+    printf("csv writer\t%.3f\t\t%.0f\n", best[0], best[0] > 0 ? mb / best[0] : 0.0);
+    printf("fprintf\t\t%.3f\t\t%.0f\n", best[1], best[1] > 0 ? mb / best[1] : 0.0);
+
+    while (books) {
+        Book* next = books->next;
+        freeBookCopies(books->copies);
+        free(books);
+        books = next;
+    }
+    return 0;
 }
 
-// --- MEMORY CLEANUP ---
-void freeBookCopies(BookCopy* head) {
-    BookCopy* tmp;
-    while (head) { tmp = head; head = head->next; free(tmp); }
+// --- MEMORY REPORT ---
+// Builds a synthetic catalog and compares its footprint with the old
+// layout, where every title and name was a fixed char[50].
+
+typedef struct LegacyAuthor { int id; char name[50]; char surname[50]; void* next; } LegacyAuthor;
+typedef struct LegacyStudent { char studentId[9]; char name[50]; char surname[50]; int score; void* prev; void* next; } LegacyStudent;
+typedef struct LegacyBookCopy { char labelNo[24]; char borrowerStudentId[9]; char status[20]; void* next; } LegacyBookCopy;
+typedef struct LegacyBook { char title[50]; char isbn[14]; int quantity; void* copies; void* next; void* isbnNext; } LegacyBook;
+
+static void printMemoryRow(const char* what, size_t count, size_t before, size_t after) {
+    printf("%-10s\t%zu\t\t%.1f MB (%zu B)\t%.1f MB (%zu B)\n", what, count,
+           before * count / (1024.0 * 1024.0), before, after * count / (1024.0 * 1024.0), after);
 }
-void freeBookList(Book* head) {
-    Book* tmp;
-    while (head) { freeBookCopies(head->copies); tmp = head; head = head->next; free(tmp); }
+
+int runMemoryReport(int bookCount) {
+    static const char* firstNames[] = { "Ada", "Alan", "Grace", "Edsger", "Donald", "Barbara", "Niklaus", "Frances" };
+    static const char* lastNames[] = { "Lovelace", "Turing", "Hopper", "Dijkstra", "Knuth", "Liskov", "Wirth", "Allen" };
+    int studentCount = bookCount / 10 + 1, authorCount = bookCount / 20 + 1;
+    char text[MAX_NAME_LEN], isbn[ISBN_LEN];
+
+    // Lists are linked directly in sorted order; no index is needed here
+    Library lib;
+    memset(&lib, 0, sizeof(lib));
+    size_t copyCount = 0;
+    for (int b = bookCount - 1; b >= 0; b--) {
+        snprintf(text, sizeof(text), "Title %07d: A Study of Volume %d", b, b % 40);
+        snprintf(isbn, sizeof(isbn), "978%010d", b);
+        Book* book = (Book*)calloc(1, sizeof(Book));
+        if (!book) return 1;
+        book->title = internString(text);
+        strcpy(book->isbn, isbn);
+        for (int c = 1; c <= STRESS_COPIES; c++) {
+            BookCopy* copy = (BookCopy*)calloc(1, sizeof(BookCopy));
+            if (!copy) return 1;
+            snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", isbn, c);
+            strcpy(copy->borrowerStudentId, "SHELF");
+            copy->next = book->copies;
+            book->copies = copy;
+            book->quantity++;
+            copyCount++;
+        }
+        book->next = lib.books;
+        lib.books = book;
+    }
+    for (int i = studentCount - 1; i >= 0; i--) {
+        Student* st = (Student*)calloc(1, sizeof(Student));
+        if (!st) return 1;
+        snprintf(st->studentId, sizeof(st->studentId), "2%07d", i % 10000000);
+        st->name = internString(firstNames[i % 8]);
+        st->surname = internString(lastNames[(i / 8) % 8]);
+        st->score = 100;
+        st->next = lib.students;
+        lib.students = st;
+    }
+    for (int i = authorCount; i >= 1; i--) {
+        Author* a = createAuthor(i, firstNames[i % 8], lastNames[(i / 3) % 8]);
+        if (!a) return 1;
+        a->next = lib.authors;
+        lib.authors = a;
+    }
+
+    printf("%d books, %zu copies, %d students, %d authors\n", bookCount, copyCount, studentCount, authorCount);
+    printf("Records\t\tCount\t\tBefore\t\t\tAfter\n");
+    printMemoryRow("authors", authorCount, sizeof(LegacyAuthor), sizeof(Author));
+    printMemoryRow("students", studentCount, sizeof(LegacyStudent), sizeof(Student));
+    printMemoryRow("books", bookCount, sizeof(LegacyBook), sizeof(Book));
+    printMemoryRow("copies", copyCount, sizeof(LegacyBookCopy), sizeof(BookCopy));
+    size_t arenaBytes = stringArena.reserved + stringArena.slotCount * sizeof(const char*);
+    printf("%-10s\t%zu\t\t-\t\t\t%.1f MB (%.1f MB text)\n", "strings", stringArena.count,
+           arenaBytes / (1024.0 * 1024.0), stringArena.bytes / (1024.0 * 1024.0));
+    size_t before = authorCount * sizeof(LegacyAuthor) + studentCount * sizeof(LegacyStudent)
+                  + bookCount * sizeof(LegacyBook) + copyCount * sizeof(LegacyBookCopy);
+    size_t after = authorCount * sizeof(Author) + studentCount * sizeof(Student)
+                 + bookCount * sizeof(Book) + copyCount * sizeof(BookCopy) + arenaBytes;
+    printf("Total\t\t\t\t%.1f MB\t\t\t%.1f MB\n", before / (1024.0 * 1024.0), after / (1024.0 * 1024.0));
+
+    freeBookList(lib.books);
+    freeStudentList(lib.students);
+    freeAuthorList(lib.authors);
+    return 0;
 }
-void freeAuthorList(Author* head) {
-    Author* tmp;
-    while(head){ tmp=head; head=head->next; free(tmp); }
+
+// --- BATCH AVAILABILITY BENCHMARK ---
+// Checks reading lists of growing size against a synthetic catalog with
+// a list scan per key, an index probe per key, and one batch lookup.
+
+static int scanAvailable(Book* head, const char* isbn) {
+    for (Book* b = head; b; b = b->next) {
+        if (strcmp(b->isbn, isbn) == 0) return countShelfCopies(b);
+    }
+    return -1;
 }
-void freeStudentList(Student* head) {
-    Student* tmp;
-    while(head){ tmp=head; head=head->next; free(tmp); }
+
+int runAvailabilityBenchmark(int bookCount) {
+    static const int batchSizes[] = { 10, 100, 1000, 10000 };
+    char text[MAX_NAME_LEN], isbn[ISBN_LEN];
+    Library lib;
+    memset(&lib, 0, sizeof(lib));
+    for (int b = bookCount - 1; b >= 0; b--) {
+        snprintf(text, sizeof(text), "Title %07d", b);
+        snprintf(isbn, sizeof(isbn), "978%010d", b);
+        Book* book = (Book*)calloc(1, sizeof(Book));
+        if (!book) return 1;
+        book->title = internString(text);
+        strcpy(book->isbn, isbn);
+        for (int c = 1; c <= STRESS_COPIES; c++) {
+            BookCopy* copy = (BookCopy*)calloc(1, sizeof(BookCopy));
+            if (!copy) return 1;
+            snprintf(copy->labelNo, sizeof(copy->labelNo), "%s_%d", isbn, c);
+            strcpy(copy->borrowerStudentId, c == 1 && b % 3 == 0 ? "20001234" : "SHELF");
+            copy->next = book->copies;
+            book->copies = copy;
+            book->quantity++;
+        }
+        book->next = lib.books;
+        lib.books = book;
+        catalogInsert(book);
+    }
+
+    int maxKeys = batchSizes[sizeof(batchSizes) / sizeof(batchSizes[0]) - 1];
+    char (*keyText)[ISBN_LEN] = malloc(sizeof(*keyText) * maxKeys);
+    char** keys = (char**)malloc(sizeof(char*) * maxKeys);
+    if (!keyText || !keys) return 1;
+    unsigned int seed = 4242;
+    for (int i = 0; i < maxKeys; i++) {
+        snprintf(keyText[i], ISBN_LEN, "978%010u", (unsigned int)rand_r(&seed) % (unsigned int)bookCount);
+        keys[i] = keyText[i];
+    }
+
+    printf("%d books, %d copies each\n", bookCount, STRESS_COPIES);
+    printf("Keys\tScan keys/s\tIndex keys/s\tBatch keys/s\n");
+    int verified = 1;
+    for (size_t s = 0; s < sizeof(batchSizes) / sizeof(batchSizes[0]); s++) {
+        int n = batchSizes[s];
+        struct timespec t0;
+        long scanSum = 0, indexSum = 0, batchSum = 0;
+
+        // The scan is quadratic; it is timed on at most 100 keys
+        int scanKeys = n < 100 ? n : 100;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < scanKeys; i++) scanSum += scanAvailable(lib.books, keys[i]);
+        double scanSecs = elapsedSeconds(&t0);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < n; i++) {
+            Book* b = catalogFind(keys[i]);
+            CatalogShard* shard = catalogShardOf(keys[i], strlen(keys[i]));
+            pthread_mutex_lock(&shard->lock);
+            indexSum += b ? countShelfCopies(b) : -1;
+            pthread_mutex_unlock(&shard->lock);
+        }
+        double indexSecs = elapsedSeconds(&t0);
+
+        AvailabilityBatch batch;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (!availabilityLookup(keys, n, &batch)) return 1;
+        double batchSecs = elapsedSeconds(&t0);
+        for (int i = 0; i < n; i++) {
+            batchSum += batch.rows[i].book ? batch.rows[i].available : -1;
+            if (i == scanKeys - 1 && batchSum != scanSum) verified = 0;
+        }
+        if (batchSum != indexSum) verified = 0;
+        availabilityFree(&batch);
+
+        printf("%d\t%.0f\t\t%.0f\t\t%.0f\n", n, scanSecs > 0 ? scanKeys / scanSecs : 0.0,
+               indexSecs > 0 ? n / indexSecs : 0.0, batchSecs > 0 ? n / batchSecs : 0.0);
+    }
+    printf("Results %s\n", verified ? "match" : "DIFFER");
+
+    for (Book* b = lib.books; b; b = b->next) catalogRemove(b);
+    freeBookList(lib.books);
+    free(keyText);
+    free(keys);
+    return verified ? 0 : 1;
 }
-void freeLoanList(LoanTransaction* head) {
-    LoanTransaction* tmp;
-    while(head){ tmp=head; head=head->next; free(tmp); }
+
+// --- LOAN HISTORY BENCHMARK ---
+// Generates a synthetic loan history and compares the resident linked
+// list with the columnar encoding: footprint in memory and on disk, and
+// the time of a monthly-volume + per-ISBN scan over the whole range.
+
+static void scanHistoryList(LoanTransaction* head, StringDict* isbns, int firstMonth, long* volumes, long* perIsbn) {
+    for (LoanTransaction* t = head; t; t = t->next) {
+        int day = dateToDayNumber(t->date);
+        if (day < 0) continue;
+        int y, m, d;
+        dayNumberToCivil(day, &y, &m, &d);
+        int isReturn = t->operationType == OP_TYPE_RETURN;
+        volumes[(y * 12 + m - 1 - firstMonth) * 2 + isReturn]++;
+        if (isReturn) continue;
+        size_t isbnLen;
+        splitLabel(t->bookLabelNo, &isbnLen);
+        int id = dictId(isbns, t->bookLabelNo, isbnLen, 0);
+        if (id >= 0) perIsbn[id]++;
+    }
 }
 
-int main() {
-    int lastID = 0;
-    Author* authors = loadAuthorsFromFile(&lastID);
-    Student* students = loadStudentsFromFile();
-    // Load books and then load copies into them
-    Book* books = loadBooksFromFile(FILE_BOOKS, FILE_COPIES);
-    loadBookCopiesFromFile(books, FILE_COPIES);
-    
-    LoanTransaction* loans = loadLoansFromFile();
-    
-    int mapCount = 0;
-    BookAuthorMap* mapArr = loadBookAuthorMap(&mapCount);
+int runHistoryBenchmark(int records) {
+    int studentCount = records / 50 + 1, bookCount = records / 20 + 1;
+    int firstDay = daysFromCivil(2020, 1, 1);
+    LoanTransaction* rows = (LoanTransaction*)malloc(sizeof(LoanTransaction) * records);
+    if (!rows) return 1;
+    // Borrow/return pairs, a few days apart, spread over five years
+    for (int i = 0; i < records; i++) {
+        int pair = i / 2;
+        int day = firstDay + (int)((long)pair * 1826 / (records / 2 + 1)) + (i % 2) * (3 + pair % 25);
+        LoanTransaction* t = &rows[i];
+        snprintf(t->studentId, sizeof(t->studentId), "2%07d", (int)(pair * 7919L % studentCount) % 10000000);
+        int book = (int)(pair * 2654435761UL % (unsigned long)bookCount);
+        snprintf(t->bookLabelNo, sizeof(t->bookLabelNo), "978%010d_%d", book, pair % STRESS_COPIES + 1);
+        t->operationType = (i % 2) ? OP_TYPE_RETURN : OP_TYPE_BORROW;
+        formatDayNumber(day, t->date, sizeof(t->date));
+        t->next = NULL;
+    }
+
+    // Resident form: one node per record, newest first
+    LoanTransaction* head = NULL;
+    for (int i = 0; i < records; i++) {
+        LoanTransaction* t = (LoanTransaction*)malloc(sizeof(LoanTransaction));
+        if (!t) return 1;
+        *t = rows[i];
+        t->next = head;
+        head = t;
+    }
+    CsvWriter w;
+    if (!csvWriterOpen(&w, FILE_BENCH_HISTORY_CSV, 0)) return 1;
+    for (int i = 0; i < records; i++) csvPutLoan(&w, &rows[i]);
+    csvWriterClose(&w);
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    LoanColumns cols;
+    if (!columnsBuild(&cols, rows, records) || !columnsWrite(&cols, FILE_BENCH_HISTORY_COL)) return 1;
+    double encodeSecs = elapsedSeconds(&t0);
+
+    // Round trip through the file
+    LoanColumns loaded;
+    LoanTransaction* decoded = NULL;
+    int verified = columnsRead(&loaded, FILE_BENCH_HISTORY_COL) && columnsDecode(&loaded, &decoded) == records;
+    for (int i = 0; verified && i < records; i++) {
+        verified = strcmp(decoded[i].studentId, rows[i].studentId) == 0 && strcmp(decoded[i].bookLabelNo, rows[i].bookLabelNo) == 0 &&
+                   decoded[i].operationType == rows[i].operationType && strcmp(decoded[i].date, rows[i].date) == 0;
+    }
+    free(decoded);
+    columnsFree(&loaded);
+
+    struct stat csvStat, colStat;
+    if (stat(FILE_BENCH_HISTORY_CSV, &csvStat) != 0 || stat(FILE_BENCH_HISTORY_COL, &colStat) != 0) return 1;
+    double listMb = (double)records * sizeof(LoanTransaction) / (1024.0 * 1024.0);
+    double csvMb = csvStat.st_size / (1024.0 * 1024.0);
+    double colMemMb = columnsMemory(&cols) / (1024.0 * 1024.0);
+    double colFileMb = colStat.st_size / (1024.0 * 1024.0);
+    printf("%d records, %d students, %d ISBNs (encoded in %.3f s, round trip %s)\n", records, cols.students.count,
+           cols.isbns.count, encodeSecs, verified ? "verified" : "MISMATCH");
+    printf("Form\t\tMemory\t\tFile\n");
+    printf("list + csv\t%.1f MB\t\t%.1f MB\n", listMb, csvMb);
+    printf("columns\t\t%.1f MB\t\t%.1f MB\n", colMemMb, colFileMb);
+    printf("ratio\t\t%.1fx\t\t%.1fx\n", colMemMb > 0 ? listMb / colMemMb : 0.0, colFileMb > 0 ? csvMb / colFileMb : 0.0);
+
+    int firstMonth = 2020 * 12, monthCount = 6 * 12;
+    long* volumes = (long*)calloc((size_t)monthCount * 2, sizeof(long));
+    long* perIsbn = (long*)calloc(cols.isbns.count, sizeof(long));
+    if (!volumes || !perIsbn) return 1;
+    double bestList = 0, bestCols = 0;
+    long listTotal = 0, colsTotal = 0;
+    for (int pass = 0; pass < 5; pass++) {
+        memset(volumes, 0, sizeof(long) * monthCount * 2);
+        memset(perIsbn, 0, sizeof(long) * cols.isbns.count);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        scanHistoryList(head, &cols.isbns, firstMonth, volumes, perIsbn);
+        double secs = elapsedSeconds(&t0);
+        if (pass == 0 || secs < bestList) bestList = secs;
+        listTotal = 0;
+        for (int i = 0; i < cols.isbns.count; i++) listTotal += perIsbn[i];
+
+        memset(volumes, 0, sizeof(long) * monthCount * 2);
+        memset(perIsbn, 0, sizeof(long) * cols.isbns.count);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        columnsScan(&cols, 0, INT_MAX, firstMonth, volumes, perIsbn);
+        secs = elapsedSeconds(&t0);
+        if (pass == 0 || secs < bestCols) bestCols = secs;
+        colsTotal = 0;
+        for (int i = 0; i < cols.isbns.count; i++) colsTotal += perIsbn[i];
+    }
+    printf("Scan (monthly volumes + borrows per ISBN), best of 5 passes\n");
+    printf("list\t\t%.1f ms\t\t%.1f M records/s\t(%ld borrows)\n", bestList * 1000, bestList > 0 ? records / bestList / 1e6 : 0.0, listTotal);
+    printf("columns\t\t%.1f ms\t\t%.1f M records/s\t(%ld borrows)\n", bestCols * 1000, bestCols > 0 ? records / bestCols / 1e6 : 0.0, colsTotal);
+
+    free(volumes);
+    free(perIsbn);
+    columnsFree(&cols);
+    free(rows);
+    freeLoanList(head);
+    unlink(FILE_BENCH_HISTORY_CSV);
+    unlink(FILE_BENCH_HISTORY_COL);
+    return verified ? 0 : 1;
+}
+
+// Removes "--name value" from argv and returns its value (or NULL)
+static const char* takeOption(int* argc, char* argv[], const char* name) {
+    for (int i = 1; i + 1 < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char* value = argv[i + 1];
+            for (int j = i; j + 2 < *argc; j++) argv[j] = argv[j + 2];
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    catalogInit();
+
+    const char* opt;
+    if ((opt = takeOption(&argc, argv, "--commit-window"))) journal.windowUs = atoi(opt);
+    if ((opt = takeOption(&argc, argv, "--commit-batch"))) journal.maxBatch = atoi(opt);
+    if ((opt = takeOption(&argc, argv, "--checkpoint-interval"))) checkpointer.intervalSec = atoi(opt);
+    if ((opt = takeOption(&argc, argv, "--checkpoint-dirty"))) checkpointer.dirtyThreshold = atoi(opt);
+    if ((opt = takeOption(&argc, argv, "--archive-days"))) archiveHorizonDays = atoi(opt);
+    if ((opt = takeOption(&argc, argv, "--journal-io"))) journal.useUring = strcmp(opt, "thread") != 0;
+    if ((opt = takeOption(&argc, argv, "--commit-mode"))) journal.asyncCommit = strcmp(opt, "async") == 0;
+    if ((opt = takeOption(&argc, argv, "--storage"))) {
+        storage = storageFind(opt);
+        if (!storage) {
+            printf("Unknown storage engine: %s (csv, binary or memory)\n", opt);
+            return 1;
+        }
+    }
+    long budgetKb = KIOSK_DEFAULT_BUDGET_KB;
+    if ((opt = takeOption(&argc, argv, "--memory-budget"))) budgetKb = atol(opt);
+    if (budgetKb < 0) budgetKb = KIOSK_DEFAULT_BUDGET_KB;
+    if (checkpointer.intervalSec < 1) checkpointer.intervalSec = CHECKPOINT_DEFAULT_INTERVAL_SEC;
+    if (checkpointer.dirtyThreshold < 1) checkpointer.dirtyThreshold = 1;
+    if (journal.windowUs < 0) journal.windowUs = 0;
+    if (journal.maxBatch < 1) journal.maxBatch = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--bench-commit") == 0) {
+        int threads = (argc > 2) ? atoi(argv[2]) : 8;
+        int transactions = (argc > 3) ? atoi(argv[3]) : 200;
+        if (threads < 1) threads = 8;
+        if (transactions < 2) transactions = 200;
+        return runCommitBenchmark(threads, transactions);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-latency") == 0) {
+        int threads = (argc > 2) ? atoi(argv[2]) : 8;
+        int transactions = (argc > 3) ? atoi(argv[3]) : LATENCY_BENCH_DEFAULT_OPS;
+        if (threads < 1) threads = 8;
+        if (transactions < 2) transactions = LATENCY_BENCH_DEFAULT_OPS;
+        return runLatencyBenchmark(threads, transactions);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-storage") == 0) {
+        int books = (argc > 2) ? atoi(argv[2]) : STORAGE_BENCH_DEFAULT_BOOKS;
+        if (books < 0) books = STORAGE_BENCH_DEFAULT_BOOKS;
+        return runStorageBenchmark(books, 4, 1000);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-parse") == 0) {
+        int rows = (argc > 2) ? atoi(argv[2]) : PARSE_BENCH_DEFAULT_ROWS;
+        if (rows < 1) rows = PARSE_BENCH_DEFAULT_ROWS;
+        return runParseBenchmark(rows);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-save") == 0) {
+        int copies = (argc > 2) ? atoi(argv[2]) : SAVE_BENCH_DEFAULT_COPIES;
+        if (copies < 1) copies = SAVE_BENCH_DEFAULT_COPIES;
+        return runSaveBenchmark(copies);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-history") == 0) {
+        int records = (argc > 2) ? atoi(argv[2]) : HISTORY_BENCH_DEFAULT_RECORDS;
+        if (records < 2) records = HISTORY_BENCH_DEFAULT_RECORDS;
+        return runHistoryBenchmark(records);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-avail") == 0) {
+        int books = (argc > 2) ? atoi(argv[2]) : AVAIL_BENCH_DEFAULT_BOOKS;
+        if (books < 1) books = AVAIL_BENCH_DEFAULT_BOOKS;
+        return runAvailabilityBenchmark(books);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--memory-report") == 0) {
+        int books = (argc > 2) ? atoi(argv[2]) : MEMORY_REPORT_DEFAULT_BOOKS;
+        if (books < 1) books = MEMORY_REPORT_DEFAULT_BOOKS;
+        return runMemoryReport(books);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+        int threads = (argc > 2) ? atoi(argv[2]) : SERVER_DEFAULT_WORKERS;
+        int ops = (argc > 3) ? atoi(argv[3]) : 100000;
+        if (threads < 1) threads = SERVER_DEFAULT_WORKERS;
+        if (ops < 1) ops = 100000;
+        return runStressTest(threads, ops);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--reader") == 0) return runReader();
+
+    if (argc > 1 && strcmp(argv[1], "--kiosk") == 0) {
+        const char* path = (argc > 2) ? argv[2] : SERVER_SOCKET_PATH;
+        int workers = (argc > 3) ? atoi(argv[3]) : SERVER_DEFAULT_WORKERS;
+        if (workers < 1) workers = SERVER_DEFAULT_WORKERS;
+        return runKiosk(path, workers, (size_t)budgetKb * 1024);
+    }
+
+    Library lib;
+    loadLibrary(&lib);
+
+    // Read-only report; the replayed journal is left for the next run
+    if (argc > 2 && strcmp(argv[1], "--availability") == 0) {
+        int rc = runAvailabilityReport(argv[2]);
+        freeLibrary(&lib);
+        return rc;
+    }
+
+    if (!storage->open()) printf("Changes will not be persisted (%s storage).\n", storage->name);
+    checkpointerStart(&lib);
+
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        const char* path = (argc > 2) ? argv[2] : SERVER_SOCKET_PATH;
+        int workers = (argc > 3) ? atoi(argv[3]) : SERVER_DEFAULT_WORKERS;
+        if (workers < 1) workers = SERVER_DEFAULT_WORKERS;
+        int rc = runServer(&lib, path, workers);
+        checkpointerStop();
+        saveLibrary(&lib);
+        storage->close();
+        freeLibrary(&lib);
+        return rc;
+    }
 
     int choice;
     do {
         printf("\n=== Library Automation System ===\n");
-        printf("1. Author Ops\n2. Student Ops\n3. Book Ops\n0. Exit\nSelect: ");
+        printf("1. Author Ops\n2. Student Ops\n3. Book Ops\n4. Statistics\n0. Exit\nSelect: ");
         scanf("%d", &choice); while(getchar()!='\n');
         
         switch(choice) {
-            case 1: menuAuthors(&authors, &mapArr, &mapCount); break;
-            case 2: menuStudents(&students, &books, &loans); break;
-            case 3: menuBooks(&books, authors, &mapArr, &mapCount); break;
+            case 1: menuAuthors(&lib.authors, &lib.mapArr, &lib.mapCount); break;
+            case 2: menuStudents(&lib.students, &lib.loans); break;
+            case 3: menuBooks(&lib.books, lib.authors, &lib.mapArr, &lib.mapCount); break;
+            case 4: menuStatistics(&lib); break;
             case 0: printf("Exiting...\n"); break;
         }
     } while (choice != 0);
 
     // Save final state
-    saveAuthorsToFile(authors, FILE_AUTHORS);
-    saveStudentsToFile(students, FILE_STUDENTS);
-    saveBooksToFile(books, FILE_BOOKS);
-    saveBookCopiesToFile(books, FILE_COPIES);
-    saveLoansToFile(loans);
-    saveBookAuthorMapToFile(mapArr, mapCount);
+    checkpointerStop();
+    saveLibrary(&lib);
+    storage->close();
 
     // Cleanup
-    freeAuthorList(authors);
-    freeStudentList(students);
-    freeBookList(books);
-    freeLoanList(loans);
-    if(mapArr) free(mapArr);
+    freeLibrary(&lib);
 
     return 0;
-}
\ No newline at end of file
+}